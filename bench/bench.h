@@ -0,0 +1,47 @@
+#ifndef OMORI_PATCHER_BENCH_H
+#define OMORI_PATCHER_BENCH_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Bench
+{
+    // Runs the measured operation the given number of times
+    typedef std::function<void(uint64_t iterations)> Fn;
+
+    struct Case
+    {
+        std::string name;
+        Fn fn;
+    };
+
+    std::vector<Case>& Cases();
+
+    /**
+     * Registers a benchmark from a static initializer. Fixtures are built on the first call, which is an untimed
+     * warmup, so only the operation itself is measured
+     */
+    struct Register
+    {
+        Register(const char* name, Fn fn)
+        {
+            Cases().push_back({name, std::move(fn)});
+        }
+    };
+
+    // Keeps the compiler from dropping a result nothing reads
+    template<typename T>
+    inline void Keep(const T& value)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        asm volatile("" : : "r,m"(value) : "memory");
+#else
+        static volatile const void* sink;
+        sink = &value;
+#endif
+    }
+}
+
+#endif //OMORI_PATCHER_BENCH_H
@@ -0,0 +1,40 @@
+#include <cstdint>
+#include <vector>
+#include "bench.h"
+#include "decode.h"
+
+namespace
+{
+    // A typical MSVC prologue: spills, frame setup, a rip relative load and a call
+    const uint8_t PROLOGUE[] = {
+            0x48, 0x89, 0x5C, 0x24, 0x08,             // mov [rsp+8], rbx
+            0x48, 0x89, 0x74, 0x24, 0x10,             // mov [rsp+16], rsi
+            0x57,                                     // push rdi
+            0x48, 0x83, 0xEC, 0x20,                   // sub rsp, 32
+            0x48, 0x8B, 0x05, 0x44, 0x33, 0x22, 0x00, // mov rax, [rip+0x223344]
+            0x48, 0x8B, 0xF9,                         // mov rdi, rcx
+            0xE8, 0x10, 0x20, 0x30, 0x00,             // call rel32
+            0xC3                                      // ret
+    };
+    // Bytes a 14 byte absolute jump overwrites
+    const size_t HOOK_LEN = 14;
+
+    // Every call decodes a function it hasn't seen, like hooking or scanning a new site
+    Bench::Register cold("decode/window_cold", [](uint64_t iterations) {
+        std::vector<InsnInfo> insns;
+        static uint64_t addr = 0x140001000;
+        for (uint64_t i = 0; i < iterations; i++)
+        {
+            addr += 0x1000;
+            Bench::Keep(Decode::Window(PROLOGUE, addr, sizeof(PROLOGUE), HOOK_LEN, insns));
+        }
+    });
+
+    Bench::Register cached("decode/window_cached", [](uint64_t iterations) {
+        std::vector<InsnInfo> insns;
+        for (uint64_t i = 0; i < iterations; i++)
+        {
+            Bench::Keep(Decode::Window(PROLOGUE, 0x140001000, sizeof(PROLOGUE), HOOK_LEN, insns));
+        }
+    });
+}
@@ -0,0 +1,47 @@
+#include <cstdarg>
+#include <cstdio>
+#include "bench.h"
+#include "binlog.h"
+
+namespace
+{
+    // Formats like Utils::logf does before handing the line to Log::Write
+    int formatText(char* buf, size_t size, const char* format, ...)
+    {
+        va_list args;
+        va_start(args, format);
+        int len = vsnprintf(buf, size, format, args);
+        va_end(args);
+        return len;
+    }
+
+    // Encodes like BinLog::Record does when the binary log is on, without the timestamp and thread id lookups
+    template<typename... Args>
+    size_t encodeBinary(BinLog::Encoder& e, uint32_t id, Args... args)
+    {
+        e.begin(id, 1, 0);
+        (e.arg(args), ...);
+        e.end();
+        return e.len;
+    }
+
+    const char* FORMAT = "[overlay] %s -> %ls (%d bytes at %p)";
+    const char* SOURCE = "C:\\Games\\OMORI\\www\\img\\pictures\\asset_42.png";
+    const wchar_t* TARGET = L"C:\\mods\\oneshot_crossover\\img\\pictures\\asset_42.png";
+
+    Bench::Register text("log/format_text", [](uint64_t iterations) {
+        char buf[1024];
+        for (uint64_t i = 0; i < iterations; i++)
+        {
+            Bench::Keep(formatText(buf, sizeof(buf), FORMAT, SOURCE, TARGET, (int) i, (void*) buf));
+        }
+    });
+
+    Bench::Register binary("log/encode_binary", [](uint64_t iterations) {
+        BinLog::Encoder e;
+        for (uint64_t i = 0; i < iterations; i++)
+        {
+            Bench::Keep(encodeBinary(e, 7, SOURCE, TARGET, (int) i, (void*) &e));
+        }
+    });
+}
@@ -0,0 +1,116 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "bench.h"
+#include "jsonreader.h"
+#include "manifest.h"
+#include "mappedfile.h"
+
+namespace
+{
+    // A large mod list, each manifest replacing a few dozen files
+    const int MOD_COUNT = 300;
+
+    std::string manifestText(int i)
+    {
+        std::string id = "synthetic_mod_" + std::to_string(i);
+        std::string text = "{\n  \"id\": \"" + id + "\",\n  \"name\": \"Synthetic Mod " + std::to_string(i) +
+                           "\",\n  \"description\": \"Replaces pictures, maps and plugins for benchmarking\",\n"
+                           "  \"version\": \"1." + std::to_string(i % 10) + ".0\",\n  \"main\": \"main.js\",\n"
+                           "  \"files\": {\n";
+        const char* kinds[] = {"img", "data", "audio", "plugins"};
+        for (int k = 0; k < 4; k++)
+        {
+            text += std::string("    \"") + kinds[k] + "\": [";
+            for (int f = 0; f < 8 + (i + k) % 8; f++)
+            {
+                text += (f == 0 ? "\"" : ", \"") + std::string(kinds[k]) + "/asset_" + std::to_string(f) + ".dat\"";
+            }
+            text += k == 3 ? "]\n" : "],\n";
+        }
+        text += "  },\n  \"patches\": [\"patches/fix_" + std::to_string(i) + ".1337\"]\n}\n";
+        return text;
+    }
+
+    /**
+     * A mods directory of synthetic mods on disk, removed again at exit
+     */
+    struct ModsDir
+    {
+        std::string root;
+        std::vector<std::string> dirs;
+
+        ModsDir()
+        {
+            char pattern[] = "/tmp/omori-bench-mods-XXXXXX";
+            if (mkdtemp(pattern) == nullptr) return;
+            root = pattern;
+            for (int i = 0; i < MOD_COUNT; i++)
+            {
+                // Mixed case and underscores, like real mod folders
+                std::string dir = (i % 3 == 0 ? "_" : i % 3 == 1 ? "Mod" : "mod") + std::to_string(i * 7919 % 1000);
+                dir += "_" + std::to_string(i);
+                std::string path = root + "/" + dir;
+                mkdir(path.c_str(), 0755);
+                FILE* file = fopen((path + "/mod.json").c_str(), "wb");
+                if (file == nullptr) continue;
+                std::string text = manifestText(i);
+                fwrite(text.data(), 1, text.size(), file);
+                fclose(file);
+                dirs.push_back(dir);
+            }
+        }
+
+        ~ModsDir()
+        {
+            for (const std::string& dir : dirs)
+            {
+                unlink((root + "/" + dir + "/mod.json").c_str());
+                rmdir((root + "/" + dir).c_str());
+            }
+            if (!root.empty()) rmdir(root.c_str());
+        }
+    };
+
+    const ModsDir& modsDir()
+    {
+        static const ModsDir instance;
+        return instance;
+    }
+
+    // What ParseMods does for every mod once the directory listing is known, minus the reporting
+    Bench::Register parse("manifest/parse_300_mods", [](uint64_t iterations) {
+        const ModsDir& mods = modsDir();
+        std::string error;
+        for (uint64_t i = 0; i < iterations; i++)
+        {
+            size_t valid = 0;
+            for (const std::string& dir : mods.dirs)
+            {
+                MappedFile file((mods.root + "/" + dir + "/mod.json").c_str());
+                Json::Value root;
+                if (file.isOpen() && JsonReader::Parse(file.data(), file.end(), root, error) &&
+                    Manifest::Validate(root, error))
+                {
+                    valid++;
+                }
+            }
+            Bench::Keep(valid);
+        }
+    });
+
+    Bench::Register sort("manifest/sort_300_dirs", [](uint64_t iterations) {
+        const ModsDir& mods = modsDir();
+        std::vector<std::string> dirs;
+        for (uint64_t i = 0; i < iterations; i++)
+        {
+            dirs = mods.dirs;
+            std::sort(dirs.begin(), dirs.end(), Manifest::DirLess);
+            Bench::Keep(dirs.front());
+        }
+    });
+}
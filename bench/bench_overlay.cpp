@@ -0,0 +1,127 @@
+#include <string>
+#include <vector>
+#include "bench.h"
+#include "fileapi_posix.h"
+#include "overlay.h"
+
+namespace
+{
+    // Roughly the number of files a large mod list replaces
+    const int OVERLAY_ENTRIES = 5000;
+    const wchar_t* GAME_DIR = L"C:\\Program Files (x86)\\Steam\\steamapps\\common\\OMORI\\www\\";
+
+    /**
+     * Opens succeed without touching the disk, so only the overlay itself is measured
+     */
+    class NullFileApi : public PosixFileApi
+    {
+    public:
+        FileHandle createFile(const wchar_t*, uint32_t, uint32_t, void*, uint32_t, uint32_t, FileHandle) override
+        {
+            return (FileHandle) (intptr_t) 1;
+        }
+
+        bool readFile(FileHandle, void*, uint32_t size, uint32_t* read, void*) override
+        {
+            if (read != nullptr) *read = size;
+            return true;
+        }
+
+        bool setFilePointer(FileHandle, int64_t distance, int64_t* newPointer, uint32_t) override
+        {
+            if (newPointer != nullptr) *newPointer = distance;
+            return true;
+        }
+
+        bool closeFile(FileHandle) override
+        {
+            return true;
+        }
+    };
+
+    std::wstring gamePath(int i)
+    {
+        const wchar_t* dirs[] = {L"img\\pictures\\", L"img\\characters\\", L"audio\\bgm\\", L"data\\", L"js\\plugins\\"};
+        return GAME_DIR + std::wstring(dirs[i % 5]) + L"asset_" + std::to_wstring(i) + L".dat";
+    }
+
+    struct OverlayFixture
+    {
+        NullFileApi api;
+        OverlayEngine loading{api};
+        OverlayEngine frozen{api};
+        std::vector<std::wstring> hits;
+        std::vector<std::wstring> misses;
+
+        OverlayFixture()
+        {
+            for (int i = 0; i < OVERLAY_ENTRIES; i++)
+            {
+                std::wstring target = L"C:\\mods\\mod_" + std::to_wstring(i % 40) + L"\\" + std::to_wstring(i) + L".dat";
+                loading.add(gamePath(i), target);
+                frozen.add(gamePath(i), target);
+                hits.push_back(gamePath((i * 7919) % OVERLAY_ENTRIES));
+                misses.push_back(gamePath(OVERLAY_ENTRIES + i));
+            }
+            frozen.freeze();
+        }
+    };
+
+    OverlayFixture& overlay()
+    {
+        static OverlayFixture fixture;
+        return fixture;
+    }
+
+    void find(OverlayEngine& engine, const std::vector<std::wstring>& paths, uint64_t iterations)
+    {
+        std::wstring target;
+        for (uint64_t i = 0; i < iterations; i++)
+        {
+            Bench::Keep(engine.find(paths[i % paths.size()], target));
+        }
+    }
+
+    Bench::Register findHit("overlay/find_hit", [](uint64_t iterations) {
+        find(overlay().frozen, overlay().hits, iterations);
+    });
+
+    Bench::Register findMiss("overlay/find_miss", [](uint64_t iterations) {
+        find(overlay().frozen, overlay().misses, iterations);
+    });
+
+    // Lookups while mods are still loading go through the lock and the map instead of the frozen index
+    Bench::Register findLoading("overlay/find_hit_loading", [](uint64_t iterations) {
+        find(overlay().loading, overlay().hits, iterations);
+    });
+
+    // Everything the CreateFileW detour does besides the real open: canonicalize, look up, check for memory files
+    Bench::Register createFile("overlay/create_file", [](uint64_t iterations) {
+        OverlayFixture& fixture = overlay();
+        bool redirected;
+        for (uint64_t i = 0; i < iterations; i++)
+        {
+            const std::wstring& path = (i & 1) != 0 ? fixture.hits[i % fixture.hits.size()]
+                                                     : fixture.misses[i % fixture.misses.size()];
+            Bench::Keep(fixture.frozen.createFile(path.c_str(), 0, 0, nullptr, DISPOSITION_OPEN_EXISTING, 0,
+                                                         nullptr, &redirected));
+        }
+    });
+
+    Bench::Register canonicalAbsolute("path/absolute", [](uint64_t iterations) {
+        NullFileApi& api = overlay().api;
+        std::wstring path = gamePath(42);
+        for (uint64_t i = 0; i < iterations; i++) Bench::Keep(api.absolutePath(path.c_str()));
+    });
+
+    Bench::Register canonicalRelative("path/relative", [](uint64_t iterations) {
+        NullFileApi& api = overlay().api;
+        for (uint64_t i = 0; i < iterations; i++) Bench::Keep(api.absolutePath(L"www\\img\\pictures\\asset_42.dat"));
+    });
+
+    Bench::Register hostPath("path/host", [](uint64_t iterations) {
+        NullFileApi& api = overlay().api;
+        std::wstring path = gamePath(42);
+        for (uint64_t i = 0; i < iterations; i++) Bench::Keep(api.hostPath(path.c_str()));
+    });
+}
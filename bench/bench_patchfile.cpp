@@ -0,0 +1,33 @@
+#include <cstdio>
+#include <string>
+#include "bench.h"
+#include "patchfile.h"
+
+namespace
+{
+    /**
+     * A patch file the size of a large binary mod, runs of a few bytes spread through the module
+     */
+    std::string patchText(int bytes)
+    {
+        std::string text = ">omori.exe\r\n";
+        char line[64];
+        for (int i = 0; i < bytes; i++)
+        {
+            unsigned rva = 0x1000 + (i / 6) * 0x40 + i % 6;
+            snprintf(line, sizeof(line), "%08X:%02X->%02X\r\n", rva, (i * 31) & 0xFF, (i * 17 + 1) & 0xFF);
+            text += line;
+        }
+        return text;
+    }
+
+    Bench::Register parse("patchfile/parse", [](uint64_t iterations) {
+        static const std::string text = patchText(20000);
+        PatchSet set;
+        std::string error;
+        for (uint64_t i = 0; i < iterations; i++)
+        {
+            Bench::Keep(PatchFile::Parse(text, set, error));
+        }
+    });
+}
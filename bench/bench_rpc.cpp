@@ -0,0 +1,35 @@
+#include <string>
+#include "bench.h"
+#include "rpc.h"
+
+namespace
+{
+    void parse(const std::string& msg, uint64_t iterations)
+    {
+        int func;
+        Json::Value data;
+        std::string error;
+        for (uint64_t i = 0; i < iterations; i++)
+        {
+            Bench::Keep(rpc::ParseEnvelope(msg.data(), msg.data() + msg.size(), func, data, error));
+        }
+    }
+
+    // What a mod sends to hook a function, the most frequent message while mods load
+    Bench::Register hook("rpc/envelope_hook", [](uint64_t iterations) {
+        static const std::string msg = R"({"func":3,"data":{"name":"Game_Interpreter.prototype.command101",)"
+                                       R"("callback":"__omori_hook_17"}})";
+        parse(msg, iterations);
+    });
+
+    // A save written through the game, the largest message
+    Bench::Register writeFile("rpc/envelope_write_file", [](uint64_t iterations) {
+        static const std::string msg = []() {
+            std::string save;
+            for (int i = 0; save.size() < 64 * 1024; i++) save += "N4IgLgngDgpiBcIBKMDOB7ArgGzQAgEEA" + std::to_string(i);
+            return R"({"func":1,"data":{"filename":"C:\\Games\\OMORI\\www\\save\\file1.rpgsave","data":")" + save +
+                   R"(","replace":true}})";
+        }();
+        parse(msg, iterations);
+    });
+}
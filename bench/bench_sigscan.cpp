@@ -0,0 +1,61 @@
+#include <cstdint>
+#include <vector>
+#include "bench.h"
+#include "sigscan.h"
+
+namespace
+{
+    const size_t TEXT_SIZE = 40 * 1024 * 1024;
+
+    /**
+     * A .text section the size of the game's, bytes drawn with the skew of x64 code so the scan's anchor bytes
+     * show up as often as they do in the real binary. The signature only occurs once, near the end
+     */
+    struct Fixture
+    {
+        std::vector<uint8_t> text;
+        Pattern pattern;
+
+        Fixture() : text(TEXT_SIZE)
+        {
+            // Common opcode and ModRM bytes, each picked a quarter of the time, random bytes otherwise
+            const uint8_t common[] = {0x48, 0x8B, 0x89, 0x00, 0xCC, 0xE8, 0x4C, 0x0F};
+            uint64_t state = 0x9E3779B97F4A7C15;
+            for (uint8_t& byte : text)
+            {
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                byte = (state & 3) == 0 ? common[(state >> 2) & 7] : (uint8_t) (state >> 8);
+            }
+            SigScan::Parse("48 8B 05 ?? ?? ?? ?? 48 85 C0 74 ?? 48 8B 40 08", pattern);
+            const uint8_t match[] = {0x48, 0x8B, 0x05, 0x44, 0x33, 0x22, 0x00, 0x48, 0x85, 0xC0, 0x74, 0x05,
+                                     0x48, 0x8B, 0x40, 0x08};
+            std::copy(match, match + sizeof(match), text.end() - 4096);
+        }
+    };
+
+    const Fixture& fixture()
+    {
+        static const Fixture instance;
+        return instance;
+    }
+
+    // Resolving a signature walks the whole section to its match
+    Bench::Register find("sigscan/find_40mb", [](uint64_t iterations) {
+        const Fixture& f = fixture();
+        for (uint64_t i = 0; i < iterations; i++)
+        {
+            Bench::Keep(SigScan::Find(f.text.data(), f.text.size(), f.pattern));
+        }
+    });
+
+    // Checking a generated signature is unique scans everything, there's no second match to stop at
+    Bench::Register unique("sigscan/count_unique_40mb", [](uint64_t iterations) {
+        const Fixture& f = fixture();
+        for (uint64_t i = 0; i < iterations; i++)
+        {
+            Bench::Keep(SigScan::Count(f.text.data(), f.text.size(), f.pattern, 2));
+        }
+    });
+}
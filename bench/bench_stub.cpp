@@ -0,0 +1,28 @@
+#include <cstdint>
+#include <vector>
+#include "bench.h"
+#include "stub.h"
+
+namespace
+{
+    // Hooks whose spec is only known at runtime encode their stub when they're installed
+    Bench::Register build("stub/build", [](uint64_t iterations) {
+        StubSpec spec = Stub::volatileSpec;
+        for (uint64_t i = 0; i < iterations; i++)
+        {
+            spec.stackArgs = (uint8_t) (i % 8);
+            Stub::StubTemplate stub = Stub::Build(spec, (i & 1) != 0);
+            Bench::Keep(stub.size);
+        }
+    });
+
+    Bench::Register instantiate("stub/instantiate", [](uint64_t iterations) {
+        const Stub::StubTemplate& stub = Stub::Precompiled<Stub::volatileSpec, true>;
+        std::vector<uint8_t> out;
+        for (uint64_t i = 0; i < iterations; i++)
+        {
+            Stub::Instantiate(stub, 0x7FF612340000 + i, 0x7FF612350000, 0, out);
+            Bench::Keep(out.data());
+        }
+    });
+}
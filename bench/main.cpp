@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <json/json.h>
+#include "bench.h"
+#include "jsonreader.h"
+
+// Benchmarks the patcher's hot paths on the host. Results are written as JSON, given a previous run as the baseline
+// every benchmark slower than the threshold is reported and the exit code is 1, so a run can gate a change
+
+namespace Bench
+{
+    std::vector<Case>& Cases()
+    {
+        static std::vector<Case> cases;
+        return cases;
+    }
+}
+
+struct Result
+{
+    std::string name;
+    uint64_t iterations;
+    double nsPerOp;
+    double minNsPerOp;
+};
+
+uint64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t timeRun(const Bench::Fn& fn, uint64_t iterations)
+{
+    uint64_t start = nowNs();
+    fn(iterations);
+    return nowNs() - start;
+}
+
+/**
+ * Grows the iteration count until one sample takes at least minNs, then takes the samples
+ */
+Result measure(const Bench::Case& bench, uint64_t minNs, int samples)
+{
+    bench.fn(1);
+    uint64_t iterations = 1;
+    while (true)
+    {
+        uint64_t elapsed = timeRun(bench.fn, iterations);
+        if (elapsed >= minNs || iterations >= (1ull << 40)) break;
+        double scale = elapsed == 0 ? 100.0 : std::min(100.0, 1.2 * (double) minNs / (double) elapsed);
+        iterations = std::max(iterations + 1, (uint64_t) ((double) iterations * scale));
+    }
+
+    std::vector<double> perOp;
+    for (int i = 0; i < samples; i++)
+    {
+        perOp.push_back((double) timeRun(bench.fn, iterations) / (double) iterations);
+    }
+    std::sort(perOp.begin(), perOp.end());
+    return {bench.name, iterations, perOp[perOp.size() / 2], perOp.front()};
+}
+
+bool loadBaseline(const char* path, std::map<std::string, double>& out)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return false;
+    }
+    std::stringstream contents;
+    contents << file.rdbuf();
+    std::string text = contents.str();
+    Json::Value root;
+    std::string error;
+    if (!JsonReader::Parse(text.data(), text.data() + text.size(), root, error) || !root["benchmarks"].isArray())
+    {
+        fprintf(stderr, "%s isn't a benchmark result: %s\n", path, error.c_str());
+        return false;
+    }
+    for (const Json::Value& bench : root["benchmarks"])
+    {
+        out[bench["name"].asString()] = bench["nsPerOp"].asDouble();
+    }
+    return true;
+}
+
+void usage()
+{
+    fprintf(stderr, "Usage: omori-patcher-bench [--filter substring] [--samples n] [--min-time ms] [--out results.json]\n"
+                    "                           [--baseline results.json] [--threshold percent] [--list]\n");
+}
+
+int main(int argc, char** argv)
+{
+    const char* filter = nullptr;
+    const char* outPath = nullptr;
+    const char* baselinePath = nullptr;
+    int samples = 7;
+    double minTimeMs = 50;
+    double threshold = 10;
+    bool list = false;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) filter = argv[++i];
+        else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) samples = std::max(atoi(argv[++i]), 1);
+        else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) minTimeMs = std::max(atof(argv[++i]), 1.0);
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) outPath = argv[++i];
+        else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) baselinePath = argv[++i];
+        else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) threshold = atof(argv[++i]);
+        else if (strcmp(argv[i], "--list") == 0) list = true;
+        else
+        {
+            usage();
+            return 2;
+        }
+    }
+
+    std::vector<Bench::Case> cases = Bench::Cases();
+    std::sort(cases.begin(), cases.end(), [](const Bench::Case& a, const Bench::Case& b) { return a.name < b.name; });
+    if (filter != nullptr)
+    {
+        std::erase_if(cases, [filter](const Bench::Case& bench) { return bench.name.find(filter) == std::string::npos; });
+    }
+    if (list)
+    {
+        for (const Bench::Case& bench : cases) printf("%s\n", bench.name.c_str());
+        return 0;
+    }
+
+    std::map<std::string, double> baseline;
+    if (baselinePath != nullptr && !loadBaseline(baselinePath, baseline)) return 2;
+
+    Json::Value root;
+    root["version"] = 1;
+    root["samples"] = samples;
+    root["minTimeMs"] = minTimeMs;
+    Json::Value& benchmarks = root["benchmarks"] = Json::Value(Json::arrayValue);
+    int regressions = 0;
+    for (const Bench::Case& bench : cases)
+    {
+        Result result = measure(bench, (uint64_t) (minTimeMs * 1e6), samples);
+        Json::Value entry;
+        entry["name"] = result.name;
+        entry["iterations"] = (Json::UInt64) result.iterations;
+        entry["nsPerOp"] = result.nsPerOp;
+        entry["minNsPerOp"] = result.minNsPerOp;
+        fprintf(stderr, "%-32s %12.1f ns/op", result.name.c_str(), result.nsPerOp);
+
+        auto previous = baseline.find(result.name);
+        if (previous != baseline.end() && previous->second > 0)
+        {
+            double change = (result.nsPerOp / previous->second - 1) * 100;
+            bool regressed = change > threshold;
+            regressions += regressed;
+            entry["baselineNsPerOp"] = previous->second;
+            entry["changePercent"] = std::round(change * 10) / 10;
+            entry["regressed"] = regressed;
+            fprintf(stderr, "  %+7.1f%%%s", change, regressed ? "  REGRESSED" : "");
+        }
+        fprintf(stderr, "\n");
+        benchmarks.append(entry);
+    }
+    if (!baseline.empty())
+    {
+        root["thresholdPercent"] = threshold;
+        root["regressions"] = regressions;
+    }
+
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "  ";
+    std::string json = Json::writeString(builder, root) + "\n";
+    if (outPath != nullptr)
+    {
+        std::ofstream out(outPath, std::ios::binary);
+        if (!(out << json))
+        {
+            fprintf(stderr, "Failed to write %s\n", outPath);
+            return 2;
+        }
+    }
+    else
+    {
+        fwrite(json.data(), 1, json.size(), stdout);
+    }
+
+    if (regressions > 0)
+    {
+        fprintf(stderr, "%d benchmark%s regressed by more than %.1f%%\n", regressions, regressions == 1 ? "" : "s",
+                threshold);
+        return 1;
+    }
+    return 0;
+}
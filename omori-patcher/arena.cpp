@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include "arena.h"
+
+namespace
+{
+    // Chunk bytes held by every arena of the process
+    std::atomic<size_t> heldBytes = 0;
+    std::atomic<size_t> heldPeak = 0;
+
+    void track(ptrdiff_t delta)
+    {
+        size_t now = heldBytes.fetch_add((size_t) delta, std::memory_order_relaxed) + (size_t) delta;
+        size_t peak = heldPeak.load(std::memory_order_relaxed);
+        while (now > peak && !heldPeak.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {}
+    }
+}
+
+Arena::Arena(size_t chunkSize) : chunkSize(chunkSize) {}
+
+Arena::~Arena()
+{
+    release();
+}
+
+/**
+ * Allocates uninitialized memory that stays valid until the enclosing Scope closes or the arena is released
+ * @param size Bytes to allocate
+ * @param align Alignment, a power of two
+ * @return The memory, or null if a new chunk couldn't be allocated
+ */
+void* Arena::alloc(size_t size, size_t align)
+{
+    if (head != nullptr)
+    {
+        auto base = (uintptr_t) (head + 1);
+        size_t offset = ((base + head->used + align - 1) & ~(uintptr_t) (align - 1)) - base;
+        if (offset + size <= head->size)
+        {
+            head->used = offset + size;
+            usedBytes += size;
+            return (void*) (base + offset);
+        }
+    }
+
+    size_t chunkBytes = std::max(chunkSize, sizeof(Chunk) + size + align);
+    auto chunk = (Chunk*) malloc(chunkBytes);
+    if (chunk == nullptr) return nullptr;
+    chunk->prev = head;
+    chunk->size = chunkBytes - sizeof(Chunk);
+    chunk->used = 0;
+    head = chunk;
+    track((ptrdiff_t) chunkBytes);
+    return alloc(size, align);
+}
+
+/**
+ * Frees every chunk, everything allocated from the arena becomes invalid
+ */
+void Arena::release()
+{
+    rewind(nullptr, 0, 0);
+}
+
+void Arena::rewind(Chunk* chunk, size_t offset, size_t used)
+{
+    while (head != chunk)
+    {
+        Chunk* prev = head->prev;
+        track(-(ptrdiff_t) (head->size + sizeof(Chunk)));
+        free(head);
+        head = prev;
+    }
+    if (head != nullptr) head->used = offset;
+    usedBytes = used;
+}
+
+/**
+ * Gets the arena of the calling thread, it lives as long as the thread and is released in bulk at the end of each
+ * load phase
+ */
+Arena& Arena::forThread()
+{
+    thread_local Arena arena;
+    return arena;
+}
+
+size_t Arena::totalBytes()
+{
+    return heldBytes.load(std::memory_order_relaxed);
+}
+
+size_t Arena::peakBytes()
+{
+    return heldPeak.load(std::memory_order_relaxed);
+}
+
+Arena::Scope::Scope(Arena& arena) : arena(arena), chunk(arena.head), offset(arena.head != nullptr ? arena.head->used : 0),
+                                    used(arena.usedBytes) {}
+
+Arena::Scope::~Scope()
+{
+    arena.rewind((Chunk*) chunk, offset, used);
+}
@@ -0,0 +1,71 @@
+#ifndef OMORI_PATCHER_ARENA_H
+#define OMORI_PATCHER_ARENA_H
+
+#include <cstddef>
+
+/**
+ * Bump allocator for the short-lived allocations of the load phase. Nothing is freed individually, a Scope gives
+ * back everything allocated since it was opened and release() frees the whole arena at once
+ */
+class Arena
+{
+public:
+    explicit Arena(size_t chunkSize = 64 * 1024);
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* alloc(size_t size, size_t align = alignof(std::max_align_t));
+    void release();
+
+    template<typename T>
+    T* allocArray(size_t count)
+    {
+        return (T*) alloc(count * sizeof(T), alignof(T));
+    }
+
+    size_t used() const
+    {
+        return usedBytes;
+    }
+
+    static Arena& forThread();
+    static size_t totalBytes();
+    static size_t peakBytes();
+
+    /**
+     * Rewinds the arena to where it was on construction, scopes have to be closed in reverse order
+     */
+    class Scope
+    {
+    public:
+        explicit Scope(Arena& arena);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Arena& arena;
+        void* chunk;
+        size_t offset;
+        size_t used;
+    };
+
+private:
+    struct Chunk
+    {
+        Chunk* prev;
+        size_t size;
+        size_t used;
+    };
+
+    Chunk* head = nullptr;
+    size_t chunkSize;
+    size_t usedBytes = 0;
+
+    void rewind(Chunk* chunk, size_t offset, size_t used);
+};
+
+#endif //OMORI_PATCHER_ARENA_H
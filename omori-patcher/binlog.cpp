@@ -0,0 +1,129 @@
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "pch.h"
+#include "binlog.h"
+#include "utils.h"
+
+namespace BinLog
+{
+    struct FormatInfo
+    {
+        LogLevel level;
+        const char* format;
+        const char* file;
+        int line;
+    };
+
+    std::mutex formatsMutex;
+    std::vector<FormatInfo> formats;
+    std::atomic<bool> enabled = false;
+    FILE* binFile = nullptr;
+
+    std::string encodeFormat(uint32_t id, const FormatInfo& info)
+    {
+        std::string record;
+        auto put = [&record](const void* data, size_t size) { record.append((const char*) data, size); };
+        auto type = BinLogFormat::RECORD_FORMAT;
+        auto level = (uint8_t) info.level;
+        auto line = (uint32_t) info.line;
+        auto fileLen = (uint16_t) strlen(info.file);
+        auto formatLen = (uint16_t) strlen(info.format);
+        put(&type, sizeof(type));
+        put(&id, sizeof(id));
+        put(&level, sizeof(level));
+        put(&line, sizeof(line));
+        put(&fileLen, sizeof(fileLen));
+        put(info.file, fileLen);
+        put(&formatLen, sizeof(formatLen));
+        put(info.format, formatLen);
+        return record;
+    }
+
+    /**
+     * Assigns an id to a log call site, called once per site
+     * @return Id recorded in place of the format
+     */
+    uint32_t Register(LogLevel level, const char* format, const char* file, int line)
+    {
+        std::lock_guard lock(formatsMutex);
+        auto id = (uint32_t) formats.size();
+        formats.push_back({level, format, file, line});
+        if (enabled)
+        {
+            // Goes through the same ring as the site's events, so it's always written before them
+            std::string record = encodeFormat(id, formats.back());
+            Log::WriteBinary(record.data(), record.size());
+        }
+        return id;
+    }
+
+    /**
+     * Starts writing events to a binary log instead of formatting them, has to run before the log drain thread
+     * @param path Binary log to create
+     */
+    void Start(const std::string& path)
+    {
+        if (fopen_s(&binFile, path.c_str(), "wb") != 0 || binFile == nullptr)
+        {
+            binFile = nullptr;
+            Utils::Errorf("[log] Failed to open %s for writing", path.c_str());
+            return;
+        }
+        fwrite(BinLogFormat::MAGIC, 1, sizeof(BinLogFormat::MAGIC), binFile);
+        fwrite(&BinLogFormat::VERSION, sizeof(BinLogFormat::VERSION), 1, binFile);
+
+        std::lock_guard lock(formatsMutex);
+        for (uint32_t id = 0; id < formats.size(); id++)
+        {
+            std::string record = encodeFormat(id, formats[id]);
+            fwrite(record.data(), 1, record.size(), binFile);
+        }
+        enabled = true;
+    }
+
+    /**
+     * Appends records drained from the log rings
+     */
+    void WriteRecords(const std::string& records)
+    {
+        if (binFile == nullptr || records.empty()) return;
+        fwrite(records.data(), 1, records.size(), binFile);
+        fflush(binFile);
+    }
+
+    bool Enabled()
+    {
+        return enabled;
+    }
+
+    uint32_t ThreadId()
+    {
+        return GetCurrentThreadId();
+    }
+
+    uint64_t NowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * Formats an event as text when the binary log is disabled, debug events are only shown with log.verbose
+     */
+    void Fallback(LogLevel level, const char* format, ...)
+    {
+        if (level == LOG_DEBUG && !Log::Verbose()) return;
+        char buf[1024];
+        va_list args;
+        va_start(args, format);
+        int len = vsnprintf(buf, sizeof(buf), format, args);
+        va_end(args);
+        if (len < 0) return;
+        Log::Write(level, buf, std::min((size_t) len, sizeof(buf) - 1));
+    }
+}
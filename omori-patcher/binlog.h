@@ -0,0 +1,161 @@
+#ifndef OMORI_PATCHER_BINLOG_H
+#define OMORI_PATCHER_BINLOG_H
+
+#include <cstring>
+#include <cwchar>
+#include <string>
+#include <type_traits>
+#include "binlog_format.h"
+#include "log.h"
+
+namespace BinLog
+{
+    uint32_t Register(LogLevel level, const char* format, const char* file, int line);
+    bool Enabled();
+    uint32_t ThreadId();
+    uint64_t NowNs();
+    void Fallback(LogLevel level, const char* format, ...);
+    void Start(const std::string& path);
+    void WriteRecords(const std::string& records);
+
+    /**
+     * Encodes an event record into a fixed buffer. Strings that don't fit are clipped and arguments that don't fit
+     * at all are dropped, either way the record is flagged as truncated
+     */
+    struct Encoder
+    {
+        char buf[512];
+        size_t len = 0;
+        size_t argCountPos = 0;
+        bool truncated = false;
+
+        void put(const void* data, size_t size)
+        {
+            size = size < sizeof(buf) - len ? size : sizeof(buf) - len;
+            memcpy(buf + len, data, size);
+            len += size;
+        }
+
+        template<typename T>
+        void putValue(T value)
+        {
+            put(&value, sizeof(value));
+        }
+
+        /**
+         * Checks that size more bytes fit, flags the record as truncated if they don't
+         */
+        bool fits(size_t size)
+        {
+            if (size <= sizeof(buf) - len) return true;
+            truncated = true;
+            return false;
+        }
+
+        void begin(uint32_t id, uint32_t threadId, uint64_t timeNs)
+        {
+            len = 0;
+            truncated = false;
+            putValue(BinLogFormat::RECORD_EVENT);
+            putValue(id);
+            putValue(threadId);
+            putValue(timeNs);
+            argCountPos = len;
+            putValue((uint8_t) 0);
+        }
+
+        void end()
+        {
+            if (truncated) buf[argCountPos] |= BinLogFormat::EVENT_TRUNCATED;
+        }
+
+        template<typename T>
+        bool putNumber(BinLogFormat::ArgType type, T value)
+        {
+            if (!fits(sizeof(type) + sizeof(value))) return false;
+            putValue(type);
+            putValue(value);
+            return true;
+        }
+
+        /**
+         * @param unit Size of one character, clipping never splits one
+         */
+        bool putBytes(BinLogFormat::ArgType type, const void* data, size_t size, size_t unit)
+        {
+            const size_t header = sizeof(type) + sizeof(uint32_t);
+            if (!fits(header)) return false;
+            // Leave half of the remaining room for the arguments after this one
+            size_t limit = (sizeof(buf) - len - header) / 2 / unit * unit;
+            auto clipped = (uint32_t) (size < limit ? size : limit);
+            if (clipped < size) truncated = true;
+            putValue(type);
+            putValue(clipped);
+            put(data, clipped);
+            return true;
+        }
+
+        template<typename T>
+        void arg(T value)
+        {
+            bool written;
+            if constexpr (std::is_same_v<std::decay_t<T>, const char*> || std::is_same_v<std::decay_t<T>, char*>)
+            {
+                const char* str = value != nullptr ? value : "(null)";
+                written = putBytes(BinLogFormat::ARG_STRING, str, strlen(str), 1);
+            }
+            else if constexpr (std::is_same_v<std::decay_t<T>, const wchar_t*> ||
+                               std::is_same_v<std::decay_t<T>, wchar_t*>)
+            {
+                const wchar_t* str = value != nullptr ? value : L"(null)";
+                written = putBytes(BinLogFormat::ARG_WSTRING, str, wcslen(str) * sizeof(wchar_t), sizeof(wchar_t));
+            }
+            else if constexpr (std::is_pointer_v<T>)
+            {
+                written = putNumber(BinLogFormat::ARG_POINTER, (uint64_t) (uintptr_t) value);
+            }
+            else if constexpr (std::is_floating_point_v<T>)
+            {
+                written = putNumber(BinLogFormat::ARG_DOUBLE, (double) value);
+            }
+            else if constexpr (std::is_signed_v<T> || std::is_enum_v<T>)
+            {
+                written = putNumber(BinLogFormat::ARG_INT, (int64_t) value);
+            }
+            else
+            {
+                static_assert(std::is_integral_v<T>, "unsupported binary log argument");
+                written = putNumber(BinLogFormat::ARG_UINT, (uint64_t) value);
+            }
+            if (written) buf[argCountPos]++;
+        }
+    };
+
+    /**
+     * Logs an event, with the binary log enabled only the format id, a timestamp and the raw arguments are recorded
+     */
+    template<typename... Args>
+    void Record(uint32_t id, LogLevel level, const char* format, Args... args)
+    {
+        if (!Enabled())
+        {
+            Fallback(level, format, args...);
+            return;
+        }
+        Encoder e;
+        e.begin(id, ThreadId(), NowNs());
+        (e.arg(args), ...);
+        e.end();
+        Log::WriteBinary(e.buf, e.len);
+    }
+}
+
+// Logs printf style, the format is registered once per call site and formatted when the binary log is decoded.
+// Arguments can be integers, floating point numbers, pointers and narrow or wide C strings
+#define BINLOG(level, format, ...) \
+    do { \
+        static const uint32_t binlogId = BinLog::Register(level, format, __FILE__, __LINE__); \
+        BinLog::Record(binlogId, level, format, ##__VA_ARGS__); \
+    } while (0)
+
+#endif //OMORI_PATCHER_BINLOG_H
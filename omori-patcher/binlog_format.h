@@ -0,0 +1,39 @@
+#ifndef OMORI_PATCHER_BINLOG_FORMAT_H
+#define OMORI_PATCHER_BINLOG_FORMAT_H
+
+#include <cstdint>
+
+// Layout of omori-patcher.binlog, shared by the patcher and tools/binlog-decode. All integers are little endian.
+//
+// File:   "OMBL" u32 version, then records
+// Format: u8 RECORD_FORMAT, u32 id, u8 level, u32 line, u16 fileLen, file, u16 formatLen, format
+// Event:  u8 RECORD_EVENT, u32 id, u32 threadId, u64 timeNs, u8 argCount, then per argument a u8 ArgType followed
+//         by 8 bytes for numbers and pointers, or a u32 byte length and the bytes for strings (UTF-16 for wide ones).
+//         EVENT_TRUNCATED is set in argCount when strings were clipped or trailing arguments dropped to fit the record
+namespace BinLogFormat
+{
+    const char MAGIC[4] = {'O', 'M', 'B', 'L'};
+    const uint32_t VERSION = 2;
+
+    // Flag in an event's argCount, the low bits hold the count
+    const uint8_t EVENT_TRUNCATED = 0x80;
+    const uint8_t ARG_COUNT_MASK = 0x7F;
+
+    enum RecordType : uint8_t
+    {
+        RECORD_FORMAT = 1,
+        RECORD_EVENT = 2
+    };
+
+    enum ArgType : uint8_t
+    {
+        ARG_INT,
+        ARG_UINT,
+        ARG_DOUBLE,
+        ARG_POINTER,
+        ARG_STRING,
+        ARG_WSTRING
+    };
+}
+
+#endif //OMORI_PATCHER_BINLOG_FORMAT_H
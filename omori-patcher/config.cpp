@@ -0,0 +1,40 @@
+#include "config.h"
+#include "utils.h"
+#include "mappedfile.h"
+
+namespace Config
+{
+    const char* configPath = "omori-patcher.json";
+    Json::Value root;
+
+    /**
+     * Loads the patcher configuration from omori-patcher.json, missing file means defaults everywhere
+     */
+    void Load()
+    {
+        if (!Utils::PathExists(configPath))
+        {
+            Utils::Infof("No %s found, using defaults", configPath);
+            return;
+        }
+        MappedFile file(configPath);
+        std::string error = "failed to read it";
+        if (!file.isOpen() || !Utils::ParseJson(file.data(), file.end(), root, error))
+        {
+            Utils::Errorf("Invalid %s, using defaults: %s", configPath, error.c_str());
+            root = Json::Value();
+        }
+    }
+
+    /**
+     * Gets a section of the configuration
+     * @param name Name of the section
+     * @return The section, or a null value if it's not set
+     */
+    const Json::Value& Section(const char* name)
+    {
+        static const Json::Value empty;
+        if (!root.isObject() || !root.isMember(name)) return empty;
+        return root[name];
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef OMORI_PATCHER_CONFIG_H
+#define OMORI_PATCHER_CONFIG_H
+
+#include <json/json.h>
+
+namespace Config
+{
+    extern Json::Value root;
+
+    void Load();
+    const Json::Value& Section(const char* name);
+}
+
+#endif //OMORI_PATCHER_CONFIG_H
@@ -0,0 +1,321 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <json/json.h>
+#include "consts.h"
+#include "config.h"
+#include "decode.h"
+#include "report.h"
+#include "sigscan.h"
+#include "trace.h"
+#include "utils.h"
+#include "mappedfile.h"
+
+namespace Consts
+{
+    const char* signaturesPath = "omori-patcher-signatures.json";
+    const char* cachePath = "omori-patcher-consts.json";
+
+    // Signatures longer than this are rejected, a function that isn't unique after this many bytes won't be
+    const size_t MAX_SIGNATURE_LEN = 64;
+
+    struct Entry
+    {
+        const char* name;
+        DWORD_PTR* value;
+        // Data addresses are found through an instruction referencing them with a rip relative operand
+        bool data;
+    };
+
+    Entry entries[] = {
+            {"JSContextPtr", &JSContextPtr, true},
+            {"JSRuntimePtr", &JSRuntimePtr, true},
+            {"JSInit_PostEvalBin", &JSInit_PostEvalBin, false},
+            {"JSImpl_print_i", &JSImpl_print_i, false},
+            {"JS_Eval", &JS_Eval, false},
+            {"JS_EvalBin", &JS_EvalBin, false},
+            {"JS_NewCFunction2", &JS_NewCFunction2, false},
+            {"JS_NewCFunction3", &JS_NewCFunction3, false},
+            {"JS_NewAtom", &JS_NewAtom, false},
+            {"JS_GetGlobalVar", &JS_GetGlobalVar, false},
+    };
+
+    struct Image
+    {
+        DWORD_PTR base;
+        DWORD timestamp;
+        DWORD checksum;
+        const uint8_t* text;
+        size_t textLen;
+    };
+
+    bool readImage(Image& image)
+    {
+        image.base = (DWORD_PTR) GetModuleHandleW(nullptr);
+        auto dos = (IMAGE_DOS_HEADER*) image.base;
+        auto nt = (IMAGE_NT_HEADERS64*) (image.base + dos->e_lfanew);
+        image.timestamp = nt->FileHeader.TimeDateStamp;
+        image.checksum = nt->OptionalHeader.CheckSum;
+
+        IMAGE_SECTION_HEADER* section = IMAGE_FIRST_SECTION(nt);
+        for (WORD i = 0; i < nt->FileHeader.NumberOfSections; i++, section++)
+        {
+            if (strncmp((const char*) section->Name, ".text", sizeof(section->Name)) != 0) continue;
+            image.text = (const uint8_t*) (image.base + section->VirtualAddress);
+            image.textLen = section->Misc.VirtualSize;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * Resolves a signature entry: {"pattern": "...", "offset": n} for code, data entries also have the offset of
+     * the rip relative displacement and the length of the referencing instruction
+     */
+    bool scanSignature(const Image& image, const Entry& entry, const Json::Value& signature)
+    {
+        Pattern pattern;
+        if (!SigScan::Parse(signature["pattern"].asString(), pattern))
+        {
+            Utils::Errorf("[sigscan] Invalid pattern for %s", entry.name);
+            return false;
+        }
+        const uint8_t* found = SigScan::Find(image.text, image.textLen, pattern);
+        if (found == nullptr)
+        {
+            Utils::Errorf("[sigscan] %s: no match", entry.name);
+            return false;
+        }
+        size_t rest = image.textLen - (found + 1 - image.text);
+        if (SigScan::Count(found + 1, rest, pattern, 1) != 0)
+        {
+            Utils::Errorf("[sigscan] %s: more than one match", entry.name);
+            return false;
+        }
+        auto match = (DWORD_PTR) found + signature["offset"].asInt();
+        if (entry.data)
+        {
+            int32_t disp;
+            memcpy(&disp, (void*) (match + signature["dispOffset"].asUInt()), sizeof(disp));
+            match += signature["insnLength"].asUInt() + disp;
+        }
+        *entry.value = match;
+        return true;
+    }
+
+    /**
+     * Finds the first mov/lea in .text that addresses target through rip
+     * @return Address of the instruction, 0 if there's none
+     */
+    DWORD_PTR findReference(const Image& image, DWORD_PTR target)
+    {
+        // REX.W 8B/89/8D modrm(00 reg 101) disp32
+        for (size_t i = 0; i + 7 <= image.textLen; i++)
+        {
+            const uint8_t* insn = image.text + i;
+            if ((insn[0] & 0xFB) != 0x48) continue;
+            if (insn[1] != 0x8B && insn[1] != 0x89 && insn[1] != 0x8D) continue;
+            if ((insn[2] & 0xC7) != 0x05) continue;
+            int32_t disp;
+            memcpy(&disp, insn + 3, sizeof(disp));
+            if ((DWORD_PTR) insn + 7 + disp == target) return (DWORD_PTR) insn;
+        }
+        return 0;
+    }
+
+    /**
+     * Builds the shortest unique signature starting at an address, operands that change between builds
+     * (rip relative displacements and branch targets) are wildcarded
+     * @return false if the code isn't unique within MAX_SIGNATURE_LEN bytes
+     */
+    bool deriveSignature(const Image& image, DWORD_PTR addr, Json::Value& signature)
+    {
+        auto code = (const uint8_t*) addr;
+        size_t available = (DWORD_PTR) image.text + image.textLen - addr;
+        std::vector<InsnInfo> insns;
+        if (!Decode::Window(code, addr, available, std::min(MAX_SIGNATURE_LEN, available), insns)) return false;
+
+        Pattern pattern;
+        for (const InsnInfo& insn : insns)
+        {
+            size_t start = pattern.bytes.size();
+            pattern.bytes.insert(pattern.bytes.end(), code + start, code + start + insn.length);
+            pattern.mask.insert(pattern.mask.end(), insn.length, 0xFF);
+            if (insn.relative)
+            {
+                std::fill_n(pattern.mask.begin() + start + insn.immOffset, insn.immSize / 8, 0x00);
+            }
+            if (insn.ripRelative)
+            {
+                std::fill_n(pattern.mask.begin() + start + insn.dispOffset, insn.dispSize / 8, 0x00);
+            }
+            for (size_t i = start; i < pattern.bytes.size(); i++) pattern.bytes[i] &= pattern.mask[i];
+
+            if (pattern.bytes.size() >= 8 && SigScan::Count(image.text, image.textLen, pattern, 2) == 1)
+            {
+                signature["pattern"] = SigScan::Format(pattern);
+                signature["offset"] = 0;
+                return true;
+            }
+            if (pattern.bytes.size() >= MAX_SIGNATURE_LEN) break;
+        }
+        return false;
+    }
+
+    /**
+     * Writes signatures for every entry using the built-in addresses, run on the build those addresses are for
+     */
+    void generateSignatures(const Image& image)
+    {
+        Json::Value signatures;
+        for (const Entry& entry : entries)
+        {
+            DWORD_PTR addr = *entry.value;
+            DWORD_PTR reference = entry.data ? findReference(image, addr) : addr;
+            Json::Value signature;
+            if (reference == 0 || !deriveSignature(image, reference, signature))
+            {
+                Utils::Warnf("[sigscan] Couldn't build a unique signature for %s", entry.name);
+                continue;
+            }
+            if (entry.data)
+            {
+                signature["dispOffset"] = 3;
+                signature["insnLength"] = 7;
+            }
+            signatures[entry.name] = signature;
+        }
+
+        std::ofstream file(signaturesPath);
+        if (!file)
+        {
+            Utils::Errorf("[sigscan] Failed to open %s for writing", signaturesPath);
+            return;
+        }
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "  ";
+        file << Json::writeString(builder, signatures) << std::endl;
+        Utils::Successf("[sigscan] Wrote %u signatures to %s", signatures.size(), signaturesPath);
+    }
+
+    bool loadCache(const Image& image)
+    {
+        if (!Utils::PathExists(cachePath)) return false;
+        MappedFile file(cachePath);
+        Json::Value cache;
+        std::string error;
+        // A broken cache is rebuilt by scanning
+        if (!file.isOpen() || !Utils::ParseJson(file.data(), file.end(), cache, error)) return false;
+        if (!cache.isObject() || cache["timestamp"].asUInt() != image.timestamp ||
+            cache["checksum"].asUInt() != image.checksum)
+        {
+            return false;
+        }
+
+        const Json::Value& rvas = cache["rva"];
+        for (const Entry& entry : entries)
+        {
+            if (!rvas.isMember(entry.name)) return false;
+        }
+        for (const Entry& entry : entries)
+        {
+            *entry.value = image.base + rvas[entry.name].asUInt64();
+        }
+        return true;
+    }
+
+    void saveCache(const Image& image)
+    {
+        Json::Value cache;
+        cache["timestamp"] = (Json::UInt) image.timestamp;
+        cache["checksum"] = (Json::UInt) image.checksum;
+        for (const Entry& entry : entries)
+        {
+            cache["rva"][entry.name] = (Json::UInt64) (*entry.value - image.base);
+        }
+
+        std::ofstream file(cachePath);
+        if (!file)
+        {
+            Utils::Errorf("[sigscan] Failed to open %s for writing", cachePath);
+            return;
+        }
+        Json::StreamWriterBuilder builder;
+        builder["indentation"] = "  ";
+        file << Json::writeString(builder, cache) << std::endl;
+    }
+
+    /**
+     * Locates every game address for the running build. Addresses are loaded from omori-patcher-consts.json when
+     * it was written for this exact executable, otherwise every signature in omori-patcher-signatures.json is
+     * scanned for in .text and the results are cached. Without signatures the built-in addresses are used.
+     * @return false if a signature couldn't be resolved
+     */
+    bool Resolve()
+    {
+        TRACE_SCOPE("Consts::Resolve");
+        Image image{};
+        if (!readImage(image))
+        {
+            Utils::Error("[sigscan] Game executable has no .text section");
+            return false;
+        }
+
+        // Built-in addresses are relative to the preferred image base
+        for (const Entry& entry : entries)
+        {
+            *entry.value = *entry.value - OMORI_BASE + image.base;
+        }
+        OMORI_BASE = image.base;
+
+        if (Config::Section("sigscan")["generate"].asBool())
+        {
+            generateSignatures(image);
+        }
+
+        if (loadCache(image))
+        {
+            Utils::Infof("[sigscan] Loaded addresses from %s", cachePath);
+            return true;
+        }
+
+        if (!Utils::PathExists(signaturesPath))
+        {
+            Utils::Infof("[sigscan] No %s found, using built-in addresses", signaturesPath);
+            return true;
+        }
+
+        MappedFile file(signaturesPath);
+        Json::Value signatures;
+        std::string error = "failed to read it";
+        if (!file.isOpen() || !Utils::ParseJson(file.data(), file.end(), signatures, error))
+        {
+            Utils::Errorf("[sigscan] Invalid %s: %s", signaturesPath, error.c_str());
+            return false;
+        }
+        if (!signatures.isObject())
+        {
+            Utils::Errorf("[sigscan] Invalid %s: expected an object of signatures", signaturesPath);
+            return false;
+        }
+
+        double start = Report::NowMs();
+        bool ok = true;
+        for (const Entry& entry : entries)
+        {
+            if (!signatures.isMember(entry.name))
+            {
+                Utils::Errorf("[sigscan] No signature for %s", entry.name);
+                ok = false;
+                continue;
+            }
+            ok &= scanSignature(image, entry, signatures[entry.name]);
+        }
+        if (!ok) return false;
+
+        Utils::Infof("[sigscan] Scanned %zu KB of code with %s in %.1f ms", image.textLen / 1024, SigScan::Backend(),
+                     Report::NowMs() - start);
+        saveCache(image);
+        return true;
+    }
+}
@@ -0,0 +1,133 @@
+#include <algorithm>
+#include "contentcache.h"
+
+/**
+ * @param budget Bytes the cached contents may take, 0 disables the cache
+ * @param maxFileBytes Largest file that's cached, 0 for an eighth of the budget so one large file can't flush
+ * everything else
+ */
+ContentCache::ContentCache(size_t budget, size_t maxFileBytes)
+{
+    configure(budget, maxFileBytes);
+}
+
+void ContentCache::configure(size_t newBudget, size_t newMaxFileBytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    budget = newBudget;
+    maxFileBytes = std::min(newMaxFileBytes != 0 ? newMaxFileBytes : newBudget / 8, newBudget);
+    evict();
+}
+
+/**
+ * Checks whether a file is small enough to be cached, before its contents are read. Files that aren't are counted
+ * @param size Size of the file
+ */
+bool ContentCache::admits(uint64_t size)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (size <= maxFileBytes) return true;
+    skipped++;
+    return false;
+}
+
+/**
+ * Looks up a file and pins it, every entry returned has to be released
+ * @param path Absolute path of the file
+ * @return The cached file, nullptr if it isn't resident
+ */
+const ContentCache::Entry* ContentCache::acquire(std::wstring_view path)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(path);
+    if (it == index.end())
+    {
+        misses++;
+        return nullptr;
+    }
+    hits++;
+    Entry& entry = *it->second;
+    if (entry.prefetched) prefetchHits++;
+    entry.prefetched = false;
+    entry.pins++;
+    lru.splice(lru.begin(), lru, it->second);
+    return &entry;
+}
+
+/**
+ * Pins a file like acquire() without counting a hit or a miss, for lookups the game didn't make
+ * @param path Absolute path of the file
+ * @return The cached file, nullptr if it isn't resident
+ */
+const ContentCache::Entry* ContentCache::peek(std::wstring_view path)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(path);
+    if (it == index.end()) return nullptr;
+    Entry& entry = *it->second;
+    entry.pins++;
+    lru.splice(lru.begin(), lru, it->second);
+    return &entry;
+}
+
+/**
+ * Adds a file after a miss and pins it, if another thread added it first that copy is returned instead
+ * @param path Absolute path of the file
+ * @param data Contents of the file
+ * @param prefetched Whether the file is read ahead of the game opening it
+ * @return The cached file, nullptr if it's too large to cache
+ */
+const ContentCache::Entry* ContentCache::insert(std::wstring_view path, std::vector<uint8_t>&& data, bool prefetched)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(path);
+    if (it != index.end())
+    {
+        it->second->pins++;
+        return &*it->second;
+    }
+    if (data.size() > maxFileBytes) return nullptr;
+
+    lru.push_front({std::wstring(path), std::move(data), 1, prefetched});
+    Entry& entry = lru.front();
+    index.emplace(entry.path, lru.begin());
+    bytes += entry.data.size();
+    peakBytes = std::max(peakBytes, bytes);
+    evict();
+    return &entry;
+}
+
+/**
+ * Unpins a file once the handle reading it is closed
+ */
+void ContentCache::release(const Entry* entry)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    const_cast<Entry*>(entry)->pins--;
+    evict();
+}
+
+ContentCache::Stats ContentCache::stats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return {hits, misses, skipped, evictions, evictedBytes, prefetchHits, prefetchEvictions, lru.size(), bytes, peakBytes,
+            budget};
+}
+
+/**
+ * Drops unpinned files from the least recently used end until the contents fit the budget
+ */
+void ContentCache::evict()
+{
+    for (auto it = lru.end(); bytes > budget && it != lru.begin();)
+    {
+        --it;
+        if (it->pins != 0) continue;
+        bytes -= it->data.size();
+        evictions++;
+        evictedBytes += it->data.size();
+        if (it->prefetched) prefetchEvictions++;
+        index.erase(it->path);
+        it = lru.erase(it);
+    }
+}
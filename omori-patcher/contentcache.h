@@ -0,0 +1,85 @@
+#ifndef OMORI_PATCHER_CONTENTCACHE_H
+#define OMORI_PATCHER_CONTENTCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Keeps the contents of overlaid files in memory within a byte budget, the least recently used files are evicted
+ * first. Files with an open handle are pinned and never evicted, so the cache can go over budget while every
+ * resident file is open, it shrinks back as they're closed
+ */
+class ContentCache
+{
+public:
+    struct Entry
+    {
+        std::wstring path;
+        std::vector<uint8_t> data;
+        uint32_t pins;
+        // Read ahead by the prefetcher and not opened by the game yet
+        bool prefetched;
+    };
+
+    struct Stats
+    {
+        uint64_t hits;
+        uint64_t misses;
+        // Files too large to cache under the current limits
+        uint64_t skipped;
+        uint64_t evictions;
+        uint64_t evictedBytes;
+        // Opens served from a prefetched file, and prefetched files evicted before the game opened them
+        uint64_t prefetchHits;
+        uint64_t prefetchEvictions;
+        size_t entries;
+        size_t bytes;
+        size_t peakBytes;
+        size_t budget;
+    };
+
+    explicit ContentCache(size_t budget = 0, size_t maxFileBytes = 0);
+
+    ContentCache(const ContentCache&) = delete;
+    ContentCache& operator=(const ContentCache&) = delete;
+
+    void configure(size_t budget, size_t maxFileBytes);
+    bool enabled() const
+    {
+        return budget != 0;
+    }
+    bool admits(uint64_t size);
+    const Entry* acquire(std::wstring_view path);
+    const Entry* peek(std::wstring_view path);
+    const Entry* insert(std::wstring_view path, std::vector<uint8_t>&& data, bool prefetched = false);
+    void release(const Entry* entry);
+    Stats stats();
+
+private:
+    std::mutex mutex;
+    size_t budget;
+    size_t maxFileBytes;
+    // Most recently used first
+    std::list<Entry> lru;
+    // Keys point into the entries' paths, list nodes never move
+    std::unordered_map<std::wstring_view, std::list<Entry>::iterator> index;
+    size_t bytes = 0;
+    size_t peakBytes = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t skipped = 0;
+    uint64_t evictions = 0;
+    uint64_t evictedBytes = 0;
+    uint64_t prefetchHits = 0;
+    uint64_t prefetchEvictions = 0;
+
+    void evict();
+};
+
+#endif //OMORI_PATCHER_CONTENTCACHE_H
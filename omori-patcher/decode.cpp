@@ -0,0 +1,132 @@
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include "decode.h"
+
+namespace Decode
+{
+    // Bounds the cache, hooks only ever look at a few instructions per function
+    const size_t MAX_CACHED = 4096;
+
+    struct CachedInsn
+    {
+        InsnInfo info;
+        // Bytes the instruction was decoded from, a hit needs them to still match
+        uint8_t bytes[ZYDIS_MAX_INSTRUCTION_LENGTH];
+    };
+
+    std::mutex cacheMutex;
+    std::unordered_map<uint64_t, CachedInsn> cache;
+
+    bool decode(const uint8_t* code, uint64_t addr, size_t available, InsnInfo& info)
+    {
+        static const ZydisDecoder decoder = []
+        {
+            ZydisDecoder d;
+            ZydisDecoderInit(&d, ZYDIS_MACHINE_MODE_LONG_64, ZYDIS_STACK_WIDTH_64);
+            return d;
+        }();
+
+        ZydisDecodedInstruction insn;
+        ZydisDecodedOperand operands[ZYDIS_MAX_OPERAND_COUNT];
+        if (!ZYAN_SUCCESS(ZydisDecoderDecodeFull(&decoder, code, available, &insn, operands))) return false;
+
+        info = {};
+        info.address = addr;
+        info.length = insn.length;
+        info.mnemonic = insn.mnemonic;
+        info.category = insn.meta.category;
+        info.opcode = insn.opcode;
+        info.terminator = insn.meta.category == ZYDIS_CATEGORY_RET || insn.mnemonic == ZYDIS_MNEMONIC_INT3 ||
+                          insn.mnemonic == ZYDIS_MNEMONIC_JMP;
+        if ((insn.attributes & ZYDIS_ATTRIB_IS_RELATIVE) && insn.raw.imm[0].is_relative)
+        {
+            info.relative = true;
+            info.target = addr + insn.length + insn.raw.imm[0].value.s;
+            info.immOffset = insn.raw.imm[0].offset;
+            info.immSize = insn.raw.imm[0].size;
+        }
+        for (int i = 0; i < insn.operand_count; i++)
+        {
+            const ZydisDecodedOperand& op = operands[i];
+            if (op.type != ZYDIS_OPERAND_TYPE_MEMORY || op.mem.base != ZYDIS_REGISTER_RIP) continue;
+            info.ripRelative = true;
+            info.dispOffset = insn.raw.disp.offset;
+            info.dispSize = insn.raw.disp.size;
+            info.ripTarget = addr + insn.length + insn.raw.disp.value;
+        }
+        return true;
+    }
+
+    /**
+     * Decodes a single instruction, results are cached per address and only reused while the bytes at code are
+     * the ones they were decoded from, so copies of the code (or code patched without Invalidate) never hit stale
+     * entries
+     * @param code Instruction bytes
+     * @param addr Runtime address of the instruction
+     * @param available Bytes readable at code
+     * @param out Decoded instruction
+     * @return false if the instruction isn't valid or doesn't fit in available
+     */
+    bool At(const uint8_t* code, uint64_t addr, size_t available, InsnInfo& out)
+    {
+        std::lock_guard lock(cacheMutex);
+        auto it = cache.find(addr);
+        if (it != cache.end())
+        {
+            const CachedInsn& cached = it->second;
+            if (cached.info.length <= available && memcmp(cached.bytes, code, cached.info.length) == 0)
+            {
+                out = cached.info;
+                return true;
+            }
+        }
+
+        if (!decode(code, addr, available, out)) return false;
+        if (cache.size() >= MAX_CACHED) cache.clear();
+        CachedInsn& entry = cache[addr];
+        entry.info = out;
+        memcpy(entry.bytes, code, out.length);
+        return true;
+    }
+
+    /**
+     * Decodes consecutive instructions until at least minLen bytes are covered
+     * @param code Start of the code
+     * @param addr Runtime address of code
+     * @param available Bytes readable at code, decoding never reads past this
+     * @param minLen Minimum amount of bytes to decode
+     * @param out Decoded instructions
+     * @return false if an instruction couldn't be decoded within available
+     */
+    bool Window(const uint8_t* code, uint64_t addr, size_t available, size_t minLen, std::vector<InsnInfo>& out)
+    {
+        out.clear();
+        size_t offset = 0;
+        while (offset < minLen)
+        {
+            if (offset >= available) return false;
+            InsnInfo info;
+            if (!At(code + offset, addr + offset, available - offset, info)) return false;
+            out.push_back(info);
+            offset += info.length;
+        }
+        return true;
+    }
+
+    /**
+     * Forgets cached instructions overlapping a range, has to be called whenever code is patched
+     * @param addr Start of the patched range
+     * @param len Length of the patched range
+     */
+    void Invalidate(uint64_t addr, size_t len)
+    {
+        std::lock_guard lock(cacheMutex);
+        for (auto it = cache.begin(); it != cache.end();)
+        {
+            const InsnInfo& info = it->second.info;
+            if (info.address < addr + len && info.address + info.length > addr) it = cache.erase(it);
+            else ++it;
+        }
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef OMORI_PATCHER_DECODE_H
+#define OMORI_PATCHER_DECODE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <Zydis/Zydis.h>
+
+struct InsnInfo
+{
+    uint64_t address;
+    uint8_t length;
+    ZydisMnemonic mnemonic;
+    ZydisInstructionCategory category;
+    uint8_t opcode;
+    // Relative branch with an immediate target
+    bool relative;
+    uint64_t target;
+    uint8_t immOffset;
+    uint8_t immSize;
+    // Memory operand addressed through rip
+    bool ripRelative;
+    uint8_t dispOffset;
+    uint8_t dispSize;
+    uint64_t ripTarget;
+    // ret, int3 or an unconditional jmp, execution doesn't fall through into the next instruction
+    bool terminator;
+};
+
+namespace Decode
+{
+    bool At(const uint8_t* code, uint64_t addr, size_t available, InsnInfo& out);
+    bool Window(const uint8_t* code, uint64_t addr, size_t available, size_t minLen, std::vector<InsnInfo>& out);
+    void Invalidate(uint64_t addr, size_t len);
+}
+
+#endif //OMORI_PATCHER_DECODE_H
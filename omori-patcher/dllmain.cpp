@@ -10,6 +10,20 @@
 #include "rpc.h"
 #include "detours.h"
 #include "fs_overlay.h"
+#include "config.h"
+#include "heap.h"
+#include "hookstats.h"
+#include "startup.h"
+#include "trace.h"
+#include "log.h"
+#include "filter.h"
+#include "mappedfile.h"
+
+// Signatures of the hooked functions, the stubs preserve every argument register of these rather than only the ones
+// the hooks take. QuickJS's JS_NewCFunction3, the parameters past the fourth are passed on the stack
+using JS_NewCFunction3Fn = void* (*)(JSContext*, void*, char*, int, int, int, void*);
+// Only the first two parameters are known, r8 and r9 are preserved in case there are more
+using JS_EvalBinFn = void (*)(JSContext*, char*, void*, void*);
 
 void JS_NewCFunctionHook(JSContext* ctx, void* function, char* name, int length)
 {
@@ -33,37 +47,36 @@ void JS_EvalBinHook(JSContext* ctx, char* filename)
 
 void PrintHook(char* msg)
 {
-    if (strncmp("console.log: getImage", msg, strlen("console.log: getImage")) == 0) return;
-    const char* log = "console.log: ";
-    const char* warn = "console.warn: ";
-    const char* err = "console.error: ";
+    Heap::Poll();
+    Filter::Match match = Filter::Classify(msg);
+    const char* text = msg + Filter::PrefixLength(match.kind);
     // TODO(nemtudom345): This is really hacky, but I can not for the life of me get a native c function to register
-    if (strncmp("<omori-patcher>: ", msg, strlen("<omori-patcher>: ")) == 0)
+    if (match.kind == Filter::KIND_RPC)
     {
-        rpc::ParseMessage(msg + strlen("<omori-patcher>: "));
+        rpc::ParseMessage(text);
         return;
     }
-    if (strncmp(log, msg, strlen(log)) == 0)
+    if (!Filter::Allow(match, msg)) return;
+    switch (match.kind)
     {
-        Utils::Infof("[console.log] %s", msg+strlen(log));
-        return;
-    }
-    if (strncmp(warn, msg, strlen(warn)) == 0)
-    {
-        Utils::Warnf("[console.warn] %s", msg+strlen(warn));
-        return;
-    }
-    if (strncmp(err, msg, strlen(err)) == 0)
-    {
-        Utils::Errorf("[console.error] %s", msg+strlen(err));
-        return;
+        case Filter::KIND_LOG:
+            Utils::Infof("[console.log] %s", text);
+            break;
+        case Filter::KIND_WARN:
+            Utils::Warnf("[console.warn] %s", text);
+            break;
+        case Filter::KIND_ERROR:
+            Utils::Errorf("[console.error] %s", text);
+            break;
+        default:
+            Log::Write(LOG_PLAIN, msg, match.length);
+            break;
     }
-
-    printf("%s\n", msg);
 }
 
 void PostEvalBinHook()
 {
+    TRACE_SCOPE("PostEvalBinHook");
     js::JSRuntimeInst = (JSRuntime*) (*((JSRuntime**)Consts::JSContextPtr));
     js::JSContextInst = (JSContext*) (*((JSContext**)Consts::JSRuntimePtr));
 
@@ -71,10 +84,23 @@ void PostEvalBinHook()
     Utils::Infof("JSContext* ctx = %p", js::JSContextInst);
 
     Utils::Info("Initializing omori-patcher stdlib");
-    js::JS_Eval(Utils::ReadFileStr("stdlib.js"), "stdlib.js");
+    {
+        TRACE_SCOPE("stdlib.js");
+        MappedFile stdlib("stdlib.js");
+        if (stdlib.isOpen()) js::JS_Eval(stdlib.data(), "stdlib.js");
+        else Utils::Error("Failed to open stdlib.js");
+    }
+
+    Heap::StartSampler();
 
+    if (!Startup::WaitReady("JSInit_PostEvalBin"))
+    {
+        Utils::Error("Mods aren't loaded yet, not running them");
+        return;
+    }
     Utils::Info("Running mods...");
     ModLoader::RunMods();
+    Trace::Dump();
 }
 
 void PatcherMain()
@@ -86,15 +112,42 @@ void PatcherMain()
     Utils::BindCrtHandlesToStdHandles(true, true, true);
 
     Utils::Success("DLL Successfully loaded!");
+    Config::Load();
+    Log::Start();
+    Trace::Init();
+    TRACE_SCOPE("PatcherMain");
+    Filter::Load();
+    if (!Consts::Resolve())
+    {
+        Utils::Error("Failed to locate game functions, this version of the game isn't supported");
+        return;
+    }
+
+    Mem::TransactionBegin();
+    Mem::Hook<JS_NewCFunction3Fn>(Consts::JS_NewCFunction3, &JS_NewCFunctionHook);
+    Mem::Hook<JS_EvalBinFn>(Consts::JS_EvalBin, &JS_EvalBinHook);
+    // Placed inside the function, not at its entry, so every volatile register has to be preserved
+    Mem::Hook(Consts::JSImpl_print_i, (DWORD_PTR) &PrintHook);
+    Mem::Hook(Consts::JSInit_PostEvalBin, (DWORD_PTR) &PostEvalBinHook);
+    if (!Mem::TransactionCommit())
+    {
+        Utils::Error("Failed to hook game functions");
+        return;
+    }
+    HookStats::Name(Consts::JS_NewCFunction3, "JS_NewCFunctionHook");
+    HookStats::Name(Consts::JS_EvalBin, "JS_EvalBinHook");
+    HookStats::Name(Consts::JSImpl_print_i, "PrintHook");
+    HookStats::Name(Consts::JSInit_PostEvalBin, "PostEvalBinHook");
+    HookStats::StartDumper();
 
-    Mem::Hook(Consts::JS_NewCFunction3, (DWORD_PTR) &JS_NewCFunctionHook, true);
-    Mem::Hook(Consts::JS_EvalBin, (DWORD_PTR) &JS_EvalBinHook, true);
-    Mem::Hook(Consts::JSImpl_print_i, (DWORD_PTR) &PrintHook, true);
-    Mem::Hook(Consts::JSInit_PostEvalBin, (DWORD_PTR) &PostEvalBinHook, false);
+    // The exe loads us from its own entry point, byte patches have to be written before DllMain returns to it
+    Utils::Info("Applying byte patches");
+    ModLoader::ApplyPatches();
 
     Utils::Info("Patching win32 functions...");
     DetourRestoreAfterWith();
 
+    TRACE_SCOPE("Detours");
     DetourTransactionBegin();
     DetourUpdateThread(GetCurrentThread());
     FS_RegisterDetours();
@@ -105,14 +158,20 @@ void PatcherMain()
     }
     Utils::Success("Patching complete");
 
-    Utils::Info("Parsing mods...");
-    ModLoader::mods = ModLoader::ParseMods();
-    Utils::Successf("Parsed %d %s", ModLoader::mods.size(), ModLoader::mods.size() == 1 ? "mod" : "mods");
-    Utils::Info("Registering files for fs overlay");
-    for (const Mod& mod : ModLoader::mods)
-    {
-        FS_RegisterOverlay(mod);
-    }
+    // Everything below runs once the loader lock is released, files in the game directory and JSInit_PostEvalBin
+    // wait for it
+    Startup::Begin([]() {
+        Utils::Info("Parsing mods...");
+        ModLoader::mods = ModLoader::ParseMods();
+        Utils::Successf("Parsed %d %s", ModLoader::mods.size(), ModLoader::mods.size() == 1 ? "mod" : "mods");
+        Utils::Info("Registering files for fs overlay");
+        TRACE_SCOPE("Overlay");
+        for (const Mod& mod : ModLoader::mods)
+        {
+            FS_RegisterOverlay(mod);
+        }
+        FS_FreezeOverlay();
+    });
 }
 
 BOOL APIENTRY DllMain(HMODULE hModule, DWORD ul_reason_for_call, LPVOID lpReserved)
@@ -121,6 +180,14 @@ BOOL APIENTRY DllMain(HMODULE hModule, DWORD ul_reason_for_call, LPVOID lpReserv
     {
         PatcherMain();
     }
+    else if (ul_reason_for_call == DLL_PROCESS_DETACH)
+    {
+        Filter::Dump();
+        Filter::Flush();
+        FS_DumpStats();
+        FS_SaveProfile();
+        Log::Flush();
+    }
     return TRUE;
 }
 
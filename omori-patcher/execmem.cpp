@@ -0,0 +1,301 @@
+#include <algorithm>
+#include <cassert>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+#include "execmem.h"
+
+#ifdef _WIN32
+#include "pch.h"
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace ExecMem
+{
+    // Everything handed out has to stay in rel32 reach of the module, keep some room for the module itself
+    const int64_t maxDistance = 0x7FFFFFFFLL - 0x10000000LL;
+    const size_t sizeClasses[] = {16, 32, 64, 128, 256, 512, 1024, 2048};
+    const size_t sizeClassCount = sizeof(sizeClasses) / sizeof(sizeClasses[0]);
+
+    struct Region
+    {
+        uintptr_t base;
+        size_t size;
+        uintptr_t cursor;
+    };
+
+    std::recursive_mutex poolMutex;
+    uintptr_t nearAddress = 0;
+    size_t defaultRegionSize = 0;
+    size_t pageSize = 0;
+    std::vector<Region> regions;
+    std::vector<void*> freeLists[sizeClassCount];
+    std::multimap<size_t, void*> largeFree;
+    // Pages written to since BeginWrite, flipped back to executable in EndWrite
+    std::set<uintptr_t> dirtyPages;
+    int writeDepth = 0;
+
+#ifdef _WIN32
+    size_t systemPageSize()
+    {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return info.dwPageSize;
+    }
+
+    size_t allocationGranularity()
+    {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return info.dwAllocationGranularity;
+    }
+
+    void* reserveAt(uintptr_t addr, size_t size)
+    {
+        return VirtualAlloc((LPVOID) addr, size, MEM_RESERVE | MEM_COMMIT, PAGE_EXECUTE_READ);
+    }
+
+    bool isFree(uintptr_t addr, size_t size)
+    {
+        MEMORY_BASIC_INFORMATION info;
+        if (VirtualQuery((LPCVOID) addr, &info, sizeof(info)) == 0) return false;
+        return info.State == MEM_FREE && (uintptr_t) info.BaseAddress + info.RegionSize >= addr + size;
+    }
+
+    bool protect(uintptr_t addr, size_t size, bool writable)
+    {
+        DWORD oldProtect;
+        return VirtualProtect((LPVOID) addr, size, writable ? PAGE_EXECUTE_READWRITE : PAGE_EXECUTE_READ, &oldProtect);
+    }
+
+    void flush(uintptr_t addr, size_t size)
+    {
+        FlushInstructionCache(GetCurrentProcess(), (LPCVOID) addr, size);
+    }
+#else
+    size_t systemPageSize()
+    {
+        return (size_t) sysconf(_SC_PAGESIZE);
+    }
+
+    size_t allocationGranularity()
+    {
+        return systemPageSize();
+    }
+
+    void* reserveAt(uintptr_t addr, size_t size)
+    {
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_FIXED_NOREPLACE
+        flags |= MAP_FIXED_NOREPLACE;
+#endif
+        void* res = mmap((void*) addr, size, PROT_READ | PROT_EXEC, flags, -1, 0);
+        if (res == MAP_FAILED) return nullptr;
+        if ((uintptr_t) res != addr)
+        {
+            // Kernel without MAP_FIXED_NOREPLACE placed it elsewhere
+            munmap(res, size);
+            return nullptr;
+        }
+        return res;
+    }
+
+    bool isFree(uintptr_t, size_t)
+    {
+        return true;
+    }
+
+    bool protect(uintptr_t addr, size_t size, bool writable)
+    {
+        return mprotect((void*) addr, size, PROT_READ | PROT_EXEC | (writable ? PROT_WRITE : 0)) == 0;
+    }
+
+    void flush(uintptr_t addr, size_t size)
+    {
+        __builtin___clear_cache((char*) addr, (char*) (addr + size));
+    }
+#endif
+
+    /**
+     * Reserves a new region within rel32 reach of nearAddress, searching outwards from it
+     * @param size Minimum size of the region
+     * @return false if no free space was found in reach
+     */
+    bool addRegion(size_t size)
+    {
+        size_t granularity = allocationGranularity();
+        size = (size + granularity - 1) / granularity * granularity;
+        uintptr_t start = nearAddress / granularity * granularity;
+
+        for (int64_t distance = (int64_t) granularity; distance < maxDistance; distance += (int64_t) granularity)
+        {
+            for (int direction : {1, -1})
+            {
+                int64_t candidate = (int64_t) start + direction * distance;
+                if (candidate <= 0) continue;
+                auto addr = (uintptr_t) candidate;
+                if (!InReach(addr, nearAddress) || !InReach(addr + size, nearAddress) || !isFree(addr, size)) continue;
+                void* res = reserveAt(addr, size);
+                if (res == nullptr) continue;
+                regions.push_back({(uintptr_t) res, size, (uintptr_t) res});
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Reserves executable memory near an address, hooks placed in it can reach anything within 2GB of that address
+     * with a rel32 jump
+     * @param nearAddr Address the memory has to be in reach of, usually the base of the hooked module
+     * @param regionSize Size of each reserved region
+     * @return false if no memory could be reserved
+     */
+    bool Init(uintptr_t nearAddr, size_t regionSize)
+    {
+        std::lock_guard<std::recursive_mutex> lock(poolMutex);
+        if (!regions.empty()) return true;
+        nearAddress = nearAddr;
+        defaultRegionSize = regionSize;
+        pageSize = systemPageSize();
+        return addRegion(regionSize);
+    }
+
+    size_t sizeClassOf(size_t size)
+    {
+        for (size_t i = 0; i < sizeClassCount; i++)
+        {
+            if (size <= sizeClasses[i]) return i;
+        }
+        return sizeClassCount;
+    }
+
+    void markDirty(uintptr_t addr, size_t size)
+    {
+        for (uintptr_t page = addr / pageSize * pageSize; page < addr + size; page += pageSize)
+        {
+            if (dirtyPages.insert(page).second) protect(page, pageSize, true);
+        }
+    }
+
+    void* carve(size_t size)
+    {
+        for (auto& region : regions)
+        {
+            if (region.cursor + size <= region.base + region.size)
+            {
+                auto res = (void*) region.cursor;
+                region.cursor += size;
+                return res;
+            }
+        }
+        if (!addRegion(std::max(size, defaultRegionSize))) return nullptr;
+        Region& region = regions.back();
+        auto res = (void*) region.cursor;
+        region.cursor += size;
+        return res;
+    }
+
+    /**
+     * Allocates executable memory, must be called between BeginWrite and EndWrite
+     * @param size Size of the allocation
+     * @return Pointer that stays writable until EndWrite, nullptr if the pool is exhausted or no write batch is open
+     */
+    void* Alloc(size_t size)
+    {
+        std::lock_guard<std::recursive_mutex> lock(poolMutex);
+        assert(writeDepth > 0 && "ExecMem::Alloc outside of BeginWrite/EndWrite");
+        if (regions.empty() || size == 0 || writeDepth == 0) return nullptr;
+
+        size_t sizeClass = sizeClassOf(size);
+        void* res = nullptr;
+        size_t allocSize;
+        if (sizeClass < sizeClassCount)
+        {
+            allocSize = sizeClasses[sizeClass];
+            if (!freeLists[sizeClass].empty())
+            {
+                res = freeLists[sizeClass].back();
+                freeLists[sizeClass].pop_back();
+            }
+        }
+        else
+        {
+            allocSize = (size + pageSize - 1) / pageSize * pageSize;
+            auto it = largeFree.find(allocSize);
+            if (it != largeFree.end())
+            {
+                res = it->second;
+                largeFree.erase(it);
+            }
+        }
+
+        if (res == nullptr) res = carve(allocSize);
+        if (res == nullptr) return nullptr;
+
+        markDirty((uintptr_t) res, allocSize);
+        return res;
+    }
+
+    /**
+     * Returns memory to the pool
+     * @param ptr Pointer returned by Alloc
+     * @param size Size passed to Alloc
+     */
+    void Free(void* ptr, size_t size)
+    {
+        std::lock_guard<std::recursive_mutex> lock(poolMutex);
+        if (ptr == nullptr) return;
+        size_t sizeClass = sizeClassOf(size);
+        if (sizeClass < sizeClassCount) freeLists[sizeClass].push_back(ptr);
+        else largeFree.emplace((size + pageSize - 1) / pageSize * pageSize, ptr);
+    }
+
+    /**
+     * Starts a write batch, memory allocated until the matching EndWrite stays writable
+     */
+    void BeginWrite()
+    {
+        poolMutex.lock();
+        writeDepth++;
+    }
+
+    /**
+     * Ends a write batch, every page written to in the batch is made read/execute only with one protection change
+     * per contiguous range and the instruction cache is flushed for them
+     */
+    void EndWrite()
+    {
+        if (--writeDepth == 0 && !dirtyPages.empty())
+        {
+            uintptr_t rangeStart = *dirtyPages.begin();
+            uintptr_t rangeEnd = rangeStart;
+            for (uintptr_t page : dirtyPages)
+            {
+                if (page != rangeEnd)
+                {
+                    protect(rangeStart, rangeEnd - rangeStart, false);
+                    flush(rangeStart, rangeEnd - rangeStart);
+                    rangeStart = page;
+                }
+                rangeEnd = page + pageSize;
+            }
+            protect(rangeStart, rangeEnd - rangeStart, false);
+            flush(rangeStart, rangeEnd - rangeStart);
+            dirtyPages.clear();
+        }
+        poolMutex.unlock();
+    }
+
+    /**
+     * Checks whether a rel32 jump at from can reach addr
+     */
+    bool InReach(uintptr_t addr, uintptr_t from)
+    {
+        auto distance = (int64_t) addr - (int64_t) from;
+        return distance < maxDistance && distance > -maxDistance;
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef OMORI_PATCHER_EXECMEM_H
+#define OMORI_PATCHER_EXECMEM_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ExecMem
+{
+    bool Init(uintptr_t nearAddr, size_t regionSize = 1024 * 1024);
+    void* Alloc(size_t size);
+    void Free(void* ptr, size_t size);
+    void BeginWrite();
+    void EndWrite();
+    bool InReach(uintptr_t addr, uintptr_t from);
+}
+
+#endif //OMORI_PATCHER_EXECMEM_H
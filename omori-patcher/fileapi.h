@@ -0,0 +1,51 @@
+#ifndef OMORI_PATCHER_FILEAPI_H
+#define OMORI_PATCHER_FILEAPI_H
+
+#include <cstdint>
+#include <string>
+
+// Same as a HANDLE on Windows, file descriptors are stored as fd + 1 by the POSIX backend
+typedef void* FileHandle;
+#define INVALID_FILE_HANDLE ((FileHandle) (intptr_t) -1)
+
+// Values match FILE_BEGIN, FILE_CURRENT and FILE_END as well as SEEK_SET, SEEK_CUR and SEEK_END
+enum SeekMethod : uint32_t
+{
+    SEEK_METHOD_BEGIN = 0,
+    SEEK_METHOD_CURRENT = 1,
+    SEEK_METHOD_END = 2
+};
+
+const uint32_t FILE_ACCESS_READ = 0x80000000;
+const uint32_t FILE_ACCESS_WRITE = 0x40000000;
+const uint32_t FILE_SHARE_READ_WRITE = 3;
+
+// CreateFileW dispositions
+const uint32_t DISPOSITION_CREATE_NEW = 1;
+const uint32_t DISPOSITION_CREATE_ALWAYS = 2;
+const uint32_t DISPOSITION_OPEN_EXISTING = 3;
+const uint32_t DISPOSITION_OPEN_ALWAYS = 4;
+const uint32_t DISPOSITION_TRUNCATE_EXISTING = 5;
+
+// Same value as FILE_FLAG_OVERLAPPED, reads of such handles complete asynchronously at offsets they pass themselves
+const uint32_t FILE_OPEN_OVERLAPPED = 0x40000000;
+
+/**
+ * The file calls the overlay makes, implemented with the original Win32 functions by the detours and with POSIX calls
+ * by tools that run the overlay on Linux. Arguments are the CreateFileW/ReadFile/SetFilePointerEx ones, pointers that
+ * only mean something on Windows are passed through untouched
+ */
+class FileApi
+{
+public:
+    virtual ~FileApi() = default;
+
+    virtual std::wstring absolutePath(const wchar_t* path) = 0;
+    virtual FileHandle createFile(const wchar_t* path, uint32_t access, uint32_t share, void* security,
+                                  uint32_t disposition, uint32_t flags, FileHandle templateFile) = 0;
+    virtual bool readFile(FileHandle file, void* buffer, uint32_t size, uint32_t* read, void* overlapped) = 0;
+    virtual bool setFilePointer(FileHandle file, int64_t distance, int64_t* newPointer, uint32_t method) = 0;
+    virtual bool closeFile(FileHandle file) = 0;
+};
+
+#endif //OMORI_PATCHER_FILEAPI_H
@@ -0,0 +1,83 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <climits>
+#include "fileapi_posix.h"
+#include "overlaytrace.h"
+
+static int toFd(FileHandle file)
+{
+    return (int) (intptr_t) file - 1;
+}
+
+static bool isAbsolute(const wchar_t* path)
+{
+    return path[0] == L'/' || path[0] == L'\\' || (path[0] != 0 && path[1] == L':');
+}
+
+std::string PosixFileApi::hostPath(const wchar_t* path) const
+{
+    std::string utf8 = OverlayTrace::ToUtf8(path);
+    if (utf8.size() >= 2 && utf8[1] == ':') utf8.erase(0, 2);
+    for (char& c : utf8)
+    {
+        if (c == '\\') c = '/';
+    }
+    if (root.empty() || utf8.empty() || utf8[0] != '/') return utf8;
+    return root + utf8;
+}
+
+/**
+ * Absolute paths are returned unchanged so keys recorded on Windows still match, relative ones are resolved against
+ * the working directory
+ */
+std::wstring PosixFileApi::absolutePath(const wchar_t* path)
+{
+    if (isAbsolute(path)) return path;
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == nullptr) return path;
+    return OverlayTrace::FromUtf8(cwd) + L"/" + path;
+}
+
+FileHandle PosixFileApi::createFile(const wchar_t* path, uint32_t access, uint32_t, void*, uint32_t disposition,
+                                    uint32_t, FileHandle)
+{
+    int flags = O_CLOEXEC | ((access & FILE_ACCESS_WRITE) != 0 ? O_RDWR : O_RDONLY);
+    switch (disposition)
+    {
+        case DISPOSITION_CREATE_NEW:
+            flags |= O_CREAT | O_EXCL;
+            break;
+        case DISPOSITION_CREATE_ALWAYS:
+            flags |= O_CREAT | O_TRUNC;
+            break;
+        case DISPOSITION_OPEN_ALWAYS:
+            flags |= O_CREAT;
+            break;
+        case DISPOSITION_TRUNCATE_EXISTING:
+            flags |= O_TRUNC;
+            break;
+    }
+    int fd = open(hostPath(path).c_str(), flags, 0644);
+    if (fd < 0) return INVALID_FILE_HANDLE;
+    return (FileHandle) (intptr_t) (fd + 1);
+}
+
+bool PosixFileApi::readFile(FileHandle file, void* buffer, uint32_t size, uint32_t* read, void*)
+{
+    ssize_t len = ::read(toFd(file), buffer, size);
+    if (read != nullptr) *read = len > 0 ? (uint32_t) len : 0;
+    return len >= 0;
+}
+
+bool PosixFileApi::setFilePointer(FileHandle file, int64_t distance, int64_t* newPointer, uint32_t method)
+{
+    off_t pos = lseek(toFd(file), (off_t) distance, (int) method);
+    if (pos < 0) return false;
+    if (newPointer != nullptr) *newPointer = pos;
+    return true;
+}
+
+bool PosixFileApi::closeFile(FileHandle file)
+{
+    return close(toFd(file)) == 0;
+}
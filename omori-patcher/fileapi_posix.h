@@ -0,0 +1,29 @@
+#ifndef OMORI_PATCHER_FILEAPI_POSIX_H
+#define OMORI_PATCHER_FILEAPI_POSIX_H
+
+#include <string>
+#include "fileapi.h"
+
+/**
+ * File api backed by POSIX calls, for running the overlay on Linux. Windows paths are mapped into root: the drive is
+ * dropped and backslashes become slashes, so C:\Games\OMORI\www\data.json opens <root>/Games/OMORI/www/data.json
+ */
+class PosixFileApi : public FileApi
+{
+public:
+    explicit PosixFileApi(std::string root = "") : root(std::move(root)) {}
+
+    std::string hostPath(const wchar_t* path) const;
+
+    std::wstring absolutePath(const wchar_t* path) override;
+    FileHandle createFile(const wchar_t* path, uint32_t access, uint32_t share, void* security, uint32_t disposition,
+                          uint32_t flags, FileHandle templateFile) override;
+    bool readFile(FileHandle file, void* buffer, uint32_t size, uint32_t* read, void* overlapped) override;
+    bool setFilePointer(FileHandle file, int64_t distance, int64_t* newPointer, uint32_t method) override;
+    bool closeFile(FileHandle file) override;
+
+private:
+    std::string root;
+};
+
+#endif //OMORI_PATCHER_FILEAPI_POSIX_H
@@ -0,0 +1,436 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <json/json.h>
+#include "pch.h"
+#include "filter.h"
+#include "config.h"
+#include "trace.h"
+#include "utils.h"
+
+namespace Filter
+{
+    enum Action
+    {
+        ACTION_PASS,
+        ACTION_DROP,
+        ACTION_SAMPLE,
+        ACTION_RATE_LIMIT,
+        ACTION_FILE
+    };
+
+    struct Rule
+    {
+        std::string pattern;
+        Action action;
+        uint32_t every;
+        uint32_t perSecond;
+        FILE* file;
+        std::atomic<uint64_t> matched{0};
+        std::atomic<uint64_t> suppressed{0};
+        std::atomic<uint64_t> routed{0};
+        std::atomic<uint64_t> windowStart{0};
+        std::atomic<uint32_t> windowCount{0};
+        std::atomic<uint32_t> windowSuppressed{0};
+    };
+
+    enum TokenType : uint8_t
+    {
+        TOKEN_BYTE,
+        TOKEN_ANY,
+        TOKEN_STAR
+    };
+
+    struct Token
+    {
+        TokenType type;
+        uint8_t byte;
+    };
+
+    struct Pattern
+    {
+        std::vector<Token> tokens;
+        // Configured rule the pattern belongs to, -1 for the built-in prefixes
+        int rule;
+        Kind kind;
+    };
+
+    struct Builtin
+    {
+        Kind kind;
+        const char* prefix;
+    };
+
+    const Builtin builtins[] = {
+            {KIND_RPC,   "<omori-patcher>: "},
+            {KIND_LOG,   "console.log: "},
+            {KIND_WARN,  "console.warn: "},
+            {KIND_ERROR, "console.error: "},
+    };
+
+    const uint16_t DEAD_STATE = 0;
+    const uint16_t START_STATE = 1;
+    const size_t MAX_STATES = 4096;
+
+    // DFA over byte classes, bytes no pattern names literally all share class 0
+    struct Automaton
+    {
+        uint8_t byteClass[256];
+        uint32_t classCount;
+        std::vector<uint16_t> next;
+        std::vector<int> rule;
+        std::vector<Kind> kind;
+        // States every byte leads back to, the rest of the message can't change the result
+        std::vector<uint8_t> sink;
+    };
+
+    std::vector<std::unique_ptr<Rule>> rules;
+    Automaton automaton;
+    std::map<std::string, FILE*> files;
+    std::mutex filesMutex;
+
+    std::vector<Token> parseGlob(const std::string& glob)
+    {
+        std::vector<Token> tokens;
+        for (size_t i = 0; i < glob.size(); i++)
+        {
+            if (glob[i] == '*')
+            {
+                // Consecutive stars are the same as one
+                if (tokens.empty() || tokens.back().type != TOKEN_STAR) tokens.push_back({TOKEN_STAR, 0});
+            }
+            else if (glob[i] == '?') tokens.push_back({TOKEN_ANY, 0});
+            else if (glob[i] == '\\' && i + 1 < glob.size()) tokens.push_back({TOKEN_BYTE, (uint8_t) glob[++i]});
+            else tokens.push_back({TOKEN_BYTE, (uint8_t) glob[i]});
+        }
+        return tokens;
+    }
+
+    std::vector<Token> parsePrefix(const std::string& prefix)
+    {
+        std::vector<Token> tokens;
+        for (char c : prefix) tokens.push_back({TOKEN_BYTE, (uint8_t) c});
+        tokens.push_back({TOKEN_STAR, 0});
+        return tokens;
+    }
+
+    /**
+     * Compiles the patterns into a DFA with subset construction, an NFA state is a position inside a pattern
+     * @return Whether the DFA fit in MAX_STATES
+     */
+    bool compile(const std::vector<Pattern>& patterns, Automaton& out)
+    {
+        std::vector<uint32_t> nfaPattern;
+        std::vector<uint32_t> nfaPos;
+        std::vector<uint32_t> starts;
+        for (uint32_t i = 0; i < patterns.size(); i++)
+        {
+            starts.push_back((uint32_t) nfaPattern.size());
+            for (uint32_t pos = 0; pos <= patterns[i].tokens.size(); pos++)
+            {
+                nfaPattern.push_back(i);
+                nfaPos.push_back(pos);
+            }
+        }
+
+        // Adds a state and, since a star can match nothing, every state after a run of stars
+        auto add = [&](std::vector<uint32_t>& set, uint32_t state) {
+            while (true)
+            {
+                set.push_back(state);
+                const auto& tokens = patterns[nfaPattern[state]].tokens;
+                if (nfaPos[state] >= tokens.size() || tokens[nfaPos[state]].type != TOKEN_STAR) break;
+                state++;
+            }
+        };
+
+        memset(out.byteClass, 0, sizeof(out.byteClass));
+        out.classCount = 1;
+        std::vector<int> representative = {-1};
+        for (const Pattern& pattern : patterns)
+        {
+            for (const Token& token : pattern.tokens)
+            {
+                if (token.type != TOKEN_BYTE || out.byteClass[token.byte] != 0) continue;
+                out.byteClass[token.byte] = (uint8_t) out.classCount++;
+                representative.push_back(token.byte);
+            }
+        }
+        for (int b = 1; b < 256 && representative[0] < 0; b++)
+        {
+            if (out.byteClass[b] == 0) representative[0] = b;
+        }
+        if (out.classCount > 255) return false;
+
+        std::map<std::vector<uint32_t>, uint16_t> ids;
+        std::vector<std::vector<uint32_t>> sets;
+        auto intern = [&](std::vector<uint32_t>& set) -> int {
+            std::sort(set.begin(), set.end());
+            set.erase(std::unique(set.begin(), set.end()), set.end());
+            auto it = ids.find(set);
+            if (it != ids.end()) return it->second;
+            if (sets.size() >= MAX_STATES) return -1;
+            ids[set] = (uint16_t) sets.size();
+            sets.push_back(set);
+            return (int) sets.size() - 1;
+        };
+
+        std::vector<uint32_t> set;
+        intern(set);
+        for (uint32_t start : starts) add(set, start);
+        intern(set);
+
+        out.next.clear();
+        for (size_t i = 0; i < sets.size(); i++)
+        {
+            for (uint32_t c = 0; c < out.classCount; c++)
+            {
+                set.clear();
+                if (representative[c] >= 0)
+                {
+                    for (uint32_t state : sets[i])
+                    {
+                        const auto& tokens = patterns[nfaPattern[state]].tokens;
+                        uint32_t pos = nfaPos[state];
+                        if (pos >= tokens.size()) continue;
+                        const Token& token = tokens[pos];
+                        if (token.type == TOKEN_STAR) add(set, state);
+                        else if (token.type == TOKEN_ANY || token.byte == representative[c]) add(set, state + 1);
+                    }
+                }
+                int id = intern(set);
+                if (id < 0) return false;
+                out.next.push_back((uint16_t) id);
+            }
+        }
+
+        out.rule.assign(sets.size(), -1);
+        out.kind.assign(sets.size(), KIND_PLAIN);
+        out.sink.assign(sets.size(), 1);
+        for (size_t i = 0; i < sets.size(); i++)
+        {
+            for (uint32_t state : sets[i])
+            {
+                const Pattern& pattern = patterns[nfaPattern[state]];
+                if (nfaPos[state] != pattern.tokens.size()) continue;
+                if (pattern.rule < 0) out.kind[i] = pattern.kind;
+                else if (out.rule[i] < 0 || pattern.rule < out.rule[i]) out.rule[i] = pattern.rule;
+            }
+            for (uint32_t c = 0; c < out.classCount; c++)
+            {
+                if (out.next[i * out.classCount + c] != i) out.sink[i] = 0;
+            }
+        }
+        return true;
+    }
+
+    FILE* openRouteFile(const std::string& path)
+    {
+        auto it = files.find(path);
+        if (it != files.end()) return it->second;
+        FILE* file = nullptr;
+        if (fopen_s(&file, path.c_str(), "w") != 0 || file == nullptr)
+        {
+            Utils::Errorf("[console] Failed to open %s for writing", path.c_str());
+            return nullptr;
+        }
+        files[path] = file;
+        return file;
+    }
+
+    /**
+     * Builds the console filter from the "console" section. Every entry of "rules" has a "glob" (* and ? wildcards,
+     * \ escapes) or a "prefix" and an "action": pass, drop, sample (one in "every"), rateLimit ("perSecond") or file
+     * (routed to "file" instead of the console). The first matching rule wins, without "rules" getImage spam is
+     * dropped like before
+     */
+    void Load()
+    {
+        TRACE_SCOPE("Filter::Load");
+        const Json::Value& config = Config::Section("console");
+        Json::Value ruleConfigs = config.get("rules", Json::Value(Json::nullValue));
+        if (ruleConfigs.isNull())
+        {
+            ruleConfigs = Json::Value(Json::arrayValue);
+            Json::Value getImage;
+            getImage["prefix"] = "console.log: getImage";
+            getImage["action"] = "drop";
+            ruleConfigs.append(getImage);
+        }
+
+        std::vector<Pattern> patterns;
+        for (const Builtin& builtin : builtins)
+        {
+            patterns.push_back({parsePrefix(builtin.prefix), -1, builtin.kind});
+        }
+        for (Json::ArrayIndex i = 0; i < ruleConfigs.size(); i++)
+        {
+            const Json::Value& ruleConfig = ruleConfigs[i];
+            auto rule = std::make_unique<Rule>();
+            std::vector<Token> tokens;
+            if (ruleConfig.isMember("glob"))
+            {
+                rule->pattern = ruleConfig["glob"].asString();
+                tokens = parseGlob(rule->pattern);
+            }
+            else if (ruleConfig.isMember("prefix"))
+            {
+                rule->pattern = ruleConfig["prefix"].asString() + "*";
+                tokens = parsePrefix(ruleConfig["prefix"].asString());
+            }
+            else
+            {
+                Utils::Errorf("[console] Rule %u has neither a glob nor a prefix", i);
+                continue;
+            }
+
+            auto action = ruleConfig.get("action", "drop").asString();
+            rule->every = std::max(ruleConfig.get("every", 1).asUInt(), 1u);
+            rule->perSecond = ruleConfig.get("perSecond", 0).asUInt();
+            rule->file = nullptr;
+            if (action == "pass") rule->action = ACTION_PASS;
+            else if (action == "drop") rule->action = ACTION_DROP;
+            else if (action == "sample") rule->action = ACTION_SAMPLE;
+            else if (action == "rateLimit") rule->action = ACTION_RATE_LIMIT;
+            else if (action == "file")
+            {
+                rule->action = ACTION_FILE;
+                rule->file = openRouteFile(ruleConfig.get("file", "omori-patcher-console.log").asString());
+                if (rule->file == nullptr) continue;
+            }
+            else
+            {
+                Utils::Errorf("[console] Rule %u has unknown action %s", i, action.c_str());
+                continue;
+            }
+
+            patterns.push_back({std::move(tokens), (int) rules.size(), KIND_PLAIN});
+            rules.push_back(std::move(rule));
+        }
+
+        if (!compile(patterns, automaton))
+        {
+            Utils::Errorf("[console] Filter rules need more than %zu states, console filtering is disabled", MAX_STATES);
+            rules.clear();
+            patterns.resize(std::size(builtins));
+            compile(patterns, automaton);
+        }
+        if (!rules.empty())
+        {
+            Utils::Infof("[console] %zu filter %s, %zu states", rules.size(), rules.size() == 1 ? "rule" : "rules",
+                         automaton.rule.size());
+        }
+    }
+
+    /**
+     * Classifies a console message in one pass over its bytes
+     * @param msg NUL terminated message
+     * @return Kind of the message, the first rule it matched and its length
+     */
+    Match Classify(const char* msg)
+    {
+        const Automaton& a = automaton;
+        if (a.next.empty()) return {KIND_PLAIN, -1, strlen(msg)};
+        uint32_t state = START_STATE;
+        const char* p = msg;
+        while (*p != 0 && !a.sink[state])
+        {
+            state = a.next[state * a.classCount + a.byteClass[(uint8_t) *p]];
+            p++;
+        }
+        return {a.kind[state], a.rule[state], (size_t) (p - msg) + strlen(p)};
+    }
+
+    size_t PrefixLength(Kind kind)
+    {
+        for (const Builtin& builtin : builtins)
+        {
+            if (builtin.kind == kind) return strlen(builtin.prefix);
+        }
+        return 0;
+    }
+
+    bool allowRate(Rule& rule)
+    {
+        uint64_t now = GetTickCount64();
+        uint64_t start = rule.windowStart.load(std::memory_order_relaxed);
+        if (now - start >= 1000 && rule.windowStart.compare_exchange_strong(start, now))
+        {
+            rule.windowCount.store(0, std::memory_order_relaxed);
+            uint32_t dropped = rule.windowSuppressed.exchange(0, std::memory_order_relaxed);
+            if (dropped != 0)
+            {
+                Utils::Warnf("[console] Rate limit suppressed %u %s matching %s", dropped,
+                             dropped == 1 ? "message" : "messages", rule.pattern.c_str());
+            }
+        }
+        if (rule.windowCount.fetch_add(1, std::memory_order_relaxed) < rule.perSecond) return true;
+        rule.windowSuppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    /**
+     * Applies the action of the rule a message matched
+     * @param match Result of Classify for msg
+     * @param msg The message
+     * @return Whether the message should still be printed
+     */
+    bool Allow(const Match& match, const char* msg)
+    {
+        if (match.rule < 0) return true;
+        Rule& rule = *rules[match.rule];
+        uint64_t seen = rule.matched.fetch_add(1, std::memory_order_relaxed);
+        bool allowed;
+        switch (rule.action)
+        {
+            case ACTION_PASS:
+                return true;
+            case ACTION_SAMPLE:
+                allowed = seen % rule.every == 0;
+                break;
+            case ACTION_RATE_LIMIT:
+                allowed = allowRate(rule);
+                break;
+            case ACTION_FILE:
+            {
+                std::lock_guard lock(filesMutex);
+                fwrite(msg, 1, match.length, rule.file);
+                fputc('\n', rule.file);
+                rule.routed.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            default:
+                allowed = false;
+                break;
+        }
+        if (!allowed) rule.suppressed.fetch_add(1, std::memory_order_relaxed);
+        return allowed;
+    }
+
+    /**
+     * Prints the counters of every rule that matched anything
+     */
+    void Dump()
+    {
+        for (const auto& rule : rules)
+        {
+            uint64_t matched = rule->matched.load(std::memory_order_relaxed);
+            if (matched == 0) continue;
+            Utils::Infof("[console] %10llu matched %10llu suppressed %10llu routed  %s", matched,
+                         rule->suppressed.load(std::memory_order_relaxed),
+                         rule->routed.load(std::memory_order_relaxed), rule->pattern.c_str());
+        }
+    }
+
+    void Flush()
+    {
+        std::lock_guard lock(filesMutex);
+        for (const auto& [path, file] : files) fflush(file);
+    }
+}
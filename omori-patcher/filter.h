@@ -0,0 +1,35 @@
+#ifndef OMORI_PATCHER_FILTER_H
+#define OMORI_PATCHER_FILTER_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Filter
+{
+    // What a console message is by its prefix, decided in the same pass as the filter rules
+    enum Kind : uint8_t
+    {
+        KIND_PLAIN,
+        KIND_RPC,
+        KIND_LOG,
+        KIND_WARN,
+        KIND_ERROR
+    };
+
+    struct Match
+    {
+        Kind kind;
+        // Index of the first configured rule matching the message, or -1
+        int rule;
+        size_t length;
+    };
+
+    void Load();
+    Match Classify(const char* msg);
+    size_t PrefixLength(Kind kind);
+    bool Allow(const Match& match, const char* msg);
+    void Dump();
+    void Flush();
+}
+
+#endif //OMORI_PATCHER_FILTER_H
@@ -1,37 +1,99 @@
-#include <mutex>
+#include <chrono>
 #include <iostream>
+#include <mutex>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
 #include "fs_overlay.h"
 #include "utils.h"
 #include "detours.h"
+#include "report.h"
+#include "startup.h"
+#include "trace.h"
+#include "binlog.h"
+#include "config.h"
+#include "overlay.h"
+#include "overlaytrace.h"
+#include "prefetch.h"
 
 static BOOL (WINAPI* trueSetFilePointerEx)(HANDLE hFile, _LARGE_INTEGER liDistanceToMove, PLARGE_INTEGER lpNewFilePointer, DWORD dwMoveMethod) = SetFilePointerEx;
 static HANDLE (WINAPI* trueCreateFileW)(LPCWSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode, LPSECURITY_ATTRIBUTES lpSecurityAttributes, DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile) = CreateFileW;
 static BOOL (WINAPI* trueReadFile)(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead, LPDWORD lpNumberOfBytesRead, LPOVERLAPPED lpOverlapped) = ReadFile;
+static BOOL (WINAPI* trueCloseHandle)(HANDLE hObject) = CloseHandle;
+
+/**
+ * File api over the original functions, the detours never see their own calls
+ */
+class Win32FileApi : public FileApi
+{
+public:
+    std::wstring absolutePath(const wchar_t* path) override
+    {
+        wchar_t buffer[MAX_PATH];
+        DWORD len = GetFullPathNameW(path, MAX_PATH, buffer, nullptr);
+        if (len < MAX_PATH) return {buffer, len};
+        std::wstring res(len, L'\0');
+        res.resize(GetFullPathNameW(path, len, res.data(), nullptr));
+        return res;
+    }
+
+    FileHandle createFile(const wchar_t* path, uint32_t access, uint32_t share, void* security, uint32_t disposition,
+                          uint32_t flags, FileHandle templateFile) override
+    {
+        return trueCreateFileW(path, access, share, (LPSECURITY_ATTRIBUTES) security, disposition, flags, templateFile);
+    }
+
+    bool readFile(FileHandle file, void* buffer, uint32_t size, uint32_t* read, void* overlapped) override
+    {
+        return trueReadFile(file, buffer, size, (LPDWORD) read, (LPOVERLAPPED) overlapped);
+    }
+
+    bool setFilePointer(FileHandle file, int64_t distance, int64_t* newPointer, uint32_t method) override
+    {
+        LARGE_INTEGER move;
+        move.QuadPart = distance;
+        return trueSetFilePointerEx(file, move, (PLARGE_INTEGER) newPointer, method);
+    }
+
+    bool closeFile(FileHandle file) override
+    {
+        return trueCloseHandle(file);
+    }
+};
 
-std::map<std::wstring, std::wstring> overlay;
-std::map<std::wstring, FileData> binOverlay;
-std::map<HANDLE, std::wstring> fileMap;
-std::map<HANDLE, _LARGE_INTEGER> filePtrMap;
-std::mutex mapMutex;
+Win32FileApi win32Api;
+OverlayEngine engine(win32Api);
+// Records every detoured call when overlay.capture is set, for tools/overlay-replay
+OverlayTrace::Writer capture;
+// Files opened while capturing, every other handle's close is left out of the trace
+std::mutex capturedMutex;
+std::unordered_set<HANDLE> capturedHandles;
+// Records the order scenes open files in and reads them ahead on later runs, when overlay.profile is set. Never freed,
+// its thread runs until the game exits
+Prefetcher* prefetcher = nullptr;
+std::string profilePath;
+bool prefetchEnabled = false;
 
-void addFileW(const Mod& mod, const wchar_t* pathWCstr)
+uint64_t captureNowNs()
 {
-    auto path = std::wstring(pathWCstr);
-    auto modDir_cstr = mod.modDir.c_str();
-    size_t modDir_cstrlen = strlen(modDir_cstr) + 1;
-    auto modDir = new wchar_t[modDir_cstrlen];
-    size_t convertedChars = 0;
-    mbstowcs_s(&convertedChars, modDir, modDir_cstrlen, modDir_cstr, _TRUNCATE);
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
-    auto modDirAbsWs = Utils::GetAbsolutePathW((std::wstring(L"mods/") + modDir).c_str());
-    auto modDirAbs = std::wstring(modDirAbsWs);
+void addFileW(const Mod& mod, const wchar_t* pathWCstr, ModCost& cost)
+{
+    Arena& arena = Arena::forThread();
+    Arena::Scope scope(arena);
+    std::wstring_view path = pathWCstr;
+    auto modDirAbs = std::wstring_view(Utils::GetAbsolutePathW(
+            (std::wstring(L"mods/") + Utils::Widen(mod.modDir.c_str(), arena)).c_str(), arena));
 
     if (path.back() == L'\\')
     {
         HANDLE handle;
         WIN32_FIND_DATAW finfo;
 
-        if((handle = FindFirstFileW((path + L"*").c_str(), &finfo)) != INVALID_HANDLE_VALUE)
+        if((handle = FindFirstFileW((std::wstring(path) + L"*").c_str(), &finfo)) != INVALID_HANDLE_VALUE)
         {
             do {
                 auto name = finfo.cFileName;
@@ -39,11 +101,11 @@ void addFileW(const Mod& mod, const wchar_t* pathWCstr)
                     continue;
                 }
 
-                std::wstring istr = path + name;
-                if ((GetFileAttributesW(istr.c_str()) & FILE_ATTRIBUTE_DIRECTORY) != 0) {
-                    addFileW(mod, (istr + L"\\").c_str());
+                std::wstring istr = std::wstring(path) + name;
+                if ((finfo.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0) {
+                    addFileW(mod, (istr + L"\\").c_str(), cost);
                 } else {
-                    addFileW(mod, istr.c_str());
+                    addFileW(mod, istr.c_str(), cost);
                 }
 
             } while (FindNextFileW(handle, &finfo));
@@ -52,36 +114,30 @@ void addFileW(const Mod& mod, const wchar_t* pathWCstr)
     }
     else
     {
-        auto asset = path.substr(modDirAbs.size()+1, path.size());
-        auto fullBase = Utils::GetAbsolutePathW(asset.c_str());
-        overlay[std::wstring(fullBase)] = path;
-        free((void*) fullBase);
+        auto asset = std::wstring(path.substr(modDirAbs.size()+1));
+        auto fullBase = Utils::GetAbsolutePathW(asset.c_str(), arena);
+        engine.add(fullBase, std::wstring(path));
+        BINLOG(LOG_DEBUG, "[overlay] %s: %ls -> %ls", mod.modDir.c_str(), fullBase, pathWCstr);
+        cost.filesScanned++;
+        cost.overlayEntries++;
     }
-
-    free(modDir);
-    free((void*) modDirAbsWs);
 }
 
-void addFile(const Mod& mod, const Json::Value& v)
+void addFile(const Mod& mod, const Json::Value& v, ModCost& cost)
 {
+    Arena& arena = Arena::forThread();
+    Arena::Scope scope(arena);
     auto asset = v.asString();
     auto modAsset = "mods/" + mod.modDir + "/" + asset;
-    const char* assetCStr = Utils::GetAbsolutePath(asset.c_str());
-    const char* modAssetCStr = Utils::GetAbsolutePath(modAsset.c_str());
-    size_t assetNewSize = strlen(assetCStr) + 1;
-    size_t modAssetNewSize = strlen(modAssetCStr) + 1;
-    auto assetWCStr = new wchar_t[assetNewSize];
-    auto modAssetWCstr = new wchar_t[modAssetNewSize];
-    size_t convertedChars = 0;
-    mbstowcs_s(&convertedChars, assetWCStr, assetNewSize, assetCStr, _TRUNCATE);
-    mbstowcs_s(&convertedChars, modAssetWCstr, modAssetNewSize, modAssetCStr, _TRUNCATE);
-
-    if (std::wstring(assetWCStr).back() == L'\\')
+    std::wstring_view assetW = Utils::Widen(Utils::GetAbsolutePath(asset.c_str(), arena), arena);
+    std::wstring_view modAssetW = Utils::Widen(Utils::GetAbsolutePath(modAsset.c_str(), arena), arena);
+
+    if (!assetW.empty() && assetW.back() == L'\\')
     {
         HANDLE handle;
         WIN32_FIND_DATAW finfo;
 
-        if((handle = FindFirstFileW((std::wstring(modAssetWCstr) + L"*").c_str(), &finfo)) != INVALID_HANDLE_VALUE){
+        if((handle = FindFirstFileW((std::wstring(modAssetW) + L"*").c_str(), &finfo)) != INVALID_HANDLE_VALUE){
             do{
                 auto name = finfo.cFileName;
                 if (wcscmp(name, L".") == 0 || wcscmp(name, L"..") == 0)
@@ -89,14 +145,14 @@ void addFile(const Mod& mod, const Json::Value& v)
                     continue;
                 }
 
-                std::wstring istr = std::wstring(modAssetWCstr) + name;
-                if ((GetFileAttributesW(istr.c_str()) & FILE_ATTRIBUTE_DIRECTORY) != 0)
+                std::wstring istr = std::wstring(modAssetW) + name;
+                if ((finfo.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0)
                 {
-                    addFileW(mod, (istr + L"\\").c_str());
+                    addFileW(mod, (istr + L"\\").c_str(), cost);
                 }
                 else
                 {
-                    addFileW(mod, istr.c_str());
+                    addFileW(mod, istr.c_str(), cost);
                 }
 
             }while(FindNextFileW(handle, &finfo));
@@ -105,98 +161,212 @@ void addFile(const Mod& mod, const Json::Value& v)
     }
     else
     {
-        overlay[std::wstring(assetWCStr)] = modAssetWCstr;
+        engine.add(std::wstring(assetW), std::wstring(modAssetW));
+        cost.filesScanned++;
+        cost.overlayEntries++;
     }
-    free((void*) assetCStr);
-    free((void*) assetWCStr);
-    free((void*) modAssetCStr);
-    free((void*) modAssetWCstr);
 }
 
 void FS_RegisterOverlay(const Mod& mod)
 {
+    TRACE_SCOPE_DETAIL("FS_RegisterOverlay", mod.modDir);
     std::vector<std::string> modKeys = {"assets", "files", "maps", "data"};
+    ModCost& cost = Report::For(mod.modDir);
+    double start = Report::NowMs();
 
     for (const auto & modKey : modKeys)
     {
         auto arr = mod.files.get(modKey, {});
         for (const auto& v : arr)
         {
-            addFile(mod, v);
+            addFile(mod, v, cost);
         }
     }
+    cost.overlayMs = Report::NowMs() - start;
 
 }
 
+/**
+ * Freezes the overlay index once every mod is registered, everything the load phase allocated on this thread is freed
+ */
+void FS_FreezeOverlay()
+{
+    TRACE_SCOPE("FS_FreezeOverlay");
+    size_t bytes = engine.freeze();
+    Arena::forThread().release();
+    if (capture.isOpen())
+    {
+        engine.forEach([](std::wstring_view path, std::wstring_view target) { capture.overlayEntry(path, target); });
+    }
+    Utils::Infof("[overlay] %zu files frozen into %zu bytes", engine.size(), bytes);
+    if (prefetcher != nullptr && prefetchEnabled) prefetcher->start();
+}
+
+/**
+ * Resolves a game relative path through the overlay
+ * @param path Path relative to the game directory
+ * @return Path of the file a mod replaces it with, or the absolute path of the original file
+ */
+std::string FS_ResolvePath(const std::string& path)
+{
+    Arena& arena = Arena::forThread();
+    Arena::Scope scope(arena);
+    const char* absolute = Utils::GetAbsolutePath(path.c_str(), arena);
+
+    std::string res = absolute;
+    std::wstring target;
+    if (engine.find(Utils::Widen(absolute, arena), target))
+    {
+        size_t convertedChars = 0;
+        res.resize(target.size() * 4 + 1);
+        wcstombs_s(&convertedChars, res.data(), res.size(), target.c_str(), _TRUNCATE);
+        res.resize(strlen(res.c_str()));
+    }
+    return res;
+}
+
 BOOL WINAPI hookedSetFilePointerEx(HANDLE hFile, _LARGE_INTEGER liDistanceToMove, PLARGE_INTEGER lpNewFilePointer, DWORD dwMoveMethod)
 {
-    std::lock_guard<std::mutex> lock(mapMutex);
-    auto filename = fileMap[hFile];
-    if (binOverlay.contains(filename))
-    {
-        if (!filePtrMap.contains(hFile)) filePtrMap[hFile] = _LARGE_INTEGER{};
-        switch (dwMoveMethod) {
-            case FILE_BEGIN:
-                filePtrMap[hFile].QuadPart = 0;
-                *lpNewFilePointer = filePtrMap[hFile];
-                break;
-            case FILE_CURRENT:
-                *lpNewFilePointer = filePtrMap[hFile];
-                break;
-            case FILE_END:
-                filePtrMap[hFile].QuadPart = (long long) binOverlay[filename].size;
-                *lpNewFilePointer = filePtrMap[hFile];
-                break;
-            default:
-                Utils::Warnf("Unsupported setFilePointerEx move method: %d", dwMoveMethod);
-        }
-        return true;
+    if (!capture.isOpen())
+    {
+        return engine.setFilePointer(hFile, liDistanceToMove.QuadPart, (int64_t*) lpNewFilePointer, dwMoveMethod);
     }
-    return trueSetFilePointerEx(hFile, liDistanceToMove, lpNewFilePointer, dwMoveMethod);
+    uint64_t start = captureNowNs();
+    int64_t newPointer = 0;
+    bool ok = engine.setFilePointer(hFile, liDistanceToMove.QuadPart, &newPointer, dwMoveMethod);
+    if (ok && lpNewFilePointer != nullptr) lpNewFilePointer->QuadPart = newPointer;
+    capture.setFilePointer(GetCurrentThreadId(), captureNowNs() - start, hFile, liDistanceToMove.QuadPart, dwMoveMethod,
+                           newPointer, ok);
+    return ok;
 }
 
 HANDLE WINAPI hookedCreateFileW(LPCWSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode, LPSECURITY_ATTRIBUTES lpSecurityAttributes, DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile)
 {
-    std::lock_guard<std::mutex> lock(mapMutex);
-    HANDLE handle;
-    if (overlay.contains(Utils::GetAbsolutePathW(lpFileName)))
+    Startup::WaitForFile(lpFileName);
+    uint64_t start = capture.isOpen() ? captureNowNs() : 0;
+    bool redirected = false;
+    HANDLE handle = engine.createFile(lpFileName, dwDesiredAccess, dwShareMode, lpSecurityAttributes,
+                                      dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile, &redirected);
+    if (redirected) BINLOG(LOG_DEBUG, "[overlay] CreateFileW %ls redirected, handle %p", lpFileName, handle);
+    if (capture.isOpen())
     {
-        handle = trueCreateFileW(overlay[Utils::GetAbsolutePathW(lpFileName)].c_str(), dwDesiredAccess, dwShareMode,
-                                 lpSecurityAttributes, dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile);
-    }
-    else {
-        handle = trueCreateFileW(lpFileName, dwDesiredAccess, dwShareMode, lpSecurityAttributes, dwCreationDisposition,
-                                 dwFlagsAndAttributes, hTemplateFile);
+        capture.createFile(GetCurrentThreadId(), captureNowNs() - start, handle, lpFileName, dwDesiredAccess,
+                           dwShareMode, dwCreationDisposition, dwFlagsAndAttributes, redirected);
+        std::lock_guard lock(capturedMutex);
+        if (handle != INVALID_HANDLE_VALUE) capturedHandles.insert(handle);
     }
-    fileMap[handle] = Utils::GetAbsolutePathW(lpFileName);
     return handle;
 }
 
 BOOL WINAPI hookedReadFile(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead, LPDWORD lpNumberOfBytesRead, LPOVERLAPPED lpOverlapped)
 {
-    std::lock_guard<std::mutex> lock(mapMutex);
-    auto filename = fileMap[hFile];
-    if (binOverlay.contains(filename))
+    if (!capture.isOpen())
     {
-        if (lpOverlapped != nullptr)
-        {
-            Utils::Warn("lpOverlapped != nullptr on an overlayed file, thinks might break");
-        }
-        size_t len = nNumberOfBytesToRead;
-        size_t offset = filePtrMap[hFile].QuadPart;
-        if (len + offset > binOverlay[filename].size) len = len + offset - binOverlay[filename].size;
-        filePtrMap[hFile].QuadPart += nNumberOfBytesToRead;
-        if (filePtrMap[hFile].QuadPart >= binOverlay[filename].size) filePtrMap[hFile].QuadPart = 0;
-        memcpy(lpBuffer, binOverlay[filename].data+offset, len);
-        *lpNumberOfBytesRead = len;
-        return true;
-    }
-    return trueReadFile(hFile, lpBuffer, nNumberOfBytesToRead, lpNumberOfBytesRead, lpOverlapped);
+        return engine.readFile(hFile, lpBuffer, nNumberOfBytesToRead, (uint32_t*) lpNumberOfBytesRead, lpOverlapped);
+    }
+    uint64_t start = captureNowNs();
+    bool ok = engine.readFile(hFile, lpBuffer, nNumberOfBytesToRead, (uint32_t*) lpNumberOfBytesRead, lpOverlapped);
+    capture.readFile(GetCurrentThreadId(), captureNowNs() - start, hFile, nNumberOfBytesToRead,
+                     lpNumberOfBytesRead != nullptr ? *lpNumberOfBytesRead : 0, ok);
+    return ok;
 }
 
+BOOL WINAPI hookedCloseHandle(HANDLE hObject)
+{
+    if (!capture.isOpen())
+    {
+        return engine.closeFile(hObject);
+    }
+    uint64_t start = captureNowNs();
+    bool ok = engine.closeFile(hObject);
+    uint64_t ns = captureNowNs() - start;
+    std::lock_guard lock(capturedMutex);
+    if (capturedHandles.erase(hObject) != 0) capture.closeFile(GetCurrentThreadId(), ns, hObject, ok);
+    return ok;
+}
+
+/**
+ * Attaches the file detours, with overlay.capture set every call they see is recorded to that file. overlay.cacheBytes
+ * sets the budget of the content cache replaced files are read from, 0 leaves it off, and overlay.cacheMaxFileBytes
+ * the largest file it takes. overlay.profile is where the order files are opened in is kept between runs, with
+ * overlay.prefetch (on by default) the files in it are read ahead and with overlay.profileBase files no mod replaces
+ * are included
+ */
 void FS_RegisterDetours()
 {
+    const Json::Value& config = Config::Section("overlay");
+    engine.contentCache().configure(config.get("cacheBytes", 0).asUInt64(), config.get("cacheMaxFileBytes", 0).asUInt64());
+    if (engine.contentCache().enabled())
+    {
+        Utils::Infof("[overlay] Caching replaced files in up to %llu KB",
+                     (unsigned long long) engine.contentCache().stats().budget / 1024);
+    }
+
+    profilePath = config.get("profile", "").asString();
+    if (!profilePath.empty())
+    {
+        prefetcher = new Prefetcher(engine, config.get("profileBase", false).asBool(),
+                                    config.get("profileMaxFilesPerScene", 512).asUInt());
+        prefetchEnabled = config.get("prefetch", true).asBool();
+        std::string error;
+        if (!prefetcher->load(profilePath.c_str(), error))
+        {
+            Utils::Infof("[overlay] No access profile yet (%s), recording one", error.c_str());
+        }
+        engine.setListener(prefetcher);
+    }
+
+    auto capturePath = config.get("capture", "").asString();
+    if (!capturePath.empty())
+    {
+        if (capture.open(capturePath.c_str())) Utils::Infof("[overlay] Capturing file calls to %s", capturePath.c_str());
+        else Utils::Errorf("[overlay] Failed to open %s for writing", capturePath.c_str());
+    }
+
     DetourAttach(&(PVOID &) trueCreateFileW, (PVOID) hookedCreateFileW);
     DetourAttach(&(PVOID &) trueReadFile, (PVOID) hookedReadFile);
     DetourAttach(&(PVOID &) trueSetFilePointerEx, (PVOID) hookedSetFilePointerEx);
+    DetourAttach(&(PVOID &) trueCloseHandle, (PVOID) hookedCloseHandle);
+}
+
+/**
+ * Logs how well the content cache and the prefetcher did, called when the game exits
+ */
+void FS_DumpStats()
+{
+    if (prefetcher != nullptr && prefetchEnabled)
+    {
+        Prefetcher::Stats prefetch = prefetcher->stats();
+        Utils::Infof("[overlay] prefetch: %llu scenes, %llu files queued, %llu warmed (%llu KB), %llu used, %llu late, "
+                     "%llu dropped", (unsigned long long) prefetch.scenes, (unsigned long long) prefetch.queued,
+                     (unsigned long long) prefetch.warmed, (unsigned long long) prefetch.warmedBytes / 1024,
+                     (unsigned long long) prefetch.used, (unsigned long long) prefetch.late,
+                     (unsigned long long) prefetch.dropped);
+    }
+    if (!engine.contentCache().enabled()) return;
+    ContentCache::Stats stats = engine.contentCache().stats();
+    uint64_t lookups = stats.hits + stats.misses;
+    Utils::Infof("[overlay] cache: %llu hits, %llu misses (%.1f%% hit rate), %llu too large, %llu evictions (%llu KB)",
+                 (unsigned long long) stats.hits, (unsigned long long) stats.misses,
+                 lookups != 0 ? (double) stats.hits * 100 / (double) lookups : 0.0, (unsigned long long) stats.skipped,
+                 (unsigned long long) stats.evictions, (unsigned long long) stats.evictedBytes / 1024);
+    Utils::Infof("[overlay] cache: %zu files resident in %zu KB, peak %zu KB of %zu KB", stats.entries,
+                 stats.bytes / 1024, stats.peakBytes / 1024, stats.budget / 1024);
+    if (prefetcher != nullptr && prefetchEnabled)
+    {
+        Utils::Infof("[overlay] cache: %llu opens served from prefetched files, %llu prefetched files evicted unused",
+                     (unsigned long long) stats.prefetchHits, (unsigned long long) stats.prefetchEvictions);
+    }
+}
+
+/**
+ * Writes the access profile recorded this run, called when the game exits
+ */
+void FS_SaveProfile()
+{
+    if (prefetcher == nullptr) return;
+    if (!prefetcher->save(profilePath.c_str()))
+    {
+        Utils::Errorf("[overlay] Failed to write the access profile to %s", profilePath.c_str());
+    }
 }
\ No newline at end of file
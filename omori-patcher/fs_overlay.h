@@ -5,5 +5,9 @@
 
 void FS_RegisterDetours();
 void FS_RegisterOverlay(const Mod& mod);
+void FS_FreezeOverlay();
+std::string FS_ResolvePath(const std::string& path);
+void FS_DumpStats();
+void FS_SaveProfile();
 
 #endif //OMORI_PATCHER_FS_OVERLAY_H
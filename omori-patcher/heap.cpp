@@ -0,0 +1,180 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include "pch.h"
+#include "js.h"
+#include "heap.h"
+#include "utils.h"
+#include "config.h"
+
+namespace Heap
+{
+    const char* objectTypeNames[GC_OBJ_TYPE_COUNT] = {
+            "js_object",
+            "function_bytecode",
+            "shape",
+            "var_ref",
+            "async_function",
+            "js_context"
+    };
+
+    FILE* series = nullptr;
+    std::mutex seriesMutex;
+    std::atomic<bool> pendingObjectSample = false;
+    size_t limitBytes = 0;
+    double warnRatio = 0.9;
+    bool limitWarned = false;
+    std::atomic<bool> samplerEnabled = false;
+
+    /**
+     * Reads the allocator state of the game's javascript runtime
+     * @param countObjects Whether to walk the GC object list, only safe on the javascript thread
+     * @return Heap statistics
+     */
+    HeapStats Sample(bool countObjects)
+    {
+        HeapStats stats{};
+        stats.timeMs = GetTickCount64();
+        JSRuntime* rt = js::JSRuntimeInst;
+        if (rt == nullptr) return stats;
+
+        stats.mallocCount = rt->malloc_state.malloc_count;
+        stats.mallocSize = rt->malloc_state.malloc_size;
+        stats.mallocLimit = rt->malloc_state.malloc_limit;
+
+        if (countObjects)
+        {
+            // Bounded so a list we are reading mid-update can't hang the game
+            size_t remaining = 50000000;
+            for (list_head* el = rt->gc_obj_list.next; el != &rt->gc_obj_list && remaining > 0; el = el->next, remaining--)
+            {
+                auto header = (JSGCObjectHeader*) ((BYTE*) el - offsetof(JSGCObjectHeader, link));
+                int type = header->gc_obj_type;
+                if (type >= 0 && type < GC_OBJ_TYPE_COUNT) stats.objectCounts[type]++;
+            }
+            stats.hasObjectCounts = true;
+        }
+        return stats;
+    }
+
+    /**
+     * Appends a sample to the heap time series
+     * @param label What the sample was taken for
+     * @param stats Sample to record
+     */
+    void Record(const std::string& label, const HeapStats& stats)
+    {
+        std::lock_guard<std::mutex> lock(seriesMutex);
+        if (series == nullptr) return;
+
+        fprintf(series, "%llu,%s,%zu,%zu,%zu", (unsigned long long) stats.timeMs, label.c_str(), stats.mallocCount, stats.mallocSize,
+                stats.mallocLimit);
+        for (size_t count : stats.objectCounts)
+        {
+            if (stats.hasObjectCounts) fprintf(series, ",%zu", count);
+            else fprintf(series, ",");
+        }
+        fprintf(series, "\n");
+        fflush(series);
+    }
+
+    /**
+     * Records and logs how much a mod grew the javascript heap
+     * @param modId Mod the snapshots were taken around
+     * @param before Snapshot before the mod ran
+     * @param after Snapshot after the mod ran
+     */
+    void Attribute(const std::string& modId, const HeapStats& before, const HeapStats& after)
+    {
+        Record("mod:" + modId + ":before", before);
+        Record("mod:" + modId + ":after", after);
+
+        auto bytes = (long long) after.mallocSize - (long long) before.mallocSize;
+        auto allocs = (long long) after.mallocCount - (long long) before.mallocCount;
+        if (!before.hasObjectCounts || !after.hasObjectCounts)
+        {
+            Utils::Infof("[heap] %s: %+lld bytes, %+lld allocations", modId.c_str(), bytes, allocs);
+            return;
+        }
+        auto objects = (long long) after.objectCounts[JS_GC_OBJ_TYPE_JS_OBJECT] -
+                       (long long) before.objectCounts[JS_GC_OBJ_TYPE_JS_OBJECT];
+        Utils::Infof("[heap] %s: %+lld bytes, %+lld allocations, %+lld objects", modId.c_str(), bytes, allocs, objects);
+    }
+
+    void checkLimit(const HeapStats& stats)
+    {
+        size_t limit = limitBytes;
+        if (limit == 0 && stats.mallocLimit != 0 && stats.mallocLimit != (size_t) -1) limit = stats.mallocLimit;
+        if (limit == 0) return;
+
+        auto threshold = (size_t) ((double) limit * warnRatio);
+        if (!limitWarned && stats.mallocSize >= threshold)
+        {
+            Utils::Warnf("[heap] javascript heap at %zu bytes, %.0f%% of the %zu byte limit", stats.mallocSize,
+                         (double) stats.mallocSize * 100.0 / (double) limit, limit);
+            limitWarned = true;
+        }
+        else if (limitWarned && stats.mallocSize < threshold - threshold / 10)
+        {
+            limitWarned = false;
+        }
+    }
+
+    /**
+     * Starts the background heap sampler, has to be called after the javascript runtime is known
+     */
+    void StartSampler()
+    {
+        const Json::Value& config = Config::Section("heap");
+        if (!config.get("enabled", false).asBool()) return;
+
+        limitBytes = (size_t) config.get("limitBytes", 0).asUInt64();
+        warnRatio = config.get("warnRatio", 0.9).asDouble();
+        auto intervalMs = config.get("sampleIntervalMs", 1000).asUInt();
+        auto output = config.get("output", "heap.csv").asString();
+
+        if (fopen_s(&series, output.c_str(), "w") != 0 || series == nullptr)
+        {
+            Utils::Errorf("[heap] Failed to open %s for writing", output.c_str());
+            series = nullptr;
+            return;
+        }
+        fprintf(series, "time_ms,label,malloc_count,malloc_size,malloc_limit");
+        for (const char* name : objectTypeNames) fprintf(series, ",%s", name);
+        fprintf(series, "\n");
+
+        Record("start", Sample(true));
+
+        samplerEnabled = true;
+        std::thread([intervalMs]() {
+            while (true)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+                HeapStats stats = Sample(false);
+                Record("sample", stats);
+                checkLimit(stats);
+                pendingObjectSample = true;
+            }
+        }).detach();
+        Utils::Infof("[heap] Sampling every %u ms into %s", intervalMs, output.c_str());
+    }
+
+    /**
+     * Whether heap.enabled is set and the sampler is running, callers only walk the GC object list when it is
+     */
+    bool SamplerEnabled()
+    {
+        return samplerEnabled;
+    }
+
+    /**
+     * Takes a full sample if the sampler asked for one, called from hooks that run on the javascript thread
+     */
+    void Poll()
+    {
+        if (!pendingObjectSample.load(std::memory_order_relaxed) || !pendingObjectSample.exchange(false)) return;
+        Record("objects", Sample(true));
+    }
+}
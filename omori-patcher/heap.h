@@ -0,0 +1,30 @@
+#ifndef OMORI_PATCHER_HEAP_H
+#define OMORI_PATCHER_HEAP_H
+
+#include <cstdint>
+#include <string>
+#include "quickjs.h"
+
+const int GC_OBJ_TYPE_COUNT = JS_GC_OBJ_TYPE_JS_CONTEXT + 1;
+
+struct HeapStats
+{
+    uint64_t timeMs;
+    size_t mallocCount;
+    size_t mallocSize;
+    size_t mallocLimit;
+    bool hasObjectCounts;
+    size_t objectCounts[GC_OBJ_TYPE_COUNT];
+};
+
+namespace Heap
+{
+    HeapStats Sample(bool countObjects);
+    void Record(const std::string& label, const HeapStats& stats);
+    void Attribute(const std::string& modId, const HeapStats& before, const HeapStats& after);
+    void StartSampler();
+    bool SamplerEnabled();
+    void Poll();
+}
+
+#endif //OMORI_PATCHER_HEAP_H
@@ -0,0 +1,107 @@
+#ifdef OMORI_HOOK_STATS
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "hookstats.h"
+#include "config.h"
+#include "utils.h"
+
+namespace HookStats
+{
+    std::mutex sitesMutex;
+    // Stubs hold pointers into this, a deque never moves its elements
+    std::deque<HookSite> sites;
+
+    /**
+     * Adds a hook site to the registry
+     * @param target Hooked instruction
+     * @param hookFn Function the hook calls
+     * @return Counters for the stub of the hook to update
+     */
+    HookSite* Register(uint64_t target, uint64_t hookFn)
+    {
+        std::lock_guard lock(sitesMutex);
+        HookSite& site = sites.emplace_back();
+        site.target = target;
+        site.hookFn = hookFn;
+        return &site;
+    }
+
+    /**
+     * Sets the name a hook is listed under when dumping
+     * @param target Hooked instruction
+     * @param name Name of the hook
+     */
+    void Name(uint64_t target, const char* name)
+    {
+        std::lock_guard lock(sitesMutex);
+        for (HookSite& site : sites)
+        {
+            if (site.target == target) site.name = name;
+        }
+    }
+
+    /**
+     * Prints call counts and the average cycles spent in every hook, busiest first
+     */
+    void Dump()
+    {
+        struct Totals
+        {
+            const HookSite* site;
+            uint64_t calls;
+            uint64_t cycles;
+            uint64_t samples;
+        };
+
+        std::vector<Totals> totals;
+        {
+            std::lock_guard lock(sitesMutex);
+            for (const HookSite& site : sites)
+            {
+                Totals total{&site, 0, 0, 0};
+                for (const HookCpuStats& cpu : site.cpus)
+                {
+                    total.calls += cpu.calls;
+                    total.cycles += cpu.sampledCycles;
+                    total.samples += cpu.samples;
+                }
+                totals.push_back(total);
+            }
+        }
+        std::sort(totals.begin(), totals.end(), [](const Totals& a, const Totals& b)
+        {
+            return a.calls > b.calls;
+        });
+
+        Utils::Info("[hooks]        calls  avg cycles   samples  target              hook");
+        for (const Totals& total : totals)
+        {
+            unsigned long long average = total.samples > 0 ? total.cycles / total.samples : 0;
+            const char* name = total.site->name.empty() ? "?" : total.site->name.c_str();
+            Utils::Infof("[hooks] %12llu  %10llu  %8llu  %p  %s", (unsigned long long) total.calls, average,
+                         (unsigned long long) total.samples, (void*) total.site->target, name);
+        }
+    }
+
+    /**
+     * Dumps the hook statistics periodically if hookStats.dumpIntervalMs is set in the configuration
+     */
+    void StartDumper()
+    {
+        auto intervalMs = Config::Section("hookStats").get("dumpIntervalMs", 0).asUInt();
+        if (intervalMs == 0) return;
+
+        std::thread([intervalMs]() {
+            while (true)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(intervalMs));
+                Dump();
+            }
+        }).detach();
+        Utils::Infof("[hooks] Dumping hook statistics every %u ms", intervalMs);
+    }
+}
+#endif
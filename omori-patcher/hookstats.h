@@ -0,0 +1,41 @@
+#ifndef OMORI_PATCHER_HOOKSTATS_H
+#define OMORI_PATCHER_HOOKSTATS_H
+
+#include <cstdint>
+#include <string>
+
+// Counters of one hook on one CPU, a cache line each so CPUs never share one
+struct alignas(64) HookCpuStats
+{
+    uint64_t calls;
+    uint64_t sampledCycles;
+    uint64_t samples;
+};
+
+const int HOOK_STATS_CPUS = 64;
+// Every call whose per-CPU call count is a multiple of this is timed
+const int HOOK_STATS_SAMPLE_INTERVAL = 64;
+
+struct HookSite
+{
+    HookCpuStats cpus[HOOK_STATS_CPUS];
+    uint64_t target;
+    uint64_t hookFn;
+    std::string name;
+};
+
+namespace HookStats
+{
+#ifdef OMORI_HOOK_STATS
+    HookSite* Register(uint64_t target, uint64_t hookFn);
+    void Name(uint64_t target, const char* name);
+    void Dump();
+    void StartDumper();
+#else
+    inline void Name(uint64_t, const char*) {}
+    inline void Dump() {}
+    inline void StartDumper() {}
+#endif
+}
+
+#endif //OMORI_PATCHER_HOOKSTATS_H
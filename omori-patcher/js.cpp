@@ -2,6 +2,7 @@
 #include <cstring>
 #include "js.h"
 #include "consts.h"
+#include <json/json.h>
 
 using std::string;
 
@@ -47,20 +48,39 @@ namespace js
     }
 
     /**
-     * Eval wrapper for executing mods
+     * Wraps a mod script so it runs isolated in its own scope with its own require
      * @param code
      * @param filename
+     * @param moduleDir Game relative directory require() resolves relative paths from
+     * @return Source to evaluate
      */
-    void JS_EvalMod(const char *code, const char *filename = "<omori-patcher>") {
-        char *filenameJS = (char *) malloc(
-                strlen(filename) + 1); // this part of the code is going to come back to haunt me one day
-        memcpy(filenameJS, filename, strlen(filename) + 1);
-        for (size_t i = 0; i < strlen(filenameJS); i++) {
-            if (filenameJS[i] == '\\') filenameJS[i] = '/';
-            if (filenameJS[i] == '\'') filenameJS[i] = '"';
+    string WrapMod(const char *code, const char *filename, const char* moduleDir) {
+        const char* prefix = "try { (()=>{ const require = mp_makeRequire(";
+        const char* middle = "\n })(); } catch(ex){ print('Failed to run script: ";
+        const char* suffix = "'); console.error(ex); }";
+        string dir = Json::valueToQuotedString(moduleDir);
+        size_t codeLen = strlen(code);
+        size_t filenameLen = strlen(filename);
+
+        // Built in place, the script is by far the largest part and is copied exactly once
+        string res;
+        res.reserve(strlen(prefix) + dir.size() + 2 + codeLen + strlen(middle) + filenameLen + strlen(suffix));
+        res.append(prefix).append(dir).append(");\n").append(code, codeLen).append(middle);
+        for (size_t i = 0; i < filenameLen; i++) {
+            char c = filename[i];
+            res.push_back(c == '\\' ? '/' : c == '\'' ? '"' : c);
         }
-        JS_Eval((string("try { (()=>{ \n") + code + "\n })(); } catch(ex){ print('Failed to run script: " + filenameJS +
-                 "'); console.error(ex); }").c_str(), filename);
-        free(filenameJS);
+        res.append(suffix);
+        return res;
+    }
+
+    /**
+     * Eval wrapper for executing mods
+     * @param code
+     * @param filename
+     * @param moduleDir Game relative directory require() resolves relative paths from
+     */
+    void JS_EvalMod(const char *code, const char *filename, const char* moduleDir) {
+        JS_Eval(WrapMod(code, filename, moduleDir).c_str(), filename);
     }
 }
\ No newline at end of file
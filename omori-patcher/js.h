@@ -48,7 +48,8 @@ namespace js
     JSValue JS_GetGlobalVar(JSContext* ctx, JSAtom prop, bool throw_ref_error);
     JSAtom JS_NewAtom(JSContext* ctx, const char* str, size_t len);
     void JS_Eval(const char* code, const char *filename);
-    void JS_EvalMod(const char* code, const char *filename);
+    std::string WrapMod(const char* code, const char* filename, const char* moduleDir);
+    void JS_EvalMod(const char* code, const char *filename, const char* moduleDir);
 }
 
 #endif //OMORI_PATCHER_JS_H
@@ -0,0 +1,25 @@
+#include <cstring>
+#include <memory>
+#include "jsonreader.h"
+
+namespace JsonReader
+{
+    /**
+     * Parses JSON straight from a buffer without copying it, each thread keeps its own reader
+     * @param begin Start of the JSON text
+     * @param end End of the JSON text
+     * @param out Parsed value
+     * @param error Reason the text isn't valid JSON
+     * @return Whether the text could be parsed
+     */
+    bool Parse(const char* begin, const char* end, Json::Value& out, std::string& error)
+    {
+        thread_local std::unique_ptr<Json::CharReader> reader = []() {
+            Json::CharReaderBuilder builder;
+            builder["collectComments"] = false;
+            return std::unique_ptr<Json::CharReader>(builder.newCharReader());
+        }();
+        if (end - begin >= 3 && memcmp(begin, "\xEF\xBB\xBF", 3) == 0) begin += 3;
+        return reader->parse(begin, end, &out, &error);
+    }
+}
@@ -0,0 +1,12 @@
+#ifndef OMORI_PATCHER_JSONREADER_H
+#define OMORI_PATCHER_JSONREADER_H
+
+#include <string>
+#include <json/json.h>
+
+namespace JsonReader
+{
+    bool Parse(const char* begin, const char* end, Json::Value& out, std::string& error);
+}
+
+#endif //OMORI_PATCHER_JSONREADER_H
@@ -0,0 +1,339 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "pch.h"
+#include "log.h"
+#include "config.h"
+#include "consts.h"
+#include "binlog.h"
+
+namespace Log
+{
+    struct RecordHeader
+    {
+        uint64_t seq;
+        uint32_t len;
+        uint32_t level;
+    };
+
+    /**
+     * Single producer single consumer byte ring, the owning thread writes records and the drain thread reads them
+     */
+    struct Ring
+    {
+        std::vector<char> buffer;
+        size_t mask;
+        // Monotonic positions, head is only written by the producer and tail only by the consumer
+        alignas(64) std::atomic<size_t> head = 0;
+        alignas(64) std::atomic<size_t> tail = 0;
+        std::atomic<size_t> dropped = 0;
+        // Set when the owning thread exits, the drain frees the ring once it's empty
+        std::atomic<bool> retired = false;
+
+        explicit Ring(size_t size) : buffer(size), mask(size - 1) {}
+
+        void copyIn(size_t pos, const void* data, size_t len)
+        {
+            size_t offset = pos & mask;
+            size_t first = std::min(len, buffer.size() - offset);
+            memcpy(buffer.data() + offset, data, first);
+            memcpy(buffer.data(), (const char*) data + first, len - first);
+        }
+
+        void copyOut(size_t pos, void* data, size_t len) const
+        {
+            size_t offset = pos & mask;
+            size_t first = std::min(len, buffer.size() - offset);
+            memcpy(data, buffer.data() + offset, first);
+            memcpy((char*) data + first, buffer.data(), len - first);
+        }
+    };
+
+    struct Pending
+    {
+        uint64_t seq;
+        LogLevel level;
+        std::string text;
+    };
+
+    // Level of records holding binary log events, they go to the binary log instead of the console
+    const uint32_t LEVEL_BINARY = 0xFF;
+    // Ends messages cut to fit half a ring
+    const char* TRUNCATED = "... [truncated]";
+
+    enum Policy
+    {
+        POLICY_DROP,
+        POLICY_BLOCK
+    };
+
+    std::atomic<bool> draining = false;
+    std::atomic<uint64_t> nextSeq = 0;
+    Policy policy = POLICY_DROP;
+    size_t ringBytes = 64 * 1024;
+    unsigned flushIntervalMs = 10;
+    bool verbose = false;
+    HANDLE wakeEvent = nullptr;
+    FILE* logFile = nullptr;
+
+    std::mutex ringsMutex;
+    std::vector<std::unique_ptr<Ring>> rings;
+    // Serializes draining between the drain thread and Flush
+    std::mutex drainMutex;
+
+    const char* prefixes[] = {"", "[INFO] ", "[SUCCESS] ", "[WARN] ", "[ERROR] ", "[DEBUG] "};
+    const int colors[] = {Consts::RESET, Consts::INFO, Consts::SUCCESS, Consts::WARN, Consts::ERR, Consts::RESET};
+
+    void writeConsole(LogLevel level, const char* text, size_t len, bool newline)
+    {
+        HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
+        DWORD written;
+        if (level != LOG_PLAIN)
+        {
+            SetConsoleTextAttribute(console, colors[level]);
+            WriteFile(console, prefixes[level], (DWORD) strlen(prefixes[level]), &written, nullptr);
+            SetConsoleTextAttribute(console, Consts::RESET);
+        }
+        WriteFile(console, text, (DWORD) len, &written, nullptr);
+        if (newline) WriteFile(console, "\n", 1, &written, nullptr);
+    }
+
+    /**
+     * Hands a thread's ring to the drain for freeing when the thread exits, so short-lived threads don't leave one
+     * behind each
+     */
+    struct RingOwner
+    {
+        Ring* ring = nullptr;
+
+        ~RingOwner()
+        {
+            if (ring != nullptr) ring->retired.store(true, std::memory_order_release);
+        }
+    };
+
+    Ring& threadRing()
+    {
+        thread_local RingOwner owner;
+        if (owner.ring == nullptr)
+        {
+            std::lock_guard lock(ringsMutex);
+            rings.push_back(std::make_unique<Ring>(ringBytes));
+            owner.ring = rings.back().get();
+        }
+        return *owner.ring;
+    }
+
+    /**
+     * Moves every record out of the rings and writes them in the order they were logged
+     */
+    void drain(bool wait)
+    {
+        std::unique_lock drainLock(drainMutex, std::defer_lock);
+        std::unique_lock lock(ringsMutex, std::defer_lock);
+        if (wait)
+        {
+            drainLock.lock();
+            lock.lock();
+        }
+        else if (!drainLock.try_lock() || !lock.try_lock())
+        {
+            return;
+        }
+
+        std::vector<Pending> pending;
+        size_t dropped = 0;
+        for (const auto& ring : rings)
+        {
+            size_t tail = ring->tail.load(std::memory_order_relaxed);
+            size_t head = ring->head.load(std::memory_order_acquire);
+            while (tail != head)
+            {
+                RecordHeader header;
+                ring->copyOut(tail, &header, sizeof(header));
+                Pending record{header.seq, (LogLevel) header.level, std::string(header.len, '\0')};
+                ring->copyOut(tail + sizeof(header), record.text.data(), header.len);
+                pending.push_back(std::move(record));
+                tail += sizeof(header) + header.len;
+            }
+            ring->tail.store(tail, std::memory_order_release);
+            dropped += ring->dropped.exchange(0);
+        }
+        // Retired rings get no more records, once drained they can go
+        std::erase_if(rings, [](const std::unique_ptr<Ring>& ring) {
+            return ring->retired.load(std::memory_order_acquire) &&
+                   ring->tail.load(std::memory_order_relaxed) == ring->head.load(std::memory_order_acquire);
+        });
+        lock.unlock();
+        if (pending.empty() && dropped == 0) return;
+
+        std::sort(pending.begin(), pending.end(), [](const Pending& a, const Pending& b)
+        {
+            return a.seq < b.seq;
+        });
+
+        // Consecutive plain lines go out in one write, only level prefixes need a color change in between
+        std::string batch;
+        std::string fileBatch;
+        std::string binaryBatch;
+        for (const Pending& record : pending)
+        {
+            if (record.level == (LogLevel) LEVEL_BINARY)
+            {
+                binaryBatch += record.text;
+                continue;
+            }
+            if (record.level != LOG_PLAIN && !batch.empty())
+            {
+                writeConsole(LOG_PLAIN, batch.data(), batch.size(), false);
+                batch.clear();
+            }
+            if (record.level != LOG_PLAIN)
+            {
+                writeConsole(record.level, record.text.data(), record.text.size(), true);
+            }
+            else
+            {
+                batch += record.text;
+                batch += '\n';
+            }
+            if (logFile != nullptr)
+            {
+                fileBatch += prefixes[record.level];
+                fileBatch += record.text;
+                fileBatch += '\n';
+            }
+        }
+        if (!batch.empty()) writeConsole(LOG_PLAIN, batch.data(), batch.size(), false);
+        if (dropped > 0)
+        {
+            std::string msg = std::to_string(dropped) + " log messages dropped, the log buffer was full";
+            writeConsole(LOG_WARN, msg.data(), msg.size(), true);
+            fileBatch += prefixes[LOG_WARN] + msg + '\n';
+        }
+        if (logFile != nullptr)
+        {
+            fwrite(fileBatch.data(), 1, fileBatch.size(), logFile);
+            fflush(logFile);
+        }
+        BinLog::WriteRecords(binaryBatch);
+    }
+
+    /**
+     * Starts the drain thread, log calls write to the console directly until it runs. Configured by the "log"
+     * section: policy (drop or block when a thread's buffer is full), ringBytes, flushIntervalMs and file
+     */
+    void Start()
+    {
+        const Json::Value& config = Config::Section("log");
+        policy = config.get("policy", "drop").asString() == "block" ? POLICY_BLOCK : POLICY_DROP;
+        flushIntervalMs = config.get("flushIntervalMs", 10).asUInt();
+        verbose = config.get("verbose", false).asBool();
+        size_t requested = std::max<size_t>(config.get("ringBytes", 64 * 1024).asUInt64(), 4096);
+        ringBytes = 4096;
+        while (ringBytes < requested) ringBytes <<= 1;
+
+        auto file = config.get("file", "").asString();
+        if (!file.empty() && (fopen_s(&logFile, file.c_str(), "w") != 0 || logFile == nullptr))
+        {
+            logFile = nullptr;
+            std::string msg = "Failed to open " + file + " for writing";
+            writeConsole(LOG_ERROR, msg.data(), msg.size(), true);
+        }
+
+        auto binary = config.get("binary", "").asString();
+        if (!binary.empty()) BinLog::Start(binary);
+
+        wakeEvent = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+        std::thread([]() {
+            draining = true;
+            while (true)
+            {
+                WaitForSingleObject(wakeEvent, flushIntervalMs);
+                drain(true);
+            }
+        }).detach();
+    }
+
+    void push(uint32_t level, const char* data, size_t len)
+    {
+        Ring& ring = threadRing();
+        size_t maxLen = ring.buffer.size() / 2 - sizeof(RecordHeader);
+        bool truncated = len > maxLen;
+        if (truncated && level == LEVEL_BINARY)
+        {
+            // A cut binary record would misparse, drop it instead
+            ring.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        size_t keep = truncated ? maxLen - strlen(TRUNCATED) : len;
+        len = truncated ? maxLen : len;
+        size_t needed = sizeof(RecordHeader) + len;
+        size_t head = ring.head.load(std::memory_order_relaxed);
+        while (head + needed - ring.tail.load(std::memory_order_acquire) > ring.buffer.size())
+        {
+            if (policy == POLICY_DROP)
+            {
+                ring.dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            SetEvent(wakeEvent);
+            std::this_thread::yield();
+        }
+
+        RecordHeader header{nextSeq.fetch_add(1, std::memory_order_relaxed), (uint32_t) len, level};
+        ring.copyIn(head, &header, sizeof(header));
+        ring.copyIn(head + sizeof(header), data, keep);
+        if (truncated) ring.copyIn(head + sizeof(header) + keep, TRUNCATED, len - keep);
+        ring.head.store(head + needed, std::memory_order_release);
+    }
+
+    /**
+     * Logs a message, it's copied into the calling thread's buffer and written by the drain thread
+     * @param level Level the message is printed with
+     * @param text Message without the line break
+     * @param len Length of text
+     */
+    void Write(LogLevel level, const char* text, size_t len)
+    {
+        if (!draining.load(std::memory_order_acquire))
+        {
+            writeConsole(level, text, len, true);
+            return;
+        }
+        push((uint32_t) level, text, len);
+    }
+
+    /**
+     * Queues an encoded binary log record, records logged before the drain thread runs are written directly
+     */
+    void WriteBinary(const char* data, size_t len)
+    {
+        if (!draining.load(std::memory_order_acquire))
+        {
+            BinLog::WriteRecords(std::string(data, len));
+            return;
+        }
+        push(LEVEL_BINARY, data, len);
+    }
+
+    bool Verbose()
+    {
+        return verbose;
+    }
+
+    /**
+     * Writes everything logged so far before returning, gives up if another thread is draining, so it's safe to call
+     * while the process is being torn down
+     */
+    void Flush()
+    {
+        if (draining) drain(false);
+    }
+}
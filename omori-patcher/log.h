@@ -0,0 +1,25 @@
+#ifndef OMORI_PATCHER_LOG_H
+#define OMORI_PATCHER_LOG_H
+
+#include <cstddef>
+
+enum LogLevel
+{
+    LOG_PLAIN,
+    LOG_INFO,
+    LOG_SUCCESS,
+    LOG_WARN,
+    LOG_ERROR,
+    LOG_DEBUG
+};
+
+namespace Log
+{
+    void Start();
+    void Write(LogLevel level, const char* text, size_t len);
+    void WriteBinary(const char* data, size_t len);
+    bool Verbose();
+    void Flush();
+}
+
+#endif //OMORI_PATCHER_LOG_H
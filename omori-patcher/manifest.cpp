@@ -0,0 +1,77 @@
+#include <algorithm>
+#include <cctype>
+#include "manifest.h"
+
+namespace Manifest
+{
+    /**
+     * Checks a mod.json against the fields the loader uses before anything reads them
+     * @param root Parsed mod.json
+     * @param error Why the manifest was rejected
+     * @return Whether the manifest is usable
+     */
+    bool Validate(const Json::Value& root, std::string& error)
+    {
+        if (!root.isObject())
+        {
+            error = "top level value isn't an object";
+            return false;
+        }
+        if (!root["id"].isString() || root["id"].asString().empty())
+        {
+            error = "\"id\" has to be a non-empty string";
+            return false;
+        }
+        for (const char* key : {"name", "description", "version", "main"})
+        {
+            if (root.isMember(key) && !root[key].isString())
+            {
+                error = std::string("\"") + key + "\" has to be a string";
+                return false;
+            }
+        }
+
+        auto isStringArray = [](const Json::Value& value) {
+            if (!value.isArray()) return false;
+            for (const Json::Value& item : value)
+            {
+                if (!item.isString()) return false;
+            }
+            return true;
+        };
+        if (root.isMember("files"))
+        {
+            const Json::Value& files = root["files"];
+            if (!files.isObject())
+            {
+                error = "\"files\" has to be an object";
+                return false;
+            }
+            for (const std::string& key : files.getMemberNames())
+            {
+                if (!isStringArray(files[key]))
+                {
+                    error = "\"files." + key + "\" has to be an array of strings";
+                    return false;
+                }
+            }
+        }
+        if (root.isMember("patches") && !isStringArray(root["patches"]))
+        {
+            error = "\"patches\" has to be an array of strings";
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * Orders mod directories the way FindFirstFileA returns them on NTFS, names compared uppercased. Load order
+     * decides which mod wins, and _stricmp would lowercase instead, putting "_" before letters
+     */
+    bool DirLess(const std::string& a, const std::string& b)
+    {
+        return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(), [](char x, char y) {
+            return toupper((unsigned char) x) < toupper((unsigned char) y);
+        });
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef OMORI_PATCHER_MANIFEST_H
+#define OMORI_PATCHER_MANIFEST_H
+
+#include <string>
+#include <json/json.h>
+
+namespace Manifest
+{
+    bool Validate(const Json::Value& root, std::string& error);
+    bool DirLess(const std::string& a, const std::string& b);
+}
+
+#endif //OMORI_PATCHER_MANIFEST_H
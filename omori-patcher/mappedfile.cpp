@@ -0,0 +1,180 @@
+#include <algorithm>
+#include <utility>
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#include "pch.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const char* path)
+{
+    open(path);
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+    if (this != &other)
+    {
+        close();
+        view = std::exchange(other.view, nullptr);
+        length = std::exchange(other.length, 0);
+        mappedLength = std::exchange(other.mappedLength, 0);
+        buffered = std::exchange(other.buffered, false);
+    }
+    return *this;
+}
+
+#ifdef _WIN32
+
+/**
+ * Maps a file, CreateFileA has no 128 character limit unlike OpenFile
+ * @param path File to map
+ * @return Whether the file could be opened, the view stays empty otherwise
+ */
+bool MappedFile::open(const char* path)
+{
+    close();
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize))
+    {
+        CloseHandle(file);
+        return false;
+    }
+    length = (size_t) fileSize.QuadPart;
+
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    if (length == 0)
+    {
+        view = "";
+    }
+    else if (length % info.dwPageSize != 0)
+    {
+        // The rest of the last page reads as zeroes
+        HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping != nullptr)
+        {
+            view = (const char*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+            mappedLength = view != nullptr ? length : 0;
+        }
+    }
+    else
+    {
+        auto buffer = (char*) VirtualAlloc(nullptr, length + 1, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        size_t done = 0;
+        while (buffer != nullptr && done < length)
+        {
+            DWORD read = 0;
+            DWORD chunk = (DWORD) std::min<size_t>(length - done, 1 << 30);
+            if (!ReadFile(file, buffer + done, chunk, &read, nullptr) || read == 0)
+            {
+                VirtualFree(buffer, 0, MEM_RELEASE);
+                buffer = nullptr;
+                break;
+            }
+            done += read;
+        }
+        view = buffer;
+        buffered = buffer != nullptr;
+    }
+    CloseHandle(file);
+    if (view == nullptr) length = 0;
+    return view != nullptr;
+}
+
+void MappedFile::close()
+{
+    if (mappedLength != 0) UnmapViewOfFile(view);
+    else if (buffered) VirtualFree((void*) view, 0, MEM_RELEASE);
+    view = nullptr;
+    length = 0;
+    mappedLength = 0;
+    buffered = false;
+}
+
+#else
+
+/**
+ * Maps a file. When the file ends on a page boundary the mapping is placed at the start of an anonymous one a page
+ * longer, so the NUL sentinel comes from the zeroed page after it rather than a copy
+ * @param path File to map
+ * @return Whether the file could be opened, the view stays empty otherwise
+ */
+bool MappedFile::open(const char* path)
+{
+    close();
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st{};
+    if (fstat(fd, &st) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    length = (size_t) st.st_size;
+
+    auto pageSize = (size_t) sysconf(_SC_PAGESIZE);
+    if (length == 0)
+    {
+        view = "";
+    }
+    else if (length % pageSize != 0)
+    {
+        void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED)
+        {
+            view = (const char*) mapped;
+            mappedLength = length;
+        }
+    }
+    else
+    {
+        void* reserved = mmap(nullptr, length + pageSize, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (reserved != MAP_FAILED)
+        {
+            if (mmap(reserved, length, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) != MAP_FAILED)
+            {
+                view = (const char*) reserved;
+                mappedLength = length + pageSize;
+            }
+            else
+            {
+                munmap(reserved, length + pageSize);
+            }
+        }
+    }
+    ::close(fd);
+    if (view == nullptr) length = 0;
+    else if (mappedLength != 0) madvise((void*) view, length, MADV_SEQUENTIAL);
+    return view != nullptr;
+}
+
+void MappedFile::close()
+{
+    if (mappedLength != 0) munmap((void*) view, mappedLength);
+    view = nullptr;
+    length = 0;
+    mappedLength = 0;
+    buffered = false;
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef OMORI_PATCHER_MAPPEDFILE_H
+#define OMORI_PATCHER_MAPPEDFILE_H
+
+#include <cstddef>
+
+/**
+ * Read-only view of a whole file. The view is always followed by a NUL byte, so text files can be used as C strings
+ * without a copy. Files whose size is a multiple of the page size have no room for it in their last page and are
+ * read into a buffer instead
+ */
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    explicit MappedFile(const char* path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    bool open(const char* path);
+    void close();
+
+    bool isOpen() const
+    {
+        return view != nullptr;
+    }
+
+    const char* data() const
+    {
+        return view;
+    }
+
+    const char* end() const
+    {
+        return view + length;
+    }
+
+    size_t size() const
+    {
+        return length;
+    }
+
+private:
+    const char* view = nullptr;
+    size_t length = 0;
+    // Bytes to unmap, 0 when the view is the empty string or a buffer
+    size_t mappedLength = 0;
+    bool buffered = false;
+};
+
+#endif //OMORI_PATCHER_MAPPEDFILE_H
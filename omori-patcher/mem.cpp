@@ -1,285 +1,433 @@
 #include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <tlhelp32.h>
 #include "mem.h"
+#include "decode.h"
+#include "reloc.h"
+#include "execmem.h"
+#include "hookstats.h"
+#include "trace.h"
+#include "binlog.h"
 #include "utils.h"
 #include "zasm/program/program.hpp"
 #include "zasm/x86/assembler.hpp"
 #include "zasm/serialization/serializer.hpp"
 #include "zasm/x86/x86.hpp"
-#include <Zydis/Zydis.h>
 
 namespace Mem
 {
     using namespace zasm::x86;
 
-    Xmm* xmms = new Xmm[] { xmm0, xmm1, xmm2, xmm3, xmm4, xmm5, xmm6, xmm7, xmm8, xmm9, xmm10, xmm11, xmm12, xmm13, xmm14, xmm15 };
-    Gp64* registers = new Gp64[] { rax, rbx, rcx, rdx, rbp, rsi, rdi, r8, r9, r10, r11, r12, r13, r14, r15, rsp };
-
     /**
-     * Decodes given assembly instruction and returns its length
-     * @param code Pointer to the instruction
-     * @return instruction length
+     * Reserves the executable memory pool next to the game module on first use
+     * @return false if no memory could be reserved
      */
-    size_t codeLength(BYTE* code)
+    bool initPool()
     {
-        ZyanU8* data = code;
-        size_t codeLength = 0;
-
-        auto runtime_address = reinterpret_cast<ZyanU64>(code);
-        ZyanUSize offset = 0;
-        ZydisDisassembledInstruction instruction;
-
-        while (ZYAN_SUCCESS(ZydisDisassembleIntel(
-                ZYDIS_MACHINE_MODE_LONG_64,
-                runtime_address,
-                data + offset,
-                sizeof(data) - offset,
-                &instruction
-        ))) {
-            codeLength += instruction.info.length;
-            offset += instruction.info.length;
-        }
+        static bool initialized = false;
+        if (initialized) return true;
+        initialized = ExecMem::Init(Consts::OMORI_BASE);
+        if (!initialized) Utils::Error("Failed to reserve executable memory near the game module");
+        return initialized;
+    }
 
-        return codeLength;
+    bool inRel32Reach(DWORD_PTR from, DWORD_PTR to)
+    {
+        auto rel = (int64_t) to - (int64_t) from;
+        return rel == (int32_t) rel;
     }
 
+    struct PendingPatch
+    {
+        DWORD_PTR addr;
+        std::vector<BYTE> bytes;
+        // Set for hooks, lets suspended threads inside the patched range continue in the trampoline
+        DWORD_PTR relocatedCode;
+        std::vector<std::pair<size_t, size_t>> offsets;
+        void* trampoline;
+        size_t trampolineSize;
+    };
+
+    // Held from TransactionBegin to the matching Commit or Abort, guards pendingPatches and transactionDepth. Commit
+    // releases the ExecMem write batch before writing the patches, so that lock doesn't cover them
+    std::recursive_mutex transactionMutex;
+    std::vector<PendingPatch> pendingPatches;
+    int transactionDepth = 0;
+
     /**
-     * Allocates space in the codecave, changes memory permissions to RWX
-     * @param size Size for allocation
-     * @return Pointer to codecave
+     * Starts collecting code patches, nothing is written until TransactionCommit
      */
-    void* codecaveAlloc(size_t size)
+    void TransactionBegin()
     {
-        DWORD _;
-        void* old = (void*) mallocI;
-        VirtualProtect(old, size, PAGE_EXECUTE_READWRITE, &_);
-        mallocI += size;
-        if (mallocI > Consts::codecaveEnd)
-        {
-            Utils::Error("codecaveAlloc: No more free space in codecave");
-            return nullptr;
-        }
-        return old;
+        transactionMutex.lock();
+        if (transactionDepth++ == 0) pendingPatches.clear();
+        ExecMem::BeginWrite();
     }
 
     /**
-     * Calculates length of multiple instructions
-     * @param insn Pointer to the first instruction
-     * @param alignTo Minimum amount of bytes that need to be decoded
-     * @return Padded length
+     * Drops every patch collected since TransactionBegin
      */
-    size_t getPaddedLength(DWORD_PTR insn, size_t alignTo)
+    void TransactionAbort()
     {
-        size_t i = 0;
-
-        for (BYTE* reader; i < alignTo; i += codeLength(reader))
+        std::lock_guard<std::recursive_mutex> lock(transactionMutex, std::adopt_lock);
+        if (--transactionDepth == 0)
         {
-            reader = (BYTE*)(insn + i);
+            for (const auto& patch : pendingPatches)
+            {
+                if (patch.trampoline != nullptr) ExecMem::Free(patch.trampoline, patch.trampolineSize);
+            }
+            pendingPatches.clear();
         }
-        return i;
+        ExecMem::EndWrite();
     }
 
     /**
-     * Writes a call instruction at a specified address
-     * @param targetInsn Place to write the call
-     * @param offset Offset from targetInsn
-     * @param targetFn Function to call
-     * @param backupLen Recommended backup length
-     * @return backup copy of instructions, length of call, padding
+     * Suspends every other thread of the process. Nothing may allocate until they're resumed, a suspended thread
+     * could be holding the heap lock
+     * @return Handles of the suspended threads
      */
-    HookResult createCall(DWORD_PTR targetInsn, int offset, DWORD_PTR targetFn, size_t backupLen)
+    std::vector<HANDLE> suspendOtherThreads()
     {
-        zasm::Program program(zasm::MachineMode::AMD64);
-        zasm::x86::Assembler a(program);
-
-        a.push(rax);
-        a.call(zasm::Imm64(targetFn));
-
-        zasm::Serializer serializer{};
-        auto res = serializer.serialize(program, (int64_t) targetInsn+offset);
-        if (res != zasm::Error::None)
+        std::vector<HANDLE> threads;
+        HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+        if (snapshot == INVALID_HANDLE_VALUE) return threads;
+
+        THREADENTRY32 entry;
+        entry.dwSize = sizeof(entry);
+        // The snapshot doesn't change, so counting first means push_back never reallocates below
+        size_t count = 0;
+        for (BOOL ok = Thread32First(snapshot, &entry); ok; ok = Thread32Next(snapshot, &entry))
         {
-            Utils::Errorf("createCall: Failed to serialize program %s", getErrorName(res));
-            return {nullptr, nullptr, 0, 0};
+            if (entry.th32OwnerProcessID == GetCurrentProcessId()) count++;
         }
+        threads.reserve(count);
 
-        size_t size = serializer.getCodeSize();
-        size_t padding = getPaddedLength(targetInsn+offset, size) - size;
-        if (backupLen < size + padding) backupLen = size + padding;
-        void* backup = malloc(backupLen);
-        memcpy(backup, (void*) (targetInsn+offset), backupLen);
-        DWORD _;
-        VirtualProtect((LPVOID) (targetInsn+offset), backupLen, PAGE_EXECUTE_READWRITE, &_);
-        memset((void*) (targetInsn+offset), 0xCC, size+padding); // add int3 padding
-
-        memcpy((void*) (targetInsn+offset), serializer.getCode(), size);
-        Utils::Infof("%p+%d (%d %d)", targetInsn, offset, size, padding);
+        for (BOOL ok = Thread32First(snapshot, &entry); ok; ok = Thread32Next(snapshot, &entry))
+        {
+            if (entry.th32OwnerProcessID != GetCurrentProcessId() || entry.th32ThreadID == GetCurrentThreadId()) continue;
+            HANDLE thread = OpenThread(THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT | THREAD_SET_CONTEXT, FALSE,
+                                       entry.th32ThreadID);
+            if (thread == nullptr) continue;
+            if (SuspendThread(thread) == (DWORD) -1)
+            {
+                CloseHandle(thread);
+                continue;
+            }
+            threads.push_back(thread);
+        }
+        CloseHandle(snapshot);
+        return threads;
+    }
 
-        return HookResult
+    /**
+     * Moves a suspended thread that stopped inside code about to be patched to the same instruction in the trampoline
+     */
+    void fixupThread(HANDLE thread)
+    {
+        CONTEXT ctx;
+        ctx.ContextFlags = CONTEXT_CONTROL;
+        if (!GetThreadContext(thread, &ctx)) return;
+        for (const auto& patch : pendingPatches)
         {
-                nullptr,
-                backup,
-                size,
-                padding
-        };
+            if (ctx.Rip < patch.addr || ctx.Rip >= patch.addr + patch.bytes.size() || patch.relocatedCode == 0) continue;
+            for (const auto& [original, relocated] : patch.offsets)
+            {
+                if (ctx.Rip != patch.addr + original) continue;
+                ctx.Rip = patch.relocatedCode + relocated;
+                SetThreadContext(thread, &ctx);
+                return;
+            }
+        }
     }
 
     /**
-     * Adds a hook to a function, removes it self after the first call to the function
-     * @param targetInsn Target to hook
-     * @param funcOffset Offset from targetInsn
-     * @param hookFn Function to call
-     * @param jmpToOffset Offset to jump back
-     * @param backupLen Recommended backup length
-     * @param asmCallback Callback asm modifier
-     * @return
+     * Writes every patch collected since TransactionBegin at once: other threads are suspended and moved out of
+     * patched code, each page range is made writable once, and the instruction cache is flushed once.
+     * If any range can't be made writable nothing is written
+     * @return false if the transaction was rolled back
      */
-    HookResult HookOnce(DWORD_PTR targetInsn, int funcOffset, DWORD_PTR hookFn, bool jmpToOffset, size_t backupLen,
-                        void* cbAsmPtr)
+    bool TransactionCommit()
     {
-        auto hookRes = createCall(targetInsn, funcOffset, (DWORD_PTR) mallocI, backupLen);
-        if (backupLen < hookRes.size + hookRes.padding) backupLen = hookRes.size + hookRes.padding;
+        std::lock_guard<std::recursive_mutex> lock(transactionMutex, std::adopt_lock);
+        TRACE_SCOPE("Mem::TransactionCommit");
+        if (--transactionDepth > 0)
+        {
+            ExecMem::EndWrite();
+            return true;
+        }
+        // Trampolines have to be executable before any thread can enter them
+        ExecMem::EndWrite();
+        if (pendingPatches.empty()) return true;
 
-        Utils::Infof("backup: %p", hookRes.backupPtr);
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        DWORD_PTR pageSize = info.dwPageSize;
+
+        // Page ranges covering every patch, merged when they touch
+        std::vector<std::pair<DWORD_PTR, DWORD_PTR>> ranges;
+        for (const auto& patch : pendingPatches)
+        {
+            DWORD_PTR start = patch.addr / pageSize * pageSize;
+            DWORD_PTR end = (patch.addr + patch.bytes.size() + pageSize - 1) / pageSize * pageSize;
+            ranges.emplace_back(start, end);
+        }
+        std::sort(ranges.begin(), ranges.end());
+        std::vector<std::pair<DWORD_PTR, DWORD_PTR>> merged;
+        for (const auto& range : ranges)
+        {
+            if (!merged.empty() && range.first <= merged.back().second) merged.back().second = std::max(merged.back().second, range.second);
+            else merged.push_back(range);
+        }
 
-        zasm::Program program(zasm::MachineMode::AMD64);
-        zasm::x86::Assembler a(program);
+        // Nothing below allocates or logs until the threads are resumed
+        std::vector<DWORD> oldProtects;
+        oldProtects.reserve(merged.size());
+        auto threads = suspendOtherThreads();
+        for (HANDLE thread : threads) fixupThread(thread);
 
-        for (int i = 0; i < 16; ++i) {
-            a.sub(rsp, 16);
-            a.movdqu(xmmword_ptr(rsp), xmms[i]);
+        bool ok = true;
+        std::pair<DWORD_PTR, DWORD_PTR> failed;
+        for (const auto& [start, end] : merged)
+        {
+            DWORD oldProtect;
+            if (!VirtualProtect((LPVOID) start, end - start, PAGE_EXECUTE_READWRITE, &oldProtect))
+            {
+                failed = {start, end};
+                ok = false;
+                break;
+            }
+            oldProtects.push_back(oldProtect);
         }
 
-        // Backup cpu registers
-        for (int i = 0; i < 16; ++i) {
-            a.push(registers[i]);
+        if (ok)
+        {
+            for (const auto& patch : pendingPatches)
+            {
+                memcpy((void*) patch.addr, patch.bytes.data(), patch.bytes.size());
+            }
         }
 
-        a.sub(rsp, 32);
+        for (size_t i = 0; i < oldProtects.size(); i++)
+        {
+            DWORD _;
+            VirtualProtect((LPVOID) merged[i].first, merged[i].second - merged[i].first, oldProtects[i], &_);
+        }
 
-        if (cbAsmPtr != nullptr) {
-            a.push(r15);
-            a.mov(r15, zasm::Imm64((DWORD_PTR)cbAsmPtr));
-            a.call(r15);
-            a.pop(r15);
+        if (ok)
+        {
+            FlushInstructionCache(GetCurrentProcess(), (LPCVOID) merged.front().first,
+                                  merged.back().second - merged.front().first);
         }
 
-        a.mov(r15, zasm::Imm64(hookFn));
-        a.call(r15);
+        for (HANDLE thread : threads)
+        {
+            ResumeThread(thread);
+            CloseHandle(thread);
+        }
 
-        a.mov(rcx, zasm::Imm64(targetInsn+funcOffset));
-        a.mov(rdx, zasm::Imm64((DWORD_PTR) hookRes.backupPtr));
-        a.mov(r8, zasm::Imm64(backupLen));
-        a.mov(rax, zasm::Imm64((DWORD_PTR) memcpy));
-        a.call(rax);
+        if (ok)
+        {
+            for (const auto& patch : pendingPatches) Decode::Invalidate(patch.addr, patch.bytes.size());
+            Utils::Successf("Committed %zu %s in %zu page %s, %zu %s suspended", pendingPatches.size(),
+                            pendingPatches.size() == 1 ? "patch" : "patches", merged.size(),
+                            merged.size() == 1 ? "range" : "ranges", threads.size(),
+                            threads.size() == 1 ? "thread" : "threads");
+        }
+        else
+        {
+            Utils::Errorf("Failed to make %p-%p writable, rolled back", failed.first, failed.second);
+            for (const auto& patch : pendingPatches)
+            {
+                if (patch.trampoline != nullptr) ExecMem::Free(patch.trampoline, patch.trampolineSize);
+            }
+        }
+        pendingPatches.clear();
+        return ok;
+    }
 
-        a.add(rsp, 32);
+    /**
+     * Writes bytes to code, collected into the current transaction if there is one
+     * @param addr Address to write to
+     * @param input Bytes to write
+     * @param len Amount of bytes
+     */
+    void Write(DWORD_PTR addr, void* input, size_t len)
+    {
+        TransactionBegin();
+        pendingPatches.push_back({addr, std::vector<BYTE>((BYTE*) input, (BYTE*) input + len), 0, {}, nullptr, 0});
+        TransactionCommit();
+    }
 
-        // Restore the original register values
-        for (int i = 15; i >= 0; i--) {
-            a.pop(registers[i]);
+    /**
+     * Creates a persistent hook, the hooked instruction jumps to a stub calling the hook, which then runs the
+     * relocated original instructions and jumps back
+     * @param targetInsn Instruction to hook
+     * @param hookFn Function to call
+     * @param stubTemplate Stub saving the registers to preserve around the hook
+     * @param cbAsmPtr Callback asm to call before the hook, needs a stub with a callback slot
+     * @return trampoline, backup of the original instructions, length of the jump, padding
+     */
+    HookResult HookStub(DWORD_PTR targetInsn, DWORD_PTR hookFn, const Stub::StubTemplate& stubTemplate, void* cbAsmPtr)
+    {
+        TRACE_SCOPE_DETAIL("Mem::Hook", Trace::Hex(targetInsn));
+        if (stubTemplate.error != nullptr)
+        {
+            Utils::Errorf("Hook: Failed to generate stub %s", stubTemplate.error);
+            return {nullptr, nullptr, 0, 0};
+        }
+        if (!initPool()) return {nullptr, nullptr, 0, 0};
+
+        // The stub only uses absolute addresses, so it's filled in before its address is known
+        std::vector<BYTE> stub;
+#ifdef OMORI_HOOK_STATS
+        auto stats = (DWORD_PTR) HookStats::Register(targetInsn, hookFn)->cpus;
+#else
+        DWORD_PTR stats = 0;
+#endif
+        Stub::Instantiate(stubTemplate, hookFn, (DWORD_PTR) cbAsmPtr, stats, stub);
+
+        // jmp rel32 if the pool is in reach, jmp qword ptr [rip+0] otherwise. The size of the relocated code doesn't
+        // depend on where it's placed, relocate once to size the allocation and again for the real address
+        size_t jmpLen = 5;
+        Relocation reloc;
+        BYTE* trampoline = nullptr;
+        size_t trampolineSize = 0;
+        TransactionBegin();
+        for (;;)
+        {
+            if (!Reloc::Relocate((const uint8_t*) targetInsn, targetInsn, 64, jmpLen, targetInsn, reloc))
+            {
+                Utils::Errorf("Failed to relocate %p: %s", targetInsn, reloc.error);
+                TransactionCommit();
+                return {nullptr, nullptr, 0, 0};
+            }
+            trampolineSize = stub.size() + reloc.code.size();
+            trampoline = (BYTE*) ExecMem::Alloc(trampolineSize);
+            if (trampoline == nullptr)
+            {
+                Utils::Error("Hook: No more free executable memory");
+                TransactionCommit();
+                return {nullptr, nullptr, 0, 0};
+            }
+            if (jmpLen == 14 || inRel32Reach(targetInsn + 5, (DWORD_PTR) trampoline)) break;
+            ExecMem::Free(trampoline, trampolineSize);
+            jmpLen = 14;
         }
 
-        for (int i = 15; i >= 0; i--) {
-            a.movdqu(xmms[i], xmmword_ptr(rsp));
-            a.add(rsp, 16);
+        if (!Reloc::Relocate((const uint8_t*) targetInsn, targetInsn, 64, jmpLen, (DWORD_PTR) trampoline + stub.size(), reloc))
+        {
+            Utils::Errorf("Failed to relocate %p: %s", targetInsn, reloc.error);
+            ExecMem::Free(trampoline, trampolineSize);
+            TransactionCommit();
+            return {nullptr, nullptr, 0, 0};
         }
 
-        a.add(rsp, 16);
-        a.jmp(jmpToOffset ? targetInsn + funcOffset : targetInsn);
+        memcpy(trampoline, stub.data(), stub.size());
+        memcpy(trampoline + stub.size(), reloc.code.data(), reloc.code.size());
 
-        zasm::Serializer serializer{};
-        auto res = serializer.serialize(program, (int64_t) mallocI);
-        if (res != zasm::Error::None)
+        void* backup = malloc(reloc.sourceLen);
+        memcpy(backup, (void*) targetInsn, reloc.sourceLen);
+
+        BYTE patch[32];
+        memset(patch, 0xCC, reloc.sourceLen); // add int3 padding
+        if (jmpLen == 5)
+        {
+            auto rel32 = (int32_t) ((DWORD_PTR) trampoline - (targetInsn + 5));
+            patch[0] = 0xE9;
+            memcpy(patch + 1, &rel32, sizeof(rel32));
+        }
+        else
+        {
+            auto target = (DWORD_PTR) trampoline;
+            const BYTE jmp[] = {0xFF, 0x25, 0x00, 0x00, 0x00, 0x00};
+            memcpy(patch, jmp, sizeof(jmp));
+            memcpy(patch + sizeof(jmp), &target, sizeof(target));
+        }
+
+        pendingPatches.push_back({targetInsn, std::vector<BYTE>(patch, patch + reloc.sourceLen),
+                                  (DWORD_PTR) trampoline + stub.size(), reloc.offsets, trampoline, trampolineSize});
+        if (!TransactionCommit())
         {
-            Utils::Errorf("HookOnce: Failed to serialize program %s", getErrorName(res));
+            free(backup);
             return {nullptr, nullptr, 0, 0};
         }
 
-        void* codePtr = codecaveAlloc(serializer.getCodeSize());
-        memcpy(codePtr, serializer.getCode(), serializer.getCodeSize());
+        BINLOG(LOG_INFO, "%p (%zu %zu) -> %p, %zu byte stub", (void*) targetInsn, jmpLen, reloc.sourceLen - jmpLen,
+               trampoline, stub.size());
 
-        return hookRes;
+        return HookResult
+        {
+                trampoline,
+                backup,
+                jmpLen,
+                reloc.sourceLen - jmpLen
+        };
+    }
+
+    /**
+     * Creates a persistent hook with a stub for a spec only known at runtime
+     * @param targetInsn Instruction to hook
+     * @param hookFn Function to call
+     * @param spec Registers the stub preserves around the hook
+     * @param cbAsmPtr Callback asm to call before the hook, can be nullptr
+     * @return trampoline, backup of the original instructions, length of the jump, padding
+     */
+    HookResult HookSpec(DWORD_PTR targetInsn, DWORD_PTR hookFn, const StubSpec& spec, void* cbAsmPtr)
+    {
+        return HookStub(targetInsn, hookFn, Stub::Build(spec, cbAsmPtr != nullptr), cbAsmPtr);
     }
 
     /**
      * Creates a persistent hook for a function
      * @param targetInsn Instruction to hook
      * @param hookFn Function to call
-     * @param useOffset Whether to use offsets or not
      * @param asmCallback Callback asm modifier
+     * @return trampoline, backup of the original instructions, length of the jump, padding
      */
-    void HookAssembly(DWORD_PTR targetInsn, DWORD_PTR hookFn, bool useOffset, void(*asmCallback)(zasm::x86::Assembler a))
+    HookResult HookAssembly(DWORD_PTR targetInsn, DWORD_PTR hookFn, void(*asmCallback)(zasm::x86::Assembler a))
     {
         zasm::Program cbProgram(zasm::MachineMode::AMD64);
         zasm::x86::Assembler cbA(cbProgram);
         asmCallback(cbA);
-        zasm::Serializer cbSerializer{};
-        auto cbRes = cbSerializer.serialize(cbProgram, (int64_t) mallocI);
-        if (cbRes != zasm::Error::None)
-        {
-            Utils::Errorf("HookAssembly: Failed to serialize program %s", getErrorName(cbRes));
-            return;
-        }
+        if (!initPool()) return {nullptr, nullptr, 0, 0};
 
+        // Serialize once to get the size, then again for the address it ends up at
+        zasm::Serializer cbSerializer{};
+        auto cbRes = cbSerializer.serialize(cbProgram, 0);
         void* cbAsmPtr = nullptr;
-        if (cbSerializer.getCodeSize() > 0)
+        if (cbRes == zasm::Error::None && cbSerializer.getCodeSize() > 0)
         {
-            cbAsmPtr = codecaveAlloc(cbSerializer.getCodeSize());
-            memcpy(cbAsmPtr, cbSerializer.getCode(), cbSerializer.getCodeSize());
+            size_t cbSize = cbSerializer.getCodeSize();
+            ExecMem::BeginWrite();
+            cbAsmPtr = ExecMem::Alloc(cbSize);
+            if (cbAsmPtr != nullptr)
+            {
+                cbRes = cbSerializer.serialize(cbProgram, (int64_t) cbAsmPtr);
+                if (cbRes == zasm::Error::None) memcpy(cbAsmPtr, cbSerializer.getCode(), cbSize);
+            }
+            ExecMem::EndWrite();
         }
-
-        // TODO: Add support for fastcall 5+ args
-        int funcOffset = useOffset ? 1 : 0;
-        auto hook1 = HookOnce(targetInsn, funcOffset, hookFn,  false, 50, cbAsmPtr);
-        size_t hook1Len = hook1.size + hook1.padding;
-        Utils::Infof("hook1 length: %d", hook1Len);
-
-        void* hookBackup = malloc(hook1Len);
-        memcpy(hookBackup, (void*) (targetInsn + funcOffset), hook1Len);
-
-        zasm::Program program(zasm::MachineMode::AMD64);
-        zasm::x86::Assembler a(program);
-
-        a.mov(rcx, zasm::Imm64(targetInsn + funcOffset));
-        a.mov(rdx, zasm::Imm64((DWORD_PTR)hookBackup));
-        a.mov(r8, zasm::Imm64(hook1Len));
-        a.mov(r15, zasm::Imm64((DWORD_PTR) memcpy));
-        a.call(r15);
-        a.ret();
-
-        zasm::Serializer serializer{};
-        auto res = serializer.serialize(program, (int64_t) mallocI);
-        if (res != zasm::Error::None)
+        if (cbRes != zasm::Error::None)
         {
-            Utils::Errorf("Hook: Failed to serialize program %s", getErrorName(res));
-            return;
+            Utils::Errorf("HookAssembly: Failed to serialize program %s", getErrorName(cbRes));
+            return {nullptr, nullptr, 0, 0};
         }
 
-        void* codePtr = codecaveAlloc(serializer.getCodeSize());
-        memcpy(codePtr, serializer.getCode(), serializer.getCodeSize());
-
-        Utils::Infof("hook2 codePtr: %p", codePtr);
-
-        Utils::Infof("hook2 at %p", targetInsn+hook1Len);
-        auto hook2 = HookOnce(targetInsn+hook1Len, 1, (DWORD_PTR)codePtr, true, 0, nullptr);
-        Utils::Infof("hook2: %d %d", hook2.size, hook2.padding);
-
-        DWORD _;
-        VirtualProtect((LPVOID)targetInsn, hook1Len + hook2.size + hook2.padding, PAGE_EXECUTE_READWRITE, &_);
-
-        memcpy((void*) ((DWORD_PTR)hook1.backupPtr+hook1Len), (void*) (targetInsn+funcOffset+hook1Len), 50 - hook1Len);
-        Utils::Successf("Hooked into %p+%d", targetInsn, funcOffset);
+        if (cbAsmPtr == nullptr) return HookStub(targetInsn, hookFn, Stub::Precompiled<Stub::volatileSpec, false>, nullptr);
+        return HookStub(targetInsn, hookFn, Stub::Precompiled<Stub::volatileSpec, true>, cbAsmPtr);
     }
 
     /**
      * Creates a persistent hook for a function
      * @param targetInsn Instruction to hook
      * @param hookFn Function to call
-     * @param useOffset Whether to use offsets or not
+     * @return trampoline, backup of the original instructions, length of the jump, padding
     */
-    void Hook(DWORD_PTR targetInsn, DWORD_PTR hookFn, bool useOffset)
+    HookResult Hook(DWORD_PTR targetInsn, DWORD_PTR hookFn)
     {
-        HookAssembly(targetInsn, hookFn, useOffset, [](zasm::x86::Assembler a){});
+        return HookStub(targetInsn, hookFn, Stub::Precompiled<Stub::volatileSpec, false>, nullptr);
     }
 
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 #include "pch.h"
 #include "consts.h"
+#include "stub.h"
 #include "zasm/x86/assembler.hpp"
 
 struct HookResult
@@ -11,14 +12,33 @@ struct HookResult
     size_t padding;
 };
 
-static DWORD_PTR mallocI = Consts::codecave;
-
 namespace Mem
 {
+    void TransactionBegin();
+    bool TransactionCommit();
+    void TransactionAbort();
     void Write(DWORD_PTR addr, void* input, size_t len);
-    void* CreateCall(DWORD_PTR addr);
-    HookResult HookOnce(DWORD_PTR targetInsn, int funcOffset, DWORD_PTR hookFn, bool jmpToOffset, size_t backupLen,
-                        void* cbAsmPtr);
-    void Hook(DWORD_PTR targetInsn, DWORD_PTR hookFn, bool useOffset);
-    void HookAssembly(DWORD_PTR targetInsn, DWORD_PTR hookFn, bool useOffset, void(*asmCallback)(zasm::x86::Assembler a));
-}
\ No newline at end of file
+    HookResult HookStub(DWORD_PTR targetInsn, DWORD_PTR hookFn, const Stub::StubTemplate& stubTemplate, void* cbAsmPtr);
+    HookResult HookSpec(DWORD_PTR targetInsn, DWORD_PTR hookFn, const StubSpec& spec, void* cbAsmPtr);
+    HookResult Hook(DWORD_PTR targetInsn, DWORD_PTR hookFn);
+    HookResult HookAssembly(DWORD_PTR targetInsn, DWORD_PTR hookFn, void(*asmCallback)(zasm::x86::Assembler a));
+
+    /**
+     * Hooks a function entry, the argument registers of the target's signature are preserved around the hook. The
+     * stub is encoded at compile time
+     * @tparam TargetFn Signature of the hooked function, e.g. void(*)(char*, int)
+     * @tparam HookFn Signature of the hook, its parameters have to be a prefix of the target's
+     * @param targetInsn Function to hook
+     * @param hookFn Function to call with the hooked function's arguments
+     * @return trampoline, backup of the original instructions, length of the jump, padding
+     */
+    template<typename TargetFn, typename HookFn>
+    HookResult Hook(DWORD_PTR targetInsn, HookFn hookFn)
+    {
+        static_assert(Stub::ParameterPrefix<HookFn, TargetFn>::value,
+                      "hook parameters have to be a prefix of the target's");
+        constexpr StubSpec spec = Stub::EntrySpec<TargetFn, HookFn>();
+        static_assert(Stub::Precompiled<spec, false>.error == nullptr, "hook stub can't be encoded");
+        return HookStub(targetInsn, (DWORD_PTR) hookFn, Stub::Precompiled<spec, false>, nullptr);
+    }
+}
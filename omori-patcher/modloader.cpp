@@ -1,15 +1,38 @@
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <condition_variable>
 #include "js.h"
 #include "utils.h"
 #include "consts.h"
 #include "modloader.h"
+#include "heap.h"
+#include "modules.h"
+#include "report.h"
+#include "mem.h"
+#include "patchfile.h"
+#include "trace.h"
+#include "mappedfile.h"
+#include "manifest.h"
+#include "startup.h"
 
 namespace ModLoader
 {
 
     std::vector<Mod> mods;
 
+    /**
+     * Reads and validates the mod.json of a mod, safe to call from any thread
+     * @param modId Directory name of the mod
+     * @return The mod, its id is empty if it couldn't be loaded
+     */
     Mod ParseMod(const char* modId)
     {
+        TRACE_SCOPE_DETAIL("ModLoader::ParseMod", modId);
+        double start = Report::NowMs();
         string infopath = string("mods\\") + modId + "\\mod.json";
         Json::Value root;
         if (!Utils::PathExists(infopath.c_str()))
@@ -17,7 +40,18 @@ namespace ModLoader
             Utils::Warnf("Mod: %s doesn't have a mod.json, skipping", modId);
             return {root, string(modId)};
         }
-        root = Utils::ParseJson(Utils::ReadFileStr(infopath.c_str()));
+
+        MappedFile file(infopath.c_str());
+        string error = "failed to read it";
+        if (!file.isOpen() || !Utils::ParseJson(file.data(), file.end(), root, error) || !Manifest::Validate(root, error))
+        {
+            Utils::Errorf("Mod: %s has an invalid mod.json, skipping: %s", modId, error.c_str());
+            return {Json::Value(), string(modId)};
+        }
+        // Only mods that actually load get a cost entry
+        ModCost& cost = Report::For(modId);
+        cost.id = root["id"].asString();
+        cost.parseMs = Report::NowMs() - start;
 
         return {
                 root,
@@ -31,9 +65,17 @@ namespace ModLoader
         };
     }
 
-    std::vector<Mod> ParseMods()
+    /**
+     * Parses the mod.json of every directory in mods on a pool of worker threads
+     * @return Mods that loaded, ordered by directory name regardless of which thread finished first
+     */
+    /**
+     * Lists the directories in mods
+     * @return Directory names in load order
+     */
+    std::vector<string> listModDirs()
     {
-        std::vector<Mod> mods;
+        std::vector<string> modDirs;
 
         HANDLE handle;
         WIN32_FIND_DATAA finfo;
@@ -41,24 +83,315 @@ namespace ModLoader
         if((handle = FindFirstFileA("mods/*", &finfo)) != INVALID_HANDLE_VALUE){
             do{
                 auto name = finfo.cFileName;
-                if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+                if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || !(finfo.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
                 {
                     continue;
                 }
-                auto mod = ParseMod(name);
-                if (!mod.id.empty()) mods.push_back(mod);
+                modDirs.emplace_back(name);
             }while(FindNextFileA(handle, &finfo));
             FindClose(handle);
         }
+        std::sort(modDirs.begin(), modDirs.end(), Manifest::DirLess);
+        return modDirs;
+    }
+
+    std::vector<Mod> ParseMods()
+    {
+        TRACE_SCOPE("ModLoader::ParseMods");
+        std::vector<string> modDirs = listModDirs();
 
+        std::vector<Mod> parsed(modDirs.size());
+        std::atomic<size_t> next = 0;
+        auto work = [&]() {
+            Startup::MarkWorkerThread();
+            for (size_t i = next++; i < modDirs.size(); i = next++)
+            {
+                parsed[i] = ParseMod(modDirs[i].c_str());
+            }
+        };
+        size_t threadCount = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), modDirs.size());
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < threadCount; i++) workers.emplace_back(work);
+        work();
+        for (auto& worker : workers) worker.join();
+
+        std::vector<Mod> mods;
+        for (auto& mod : parsed)
+        {
+            if (!mod.id.empty()) mods.push_back(std::move(mod));
+        }
         return mods;
     }
 
+    struct PatchTotals
+    {
+        size_t applied;
+        size_t alreadyApplied;
+        size_t mismatched;
+        size_t outOfBounds;
+        size_t conflicts;
+    };
+
+    struct QueuedRun
+    {
+        DWORD_PTR end;
+        string path;
+        std::vector<uint8_t> patched;
+    };
+
+    /**
+     * Finds a run queued earlier in this transaction that overlaps a range, queued runs never overlap each other
+     * @param queued Runs keyed by their start address
+     * @return The overlapping run, nullptr if the range is free
+     */
+    const std::pair<const DWORD_PTR, QueuedRun>* findOverlap(const std::map<DWORD_PTR, QueuedRun>& queued,
+                                                             DWORD_PTR addr, size_t len)
+    {
+        auto it = queued.lower_bound(addr + len);
+        if (it == queued.begin()) return nullptr;
+        --it;
+        return it->second.end > addr ? &*it : nullptr;
+    }
+
+    /**
+     * Queues the runs of a .1337 file that still have to be written into the current Mem transaction. Runs
+     * overlapping one queued by an earlier file are reported and skipped, the earlier file wins
+     * @param queued Runs queued so far, by start address
+     */
+    void queuePatchFile(const string& path, PatchTotals& totals, std::map<DWORD_PTR, QueuedRun>& queued)
+    {
+        MappedFile file(path.c_str());
+        if (!file.isOpen())
+        {
+            Utils::Errorf("[patch] Failed to read %s", path.c_str());
+            return;
+        }
+        PatchSet set;
+        string error;
+        if (!PatchFile::Parse(file.data(), set, error))
+        {
+            Utils::Errorf("[patch] %s: %s", path.c_str(), error.c_str());
+            return;
+        }
+
+        auto base = (DWORD_PTR) GetModuleHandleA(set.module.c_str());
+        if (base == 0)
+        {
+            Utils::Errorf("[patch] %s: module %s isn't loaded", path.c_str(), set.module.c_str());
+            return;
+        }
+
+        auto dos = (IMAGE_DOS_HEADER*) base;
+        auto nt = (IMAGE_NT_HEADERS*) (base + dos->e_lfanew);
+        uint64_t imageSize = nt->OptionalHeader.SizeOfImage;
+
+        for (PatchRun& run : set.runs)
+        {
+            if (run.rva > imageSize || run.patched.size() > imageSize - run.rva)
+            {
+                Utils::Errorf("[patch] %s: %zu bytes at %s+%llX are outside the module, skipping", path.c_str(),
+                              run.patched.size(), set.module.c_str(), (unsigned long long) run.rva);
+                totals.outOfBounds++;
+                continue;
+            }
+            DWORD_PTR addr = base + run.rva;
+            switch (PatchFile::Check((const uint8_t*) addr, run))
+            {
+                case PATCH_APPLICABLE:
+                    if (auto overlap = findOverlap(queued, addr, run.patched.size()))
+                    {
+                        const QueuedRun& other = overlap->second;
+                        // The same bytes from two files don't conflict
+                        if (overlap->first == addr && other.patched == run.patched)
+                        {
+                            totals.alreadyApplied++;
+                            break;
+                        }
+                        Utils::Errorf("[patch] %s: %zu bytes at %s+%llX conflict with %s, skipping", path.c_str(),
+                                      run.patched.size(), set.module.c_str(), (unsigned long long) run.rva,
+                                      other.path.c_str());
+                        totals.conflicts++;
+                        break;
+                    }
+                    Mem::Write(addr, run.patched.data(), run.patched.size());
+                    queued.emplace(addr, QueuedRun{addr + run.patched.size(), path, run.patched});
+                    totals.applied++;
+                    break;
+                case PATCH_ALREADY_APPLIED:
+                    totals.alreadyApplied++;
+                    break;
+                case PATCH_MISMATCH:
+                    Utils::Warnf("[patch] %s: %zu bytes at %s+%llX don't match, skipping", path.c_str(),
+                                 run.patched.size(), set.module.c_str(), (unsigned long long) run.rva);
+                    totals.mismatched++;
+                    break;
+            }
+        }
+    }
+
+    /**
+     * Applies every .1337 file listed in a mod's "patches", all runs are written in one Mem transaction. Called from
+     * DllMain before the game's entry point runs, so only the "patches" lists are read here, the rest of each mod.json
+     * is parsed and validated later by ParseMods. ChowdrenNoDyB.1337 isn't applied, it's the patch that makes the exe
+     * load us in the first place
+     */
+    void ApplyPatches()
+    {
+        TRACE_SCOPE("ModLoader::ApplyPatches");
+        PatchTotals totals{};
+        std::map<DWORD_PTR, QueuedRun> queued;
+        Mem::TransactionBegin();
+        for (const string& modDir : listModDirs())
+        {
+            MappedFile file(("mods\\" + modDir + "\\mod.json").c_str());
+            Json::Value root;
+            string error;
+            // Broken manifests are reported by ParseMods
+            if (!file.isOpen() || !Utils::ParseJson(file.data(), file.end(), root, error)) continue;
+            if (!root.isObject() || !root["patches"].isArray()) continue;
+            for (const Json::Value& patch : root["patches"])
+            {
+                if (!patch.isString()) continue;
+                string path = "mods\\" + modDir + "\\" + patch.asString();
+                if (!Utils::PathExists(path.c_str()))
+                {
+                    Utils::Errorf("[patch] %s: %s doesn't exist", modDir.c_str(), path.c_str());
+                    continue;
+                }
+                queuePatchFile(path, totals, queued);
+            }
+        }
+        if (!Mem::TransactionCommit())
+        {
+            Utils::Error("[patch] Failed to write byte patches");
+            return;
+        }
+        Utils::Infof("[patch] %zu %s applied, %zu already applied, %zu mismatched, %zu out of bounds, %zu conflicting",
+                     totals.applied, totals.applied == 1 ? "run" : "runs", totals.alreadyApplied, totals.mismatched,
+                     totals.outOfBounds, totals.conflicts);
+    }
+
+    struct ScriptJob
+    {
+        const Mod* mod;
+        string filename;
+        string moduleDir;
+        string source;
+        ModuleSet modules;
+        size_t size;
+        uint64_t hash;
+        bool ready;
+    };
+
+    /**
+     * Converts a script to UTF-8, stripping byte order marks. UTF-8 scripts are used straight from the mapping, only
+     * UTF-16 ones are converted into the arena
+     * @param file Raw file contents
+     * @param arena Arena for the converted script
+     * @return NUL terminated UTF-8 source
+     */
+    std::string_view transcode(const MappedFile& file, Arena& arena)
+    {
+        const char* data = file.data();
+        if (file.size() >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0) return {data + 3, file.size() - 3};
+        if (file.size() >= 2 && memcmp(data, "\xFF\xFE", 2) == 0)
+        {
+            auto wide = (const wchar_t*) (data + 2);
+            int wideLen = (int) ((file.size() - 2) / sizeof(wchar_t));
+            int len = WideCharToMultiByte(CP_UTF8, 0, wide, wideLen, nullptr, 0, nullptr, nullptr);
+            auto res = arena.allocArray<char>(len + 1);
+            WideCharToMultiByte(CP_UTF8, 0, wide, wideLen, res, len, nullptr, nullptr);
+            res[len] = 0;
+            return {res, (size_t) len};
+        }
+        return {data, file.size()};
+    }
+
+    /**
+     * FNV-1a hash of a script, identifies its contents in logs and caches
+     */
+    uint64_t hashSource(std::string_view source)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (unsigned char c : source)
+        {
+            hash ^= c;
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    /**
+     * Reads and prepares a mod script off the javascript thread
+     * @param job Job to fill in
+     */
+    void prepareScript(ScriptJob& job)
+    {
+        TRACE_SCOPE_DETAIL("Prepare", job.filename);
+        const Mod& mod = *job.mod;
+        Arena& arena = Arena::forThread();
+        Arena::Scope scope(arena);
+        MappedFile file(("mods\\" + mod.modDir + "\\" + mod.main).c_str());
+        if (!file.isOpen()) Utils::Errorf("Failed to read %s", job.filename.c_str());
+        std::string_view code = file.isOpen() ? transcode(file, arena) : "";
+
+        job.size = code.size();
+        job.hash = hashSource(code);
+        job.modules = Modules::Collect(code.data(), job.moduleDir);
+        job.source = js::WrapMod(code.data(), job.filename.c_str(), job.moduleDir.c_str());
+    }
+
+    /**
+     * Runs the main script of every mod in load order, scripts are read and prepared on a worker thread
+     * while earlier mods are being evaluated
+     */
     void RunMods()
     {
+        TRACE_SCOPE("ModLoader::RunMods");
+        std::vector<ScriptJob> jobs;
         for (const auto& mod : mods)
         {
-            if (!mod.main.empty()) js::JS_EvalMod(Utils::ReadFileStr(("mods\\" + mod.modDir + "\\" + mod.main).c_str()), (mod.modDir + "/" + mod.main).c_str());
+            if (mod.main.empty()) continue;
+            auto filename = mod.modDir + "/" + mod.main;
+            jobs.push_back({&mod, filename, "mods/" + filename.substr(0, filename.find_last_of("/\\"))});
+        }
+
+        std::mutex jobsMutex;
+        std::condition_variable jobReady;
+        std::thread worker([&]() {
+            for (auto& job : jobs)
+            {
+                prepareScript(job);
+                std::lock_guard<std::mutex> lock(jobsMutex);
+                job.ready = true;
+                jobReady.notify_one();
+            }
+        });
+
+        for (auto& job : jobs)
+        {
+            {
+                std::unique_lock<std::mutex> lock(jobsMutex);
+                jobReady.wait(lock, [&job]() { return job.ready; });
+            }
+            Utils::Infof("Running %s (%zu bytes, %016llx)", job.filename.c_str(), job.size, (unsigned long long) job.hash);
+            TRACE_SCOPE_DETAIL("Eval", job.filename);
+            ModCost& cost = Report::For(job.mod->modDir);
+            // Walking the GC object list is only worth it when heap.enabled is set, and stays out of the timing
+            bool countObjects = Heap::SamplerEnabled();
+            HeapStats before = Heap::Sample(countObjects);
+            double start = Report::NowMs();
+            Modules::Define(job.modules);
+            js::JS_Eval(job.source.c_str(), job.filename.c_str());
+            cost.evalMs = Report::NowMs() - start;
+            HeapStats after = Heap::Sample(countObjects);
+            cost.scriptBytes = job.size;
+            cost.heapBytes = (long long) after.mallocSize - (long long) before.mallocSize;
+            Heap::Attribute(job.mod->id, before, after);
+            job.source.clear();
+            job.source.shrink_to_fit();
         }
+        worker.join();
+        Report::Write();
     }
 }
\ No newline at end of file
@@ -22,6 +22,7 @@ namespace ModLoader {
 
     Mod ParseMod(const char *modId);
     std::vector<Mod> ParseMods();
+    void ApplyPatches();
     void RunMods();
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,204 @@
+#include <set>
+#include <mutex>
+#include <cctype>
+#include <cstring>
+#include <vector>
+#include <json/json.h>
+#include "js.h"
+#include "utils.h"
+#include "modules.h"
+#include "fs_overlay.h"
+#include "mappedfile.h"
+
+namespace Modules
+{
+    const char* libDir = "lib";
+    std::set<std::string> defined;
+    std::mutex definedMutex;
+
+    /**
+     * Collapses "." and ".." segments and backslashes of a game relative path
+     * @param path Path to normalize
+     * @return Normalized path, segments separated by '/'
+     */
+    std::string normalize(const std::string& path)
+    {
+        std::vector<std::string> segments;
+        size_t start = 0;
+        while (start <= path.size())
+        {
+            size_t end = path.find_first_of("/\\", start);
+            if (end == std::string::npos) end = path.size();
+            auto segment = path.substr(start, end - start);
+            if (segment == "..")
+            {
+                if (!segments.empty()) segments.pop_back();
+            }
+            else if (!segment.empty() && segment != ".")
+            {
+                segments.push_back(segment);
+            }
+            start = end + 1;
+        }
+
+        std::string res;
+        for (const auto& segment : segments)
+        {
+            if (!res.empty()) res += '/';
+            res += segment;
+        }
+        return res;
+    }
+
+    std::string dirname(const std::string& id)
+    {
+        size_t i = id.find_last_of('/');
+        return i == std::string::npos ? "" : id.substr(0, i);
+    }
+
+    /**
+     * Resolves a require() specifier to a module id, the files are looked up through the fs overlay
+     * @param spec Specifier passed to require, "./" and "../" are relative to dir, anything else is looked up in lib/
+     * @param dir Game relative directory of the requiring script
+     * @return Module id (game relative path), empty if the module doesn't exist
+     */
+    std::string Resolve(const std::string& spec, const std::string& dir)
+    {
+        std::string base;
+        if (spec.starts_with("./") || spec.starts_with("../")) base = normalize(dir + "/" + spec);
+        else if (spec.starts_with("/")) base = normalize(spec);
+        else base = normalize(string(libDir) + "/" + spec);
+
+        for (const auto& candidate : {base, base + ".js", base + "/index.js"})
+        {
+            auto path = FS_ResolvePath(candidate);
+            DWORD attributes = GetFileAttributesA(path.c_str());
+            if (attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY) == 0) return candidate;
+        }
+        return "";
+    }
+
+    /**
+     * Collects the string literal arguments of every require() call in a script
+     * @param code Script source
+     * @return Specifiers in order of appearance
+     */
+    std::vector<std::string> scanRequires(const char* code)
+    {
+        std::vector<std::string> specs;
+        const char* needle = "require(";
+        size_t needleLen = strlen(needle);
+
+        for (const char* p = strstr(code, needle); p != nullptr; p = strstr(p + needleLen, needle))
+        {
+            if (p > code && (isalnum((unsigned char) p[-1]) || p[-1] == '_' || p[-1] == '$' || p[-1] == '.')) continue;
+            const char* q = p + needleLen;
+            while (*q == ' ' || *q == '\t') q++;
+            char quote = *q;
+            if (quote != '\'' && quote != '"' && quote != '`') continue;
+            const char* end = strchr(q + 1, quote);
+            if (end == nullptr) break;
+            specs.emplace_back(q + 1, end - q - 1);
+        }
+        return specs;
+    }
+
+    /**
+     * Resolves and reads every module a script requires, recursively, without evaluating any of them. Modules are
+     * only marked defined once Define runs them, so a require() handled in the meantime still gets its own copy
+     * @param code Script source
+     * @param dir Game relative directory of the script
+     * @param set Collected definitions and resolutions, appended to
+     * @param collected Ids already in set
+     */
+    void collect(const char* code, const std::string& dir, ModuleSet& set, std::set<std::string>& collected)
+    {
+        for (const auto& spec : scanRequires(code))
+        {
+            auto id = Resolve(spec, dir);
+            if (id.empty())
+            {
+                Utils::Warnf("[require] Cannot find module '%s' from '%s'", spec.c_str(), dir.c_str());
+                continue;
+            }
+
+            bool isDefined;
+            {
+                std::lock_guard<std::mutex> lock(definedMutex);
+                isDefined = defined.contains(id);
+            }
+            if (!isDefined && !collected.contains(id))
+            {
+                MappedFile moduleFile(FS_ResolvePath(id).c_str());
+                if (!moduleFile.isOpen())
+                {
+                    // Left unresolved, so require() fails instead of running an empty module
+                    Utils::Errorf("[require] Failed to read %s, cannot resolve '%s' from '%s'", id.c_str(),
+                                  spec.c_str(), dir.c_str());
+                    continue;
+                }
+                collected.insert(id);
+                set.definitions.push_back({id, "mp_define(" + Json::valueToQuotedString(id.c_str()) +
+                                               ", function (module, exports, require) {\n" + moduleFile.data() +
+                                               "\n});"});
+                collect(moduleFile.data(), dirname(id), set, collected);
+            }
+            set.resolutions += "mp_resolved(" + Json::valueToQuotedString(dir.c_str()) + ", " +
+                               Json::valueToQuotedString(spec.c_str()) + ", " + Json::valueToQuotedString(id.c_str()) + ");\n";
+        }
+    }
+
+    /**
+     * Resolves and reads the static dependencies of a script, safe to call from any thread
+     * @param code Script source
+     * @param dir Game relative directory of the script
+     * @return Modules that still have to be defined with Define
+     */
+    ModuleSet Collect(const char* code, const std::string& dir)
+    {
+        ModuleSet set;
+        std::set<std::string> collected;
+        collect(code, dir, set, collected);
+        return set;
+    }
+
+    /**
+     * Defines collected modules in the javascript context, has to be called on the javascript thread
+     * @param set Modules returned by Collect
+     */
+    void Define(const ModuleSet& set)
+    {
+        for (const auto& [id, source] : set.definitions)
+        {
+            {
+                // Another set collected before this one ran may have defined it already
+                std::lock_guard<std::mutex> lock(definedMutex);
+                if (!defined.insert(id).second) continue;
+            }
+            js::JS_Eval(source.c_str(), id.c_str());
+            Utils::Infof("[require] Loaded module %s", id.c_str());
+        }
+        if (!set.resolutions.empty()) js::JS_Eval(set.resolutions.c_str(), "<omori-patcher>");
+    }
+
+    /**
+     * Resolves the static dependencies of a script up front, so require() only has to run the cached modules
+     * @param code Script source
+     * @param dir Game relative directory of the script
+     */
+    void Preload(const char* code, const std::string& dir)
+    {
+        Define(Collect(code, dir));
+    }
+
+    /**
+     * Handles a require() the up front resolution didn't see
+     * @param spec Specifier passed to require
+     * @param dir Game relative directory of the requiring script
+     */
+    void Require(const std::string& spec, const std::string& dir)
+    {
+        string code = "require(" + Json::valueToQuotedString(spec.c_str()) + ")";
+        Preload(code.c_str(), dir);
+    }
+}
@@ -0,0 +1,23 @@
+#ifndef OMORI_PATCHER_MODULES_H
+#define OMORI_PATCHER_MODULES_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+struct ModuleSet
+{
+    std::vector<std::pair<std::string, std::string>> definitions;
+    std::string resolutions;
+};
+
+namespace Modules
+{
+    std::string Resolve(const std::string& spec, const std::string& dir);
+    ModuleSet Collect(const char* code, const std::string& dir);
+    void Define(const ModuleSet& set);
+    void Preload(const char* code, const std::string& dir);
+    void Require(const std::string& spec, const std::string& dir);
+}
+
+#endif //OMORI_PATCHER_MODULES_H
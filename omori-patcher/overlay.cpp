@@ -0,0 +1,310 @@
+#include <algorithm>
+#include <cstring>
+#include "overlay.h"
+
+/**
+ * Replaces a file, the last mod to add a path wins
+ * @param path Absolute path of the replaced file
+ * @param target Absolute path of the file replacing it
+ */
+void OverlayEngine::add(const std::wstring& path, const std::wstring& target)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries[path] = target;
+}
+
+/**
+ * Serves reads of a file from memory, the data has to outlive the engine
+ * @param path Absolute path of the file
+ * @param data Contents
+ * @param size Size of the contents
+ */
+void OverlayEngine::addMemoryFile(const std::wstring& path, const uint8_t* data, size_t size)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    memoryFiles[path] = {data, size};
+}
+
+/**
+ * Moves the entries into one block with a sorted index, nothing can be added afterwards
+ * @return Bytes used by the frozen index
+ */
+size_t OverlayEngine::freeze()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t chars = 0;
+    for (const auto& [path, target] : entries) chars += path.size() + target.size() + 1;
+    frozenStrings = std::make_unique<wchar_t[]>(chars);
+    frozen.reserve(entries.size());
+    wchar_t* out = frozenStrings.get();
+    for (const auto& [path, target] : entries)
+    {
+        std::wstring_view pathView(out, path.size());
+        out = std::copy(path.begin(), path.end(), out);
+        std::wstring_view targetView(out, target.size());
+        out = std::copy(target.begin(), target.end(), out);
+        *out++ = 0;
+        frozen.push_back({pathView, targetView});
+    }
+    isFrozen.store(true, std::memory_order_release);
+    entries.clear();
+    return frozen.size() * sizeof(FrozenEntry) + chars * sizeof(wchar_t);
+}
+
+const OverlayEngine::FrozenEntry* OverlayEngine::findFrozen(std::wstring_view absolute) const
+{
+    auto it = std::lower_bound(frozen.begin(), frozen.end(), absolute,
+                               [](const FrozenEntry& entry, std::wstring_view path) { return entry.path < path; });
+    if (it == frozen.end() || it->path != absolute) return nullptr;
+    return &*it;
+}
+
+/**
+ * Looks a file up in the overlay
+ * @param absolute Absolute path of the file
+ * @param target Path of the file replacing it
+ * @return Whether a mod replaces the file
+ */
+bool OverlayEngine::find(const std::wstring& absolute, std::wstring& target)
+{
+    if (!isFrozen.load(std::memory_order_acquire))
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // Rechecked under the lock, freeze() clears the map
+        if (!isFrozen.load(std::memory_order_relaxed))
+        {
+            auto it = entries.find(absolute);
+            if (it == entries.end()) return false;
+            target = it->second;
+            return true;
+        }
+    }
+    const FrozenEntry* entry = findFrozen(absolute);
+    if (entry == nullptr) return false;
+    target = entry->target;
+    return true;
+}
+
+size_t OverlayEngine::size()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return isFrozen ? frozen.size() : entries.size();
+}
+
+/**
+ * Opens a file, or the file a mod replaces it with
+ * @param redirected Set to whether the open was redirected
+ * @return Handle from the file api
+ */
+FileHandle OverlayEngine::createFile(const wchar_t* path, uint32_t access, uint32_t share, void* security,
+                                     uint32_t disposition, uint32_t flags, FileHandle templateFile, bool* redirected)
+{
+    std::wstring absolute = api.absolutePath(path);
+    const wchar_t* openPath = path;
+    std::wstring target;
+    if (isFrozen.load(std::memory_order_acquire))
+    {
+        const FrozenEntry* entry = findFrozen(absolute);
+        if (entry != nullptr) openPath = entry->target.data();
+    }
+    else if (find(absolute, target))
+    {
+        openPath = target.c_str();
+    }
+    if (redirected != nullptr) *redirected = openPath != path;
+
+    FileHandle handle = api.createFile(openPath, access, share, security, disposition, flags, templateFile);
+    if (handle == INVALID_FILE_HANDLE) return handle;
+    if (listener != nullptr) listener->opened(absolute, openPath != path);
+
+    // The real handle stays open for everything but reads and seeks, like GetFileSize
+    const ContentCache::Entry* cached = nullptr;
+    if (openPath != path && cache.enabled() && (access & FILE_ACCESS_WRITE) == 0 && (flags & FILE_OPEN_OVERLAPPED) == 0)
+    {
+        cached = loadCached(handle, openPath);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    MemoryHandle memory;
+    if (cached != nullptr)
+    {
+        memory = {cached->data.data(), cached->data.size(), 0, cached};
+    }
+    else
+    {
+        if (memoryFiles.empty()) return handle;
+        auto it = memoryFiles.find(absolute);
+        if (it == memoryFiles.end()) return handle;
+        memory = {it->second.data, it->second.size, 0, nullptr};
+    }
+    auto it = memoryHandles.find(handle);
+    if (it == memoryHandles.end())
+    {
+        memoryHandles.emplace(handle, memory);
+        openMemoryHandles++;
+    }
+    else
+    {
+        // The handle was closed without going through closeFile and got reused
+        if (it->second.cached != nullptr) cache.release(it->second.cached);
+        it->second = memory;
+    }
+    return handle;
+}
+
+/**
+ * Gets a replaced file's contents from the cache, reading it through a freshly opened handle on a miss
+ * @param handle Handle of the file, its pointer is left at the start
+ * @param target Path of the file replacing the opened one
+ * @return The pinned contents, nullptr if the file isn't cached
+ */
+const ContentCache::Entry* OverlayEngine::loadCached(FileHandle handle, const wchar_t* target)
+{
+    const ContentCache::Entry* entry = cache.acquire(target);
+    if (entry != nullptr) return entry;
+    return readCached(handle, target, false);
+}
+
+/**
+ * Reads a file into the content cache
+ * @param prefetched Whether the game hasn't asked for the file yet
+ */
+const ContentCache::Entry* OverlayEngine::readCached(FileHandle handle, const wchar_t* target, bool prefetched)
+{
+    int64_t size;
+    if (!api.setFilePointer(handle, 0, &size, SEEK_METHOD_END) || size < 0 || !cache.admits((uint64_t) size))
+    {
+        api.setFilePointer(handle, 0, nullptr, SEEK_METHOD_BEGIN);
+        return nullptr;
+    }
+    std::vector<uint8_t> data((size_t) size);
+    bool ok = api.setFilePointer(handle, 0, nullptr, SEEK_METHOD_BEGIN);
+    for (size_t pos = 0; ok && pos < data.size();)
+    {
+        uint32_t read = 0;
+        auto chunk = (uint32_t) std::min<size_t>(data.size() - pos, UINT32_MAX);
+        ok = api.readFile(handle, data.data() + pos, chunk, &read, nullptr) && read != 0;
+        pos += read;
+    }
+    api.setFilePointer(handle, 0, nullptr, SEEK_METHOD_BEGIN);
+    if (!ok) return nullptr;
+    return cache.insert(target, std::move(data), prefetched);
+}
+
+/**
+ * Reads a file ahead of the game so its open doesn't wait on the disk. Replaced files go into the content cache when
+ * it's on, everything else is read through once to bring it into the page cache
+ * @param absolute Absolute path of the file the game will open
+ * @return Bytes read, 0 if the file couldn't be opened or was already cached
+ */
+uint64_t OverlayEngine::warm(const std::wstring& absolute)
+{
+    std::wstring target;
+    bool replaced = find(absolute, target);
+    const std::wstring& openPath = replaced ? target : absolute;
+    FileHandle handle = api.createFile(openPath.c_str(), FILE_ACCESS_READ, FILE_SHARE_READ_WRITE, nullptr,
+                                       DISPOSITION_OPEN_EXISTING, 0, nullptr);
+    if (handle == INVALID_FILE_HANDLE) return 0;
+
+    uint64_t bytes = 0;
+    if (replaced && cache.enabled())
+    {
+        const ContentCache::Entry* entry = cache.peek(openPath);
+        if (entry == nullptr)
+        {
+            entry = readCached(handle, openPath.c_str(), true);
+            if (entry != nullptr) bytes = entry->data.size();
+        }
+        if (entry != nullptr) cache.release(entry);
+    }
+    else
+    {
+        thread_local std::vector<uint8_t> buffer(64 * 1024);
+        uint32_t read = 0;
+        while (api.readFile(handle, buffer.data(), (uint32_t) buffer.size(), &read, nullptr) && read != 0) bytes += read;
+    }
+    api.closeFile(handle);
+    return bytes;
+}
+
+/**
+ * Reads from a file, in-memory files are served from their contents
+ */
+bool OverlayEngine::readFile(FileHandle file, void* buffer, uint32_t size, uint32_t* read, void* overlapped)
+{
+    if (openMemoryHandles.load(std::memory_order_relaxed) != 0)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = memoryHandles.find(file);
+        if (it != memoryHandles.end())
+        {
+            MemoryHandle& handle = it->second;
+            uint64_t available = handle.pointer < handle.size ? handle.size - handle.pointer : 0;
+            auto len = (uint32_t) std::min<uint64_t>(size, available);
+            memcpy(buffer, handle.data + handle.pointer, len);
+            handle.pointer += len;
+            if (read != nullptr) *read = len;
+            return true;
+        }
+    }
+    return api.readFile(file, buffer, size, read, overlapped);
+}
+
+/**
+ * Moves the file pointer, in-memory files keep their own
+ */
+bool OverlayEngine::setFilePointer(FileHandle file, int64_t distance, int64_t* newPointer, uint32_t method)
+{
+    if (openMemoryHandles.load(std::memory_order_relaxed) != 0)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = memoryHandles.find(file);
+        if (it != memoryHandles.end())
+        {
+            MemoryHandle& handle = it->second;
+            int64_t base;
+            switch (method)
+            {
+                case SEEK_METHOD_BEGIN:
+                    base = 0;
+                    break;
+                case SEEK_METHOD_CURRENT:
+                    base = (int64_t) handle.pointer;
+                    break;
+                case SEEK_METHOD_END:
+                    base = (int64_t) handle.size;
+                    break;
+                default:
+                    return false;
+            }
+            if (base + distance < 0) return false;
+            handle.pointer = (uint64_t) (base + distance);
+            if (newPointer != nullptr) *newPointer = (int64_t) handle.pointer;
+            return true;
+        }
+    }
+    return api.setFilePointer(file, distance, newPointer, method);
+}
+
+/**
+ * Closes a file, the cached contents it was reading are unpinned
+ */
+bool OverlayEngine::closeFile(FileHandle file)
+{
+    if (openMemoryHandles.load(std::memory_order_relaxed) != 0)
+    {
+        const ContentCache::Entry* cached = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = memoryHandles.find(file);
+            if (it != memoryHandles.end())
+            {
+                cached = it->second.cached;
+                memoryHandles.erase(it);
+                openMemoryHandles--;
+            }
+        }
+        if (cached != nullptr) cache.release(cached);
+    }
+    return api.closeFile(file);
+}
@@ -0,0 +1,115 @@
+#ifndef OMORI_PATCHER_OVERLAY_H
+#define OMORI_PATCHER_OVERLAY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "contentcache.h"
+#include "fileapi.h"
+
+/**
+ * Told about every successful open, for acting on the order files are used in
+ */
+class OpenListener
+{
+public:
+    virtual ~OpenListener() = default;
+
+    virtual void opened(std::wstring_view absolute, bool redirected) = 0;
+};
+
+/**
+ * Redirects opens of files mods replace and serves in-memory files, independent of Windows so it can be driven by the
+ * detours in the game or by a replayed trace on Linux. Entries are added while mods are registered, after freeze() the
+ * index is read-only and lookups take no lock. With a cache budget set, reads of replaced files are served from the
+ * content cache
+ */
+class OverlayEngine
+{
+public:
+    explicit OverlayEngine(FileApi& api) : api(api) {}
+
+    OverlayEngine(const OverlayEngine&) = delete;
+    OverlayEngine& operator=(const OverlayEngine&) = delete;
+
+    void add(const std::wstring& path, const std::wstring& target);
+    void addMemoryFile(const std::wstring& path, const uint8_t* data, size_t size);
+    size_t freeze();
+    bool find(const std::wstring& absolute, std::wstring& target);
+    size_t size();
+
+    ContentCache& contentCache()
+    {
+        return cache;
+    }
+
+    // Has to be set before any file is opened through the engine
+    void setListener(OpenListener* newListener)
+    {
+        listener = newListener;
+    }
+
+    uint64_t warm(const std::wstring& absolute);
+
+    FileHandle createFile(const wchar_t* path, uint32_t access, uint32_t share, void* security, uint32_t disposition,
+                          uint32_t flags, FileHandle templateFile, bool* redirected = nullptr);
+    bool readFile(FileHandle file, void* buffer, uint32_t size, uint32_t* read, void* overlapped);
+    bool setFilePointer(FileHandle file, int64_t distance, int64_t* newPointer, uint32_t method);
+    bool closeFile(FileHandle file);
+
+    // Calls fn(path, target) for every entry of the frozen index
+    template<typename Fn>
+    void forEach(Fn fn) const
+    {
+        for (const FrozenEntry& entry : frozen) fn(entry.path, entry.target);
+    }
+
+private:
+    struct FrozenEntry
+    {
+        std::wstring_view path;
+        // NUL terminated in the frozen block, passed to createFile as is
+        std::wstring_view target;
+    };
+
+    struct MemoryFile
+    {
+        const uint8_t* data;
+        size_t size;
+    };
+
+    struct MemoryHandle
+    {
+        const uint8_t* data;
+        uint64_t size;
+        uint64_t pointer;
+        // Pinned until the handle is closed, nullptr for files added with addMemoryFile
+        const ContentCache::Entry* cached;
+    };
+
+    FileApi& api;
+    std::mutex mutex;
+    std::map<std::wstring, std::wstring> entries;
+    std::vector<FrozenEntry> frozen;
+    std::unique_ptr<wchar_t[]> frozenStrings;
+    std::atomic<bool> isFrozen = false;
+    std::map<std::wstring, MemoryFile> memoryFiles;
+    std::unordered_map<FileHandle, MemoryHandle> memoryHandles;
+    // Lets reads and seeks skip the lock while no in-memory file is open, which is nearly always
+    std::atomic<size_t> openMemoryHandles = 0;
+    ContentCache cache;
+    OpenListener* listener = nullptr;
+
+    const FrozenEntry* findFrozen(std::wstring_view absolute) const;
+    const ContentCache::Entry* loadCached(FileHandle handle, const wchar_t* target);
+    const ContentCache::Entry* readCached(FileHandle handle, const wchar_t* target, bool prefetched);
+};
+
+#endif //OMORI_PATCHER_OVERLAY_H
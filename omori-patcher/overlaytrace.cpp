@@ -0,0 +1,252 @@
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include "overlaytrace.h"
+
+namespace OverlayTrace
+{
+    FILE* openFile(const char* path, const char* mode)
+    {
+#ifdef _WIN32
+        FILE* file = nullptr;
+        return fopen_s(&file, path, mode) == 0 ? file : nullptr;
+#else
+        return fopen(path, mode);
+#endif
+    }
+
+    /**
+     * Converts a wide string to UTF-8, wchar_t is UTF-16 on Windows and UTF-32 elsewhere
+     */
+    std::string ToUtf8(std::wstring_view str)
+    {
+        std::string out;
+        out.reserve(str.size());
+        for (size_t i = 0; i < str.size(); i++)
+        {
+            auto c = (uint32_t) str[i];
+            if (sizeof(wchar_t) == 2 && c >= 0xD800 && c < 0xDC00 && i + 1 < str.size())
+            {
+                c = 0x10000 + ((c - 0xD800) << 10) + ((uint32_t) str[++i] - 0xDC00);
+            }
+            if (c < 0x80) out += (char) c;
+            else if (c < 0x800)
+            {
+                out += (char) (0xC0 | c >> 6);
+                out += (char) (0x80 | (c & 0x3F));
+            }
+            else if (c < 0x10000)
+            {
+                out += (char) (0xE0 | c >> 12);
+                out += (char) (0x80 | (c >> 6 & 0x3F));
+                out += (char) (0x80 | (c & 0x3F));
+            }
+            else
+            {
+                out += (char) (0xF0 | c >> 18);
+                out += (char) (0x80 | (c >> 12 & 0x3F));
+                out += (char) (0x80 | (c >> 6 & 0x3F));
+                out += (char) (0x80 | (c & 0x3F));
+            }
+        }
+        return out;
+    }
+
+    std::wstring FromUtf8(std::string_view str)
+    {
+        std::wstring out;
+        out.reserve(str.size());
+        for (size_t i = 0; i < str.size();)
+        {
+            auto c = (uint8_t) str[i];
+            int extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : 0;
+            uint32_t code = extra == 0 ? c : c & (0x3F >> extra);
+            for (int j = 1; j <= extra && i + j < str.size(); j++) code = code << 6 | ((uint8_t) str[i + j] & 0x3F);
+            i += extra + 1;
+            if (sizeof(wchar_t) == 2 && code >= 0x10000)
+            {
+                code -= 0x10000;
+                out += (wchar_t) (0xD800 + (code >> 10));
+                out += (wchar_t) (0xDC00 + (code & 0x3FF));
+            }
+            else
+            {
+                out += (wchar_t) code;
+            }
+        }
+        return out;
+    }
+
+    std::vector<std::string_view> split(std::string_view line)
+    {
+        std::vector<std::string_view> fields;
+        size_t start = 0;
+        while (true)
+        {
+            size_t tab = line.find('\t', start);
+            fields.push_back(line.substr(start, tab == std::string_view::npos ? std::string_view::npos : tab - start));
+            if (tab == std::string_view::npos) return fields;
+            start = tab + 1;
+        }
+    }
+
+    uint64_t number(std::string_view field, int base = 10)
+    {
+        return strtoull(std::string(field).c_str(), nullptr, base);
+    }
+
+    /**
+     * Reads a whole trace
+     * @param path Trace file
+     * @param out Overlay entries and events in the order they were recorded
+     * @param error What's wrong with the trace
+     * @return Whether the trace could be read
+     */
+    bool Load(const char* path, Trace& out, std::string& error)
+    {
+        FILE* file = openFile(path, "rb");
+        if (file == nullptr)
+        {
+            error = std::string("failed to open ") + path;
+            return false;
+        }
+        std::string text;
+        char chunk[65536];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) text.append(chunk, n);
+        fclose(file);
+
+        if (text.compare(0, strlen(HEADER), HEADER) != 0)
+        {
+            error = "not an overlay trace";
+            return false;
+        }
+        size_t lineNumber = 0;
+        for (size_t pos = 0; pos < text.size();)
+        {
+            size_t end = text.find('\n', pos);
+            if (end == std::string::npos) end = text.size();
+            std::string_view line(text.data() + pos, end - pos);
+            pos = end + 1;
+            lineNumber++;
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            if (line.empty() || line[0] == '#') continue;
+
+            auto fields = split(line);
+            Event event{};
+            event.op = (Op) line[0];
+            size_t expected;
+            switch (line[0])
+            {
+                case 'O': expected = 3; break;
+                case OP_CREATE: expected = 10; break;
+                case OP_READ: expected = 7; break;
+                case OP_SEEK: expected = 8; break;
+                case OP_CLOSE: expected = 5; break;
+                default: expected = 0; break;
+            }
+            if (fields.size() != expected || fields[0].size() != 1)
+            {
+                error = "malformed record on line " + std::to_string(lineNumber);
+                return false;
+            }
+            if (line[0] == 'O')
+            {
+                out.overlay.emplace_back(FromUtf8(fields[1]), FromUtf8(fields[2]));
+                continue;
+            }
+            event.thread = (uint32_t) number(fields[1]);
+            event.ns = number(fields[2]);
+            event.handle = number(fields[3], 16);
+            switch (event.op)
+            {
+                case OP_CREATE:
+                    event.access = (uint32_t) number(fields[4], 16);
+                    event.share = (uint32_t) number(fields[5]);
+                    event.disposition = (uint32_t) number(fields[6]);
+                    event.flags = (uint32_t) number(fields[7], 16);
+                    event.redirected = fields[8] == "1";
+                    event.path = FromUtf8(fields[9]);
+                    break;
+                case OP_READ:
+                    event.size = (uint32_t) number(fields[4]);
+                    event.read = (uint32_t) number(fields[5]);
+                    event.ok = fields[6] == "1";
+                    break;
+                case OP_SEEK:
+                    event.distance = strtoll(std::string(fields[4]).c_str(), nullptr, 10);
+                    event.method = (uint32_t) number(fields[5]);
+                    event.result = strtoll(std::string(fields[6]).c_str(), nullptr, 10);
+                    event.ok = fields[7] == "1";
+                    break;
+                case OP_CLOSE:
+                    event.ok = fields[4] == "1";
+                    break;
+            }
+            out.events.push_back(std::move(event));
+        }
+        return true;
+    }
+
+    Writer::~Writer()
+    {
+        close();
+    }
+
+    bool Writer::open(const char* path)
+    {
+        close();
+        file = openFile(path, "wb");
+        if (file == nullptr) return false;
+        fprintf(file, "%s\n", HEADER);
+        return true;
+    }
+
+    void Writer::close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (file != nullptr) fclose(file);
+        file = nullptr;
+    }
+
+    void Writer::overlayEntry(std::wstring_view path, std::wstring_view target)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (file == nullptr) return;
+        fprintf(file, "O\t%s\t%s\n", ToUtf8(path).c_str(), ToUtf8(target).c_str());
+    }
+
+    void Writer::createFile(uint32_t thread, uint64_t ns, FileHandle handle, const wchar_t* path, uint32_t access,
+                            uint32_t share, uint32_t disposition, uint32_t flags, bool redirected)
+    {
+        std::string utf8 = path != nullptr ? ToUtf8(path) : "";
+        std::lock_guard<std::mutex> lock(mutex);
+        if (file == nullptr) return;
+        fprintf(file, "C\t%u\t%" PRIu64 "\t%" PRIxPTR "\t%x\t%u\t%u\t%x\t%d\t%s\n", thread, ns, (uintptr_t) handle,
+                access, share, disposition, flags, redirected ? 1 : 0, utf8.c_str());
+    }
+
+    void Writer::readFile(uint32_t thread, uint64_t ns, FileHandle handle, uint32_t size, uint32_t read, bool ok)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (file == nullptr) return;
+        fprintf(file, "R\t%u\t%" PRIu64 "\t%" PRIxPTR "\t%u\t%u\t%d\n", thread, ns, (uintptr_t) handle, size, read,
+                ok ? 1 : 0);
+    }
+
+    void Writer::setFilePointer(uint32_t thread, uint64_t ns, FileHandle handle, int64_t distance, uint32_t method,
+                                int64_t result, bool ok)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (file == nullptr) return;
+        fprintf(file, "S\t%u\t%" PRIu64 "\t%" PRIxPTR "\t%" PRId64 "\t%u\t%" PRId64 "\t%d\n", thread, ns,
+                (uintptr_t) handle, distance, method, result, ok ? 1 : 0);
+    }
+
+    void Writer::closeFile(uint32_t thread, uint64_t ns, FileHandle handle, bool ok)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (file == nullptr) return;
+        fprintf(file, "X\t%u\t%" PRIu64 "\t%" PRIxPTR "\t%d\n", thread, ns, (uintptr_t) handle, ok ? 1 : 0);
+    }
+}
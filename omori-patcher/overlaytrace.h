@@ -0,0 +1,94 @@
+#ifndef OMORI_PATCHER_OVERLAYTRACE_H
+#define OMORI_PATCHER_OVERLAYTRACE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "fileapi.h"
+
+// Text trace of the file calls the overlay sees, written by the detours with overlay.capture set and replayed by
+// tools/overlay-replay. One tab separated record per line, paths are UTF-8 and handles hex:
+//
+// O  path  target                                                           overlay entry, written on freeze
+// C  thread  ns  handle  access  share  disposition  flags  redirected  path  CreateFileW
+// R  thread  ns  handle  size  read  ok                                     ReadFile
+// S  thread  ns  handle  distance  method  result  ok                       SetFilePointerEx
+// X  thread  ns  handle  ok                                                 CloseHandle
+//
+// ns is how long the call took in the game, including the original function
+namespace OverlayTrace
+{
+    const char* const HEADER = "# omori-patcher overlay trace 1";
+
+    enum Op : char
+    {
+        OP_CREATE = 'C',
+        OP_READ = 'R',
+        OP_SEEK = 'S',
+        OP_CLOSE = 'X'
+    };
+
+    struct Event
+    {
+        Op op;
+        uint32_t thread;
+        uint64_t ns;
+        uint64_t handle;
+        std::wstring path;
+        uint32_t access;
+        uint32_t share;
+        uint32_t disposition;
+        uint32_t flags;
+        bool redirected;
+        uint32_t size;
+        uint32_t read;
+        int64_t distance;
+        uint32_t method;
+        int64_t result;
+        bool ok;
+    };
+
+    struct Trace
+    {
+        std::vector<std::pair<std::wstring, std::wstring>> overlay;
+        std::vector<Event> events;
+    };
+
+    std::string ToUtf8(std::wstring_view str);
+    std::wstring FromUtf8(std::string_view str);
+    bool Load(const char* path, Trace& out, std::string& error);
+
+    /**
+     * Appends records to a trace file, safe to call from any thread
+     */
+    class Writer
+    {
+    public:
+        ~Writer();
+
+        bool open(const char* path);
+        void close();
+
+        bool isOpen() const
+        {
+            return file != nullptr;
+        }
+
+        void overlayEntry(std::wstring_view path, std::wstring_view target);
+        void createFile(uint32_t thread, uint64_t ns, FileHandle handle, const wchar_t* path, uint32_t access,
+                        uint32_t share, uint32_t disposition, uint32_t flags, bool redirected);
+        void readFile(uint32_t thread, uint64_t ns, FileHandle handle, uint32_t size, uint32_t read, bool ok);
+        void setFilePointer(uint32_t thread, uint64_t ns, FileHandle handle, int64_t distance, uint32_t method,
+                            int64_t result, bool ok);
+        void closeFile(uint32_t thread, uint64_t ns, FileHandle handle, bool ok);
+
+    private:
+        FILE* file = nullptr;
+        std::mutex mutex;
+    };
+}
+
+#endif //OMORI_PATCHER_OVERLAYTRACE_H
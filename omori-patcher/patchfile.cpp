@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <cstring>
+#include <emmintrin.h>
+#include "patchfile.h"
+
+namespace PatchFile
+{
+    struct PatchByte
+    {
+        uint64_t rva;
+        uint8_t original;
+        uint8_t patched;
+        size_t line;
+    };
+
+    bool parseHex(std::string_view text, size_t start, size_t end, uint64_t& out)
+    {
+        if (start >= end || end - start > 16) return false;
+        out = 0;
+        for (size_t i = start; i < end; i++)
+        {
+            char c = text[i];
+            int digit;
+            if (c >= '0' && c <= '9') digit = c - '0';
+            else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+            else return false;
+            out = out << 4 | digit;
+        }
+        return true;
+    }
+
+    /**
+     * Parses an x64dbg patch file: a ">module.exe" line followed by "OFFSET:OLD->NEW" lines, one per byte.
+     * Bytes at consecutive offsets are merged into runs
+     * @param text Contents of the .1337 file
+     * @param out Parsed patches, runs sorted by offset
+     * @param error Why parsing failed
+     * @return false if the file is malformed or patches the same byte twice
+     */
+    bool Parse(std::string_view text, PatchSet& out, std::string& error)
+    {
+        out.module.clear();
+        out.runs.clear();
+        std::vector<PatchByte> bytes;
+
+        size_t lineNo = 0;
+        for (size_t pos = 0; pos < text.size();)
+        {
+            size_t end = text.find('\n', pos);
+            if (end == std::string_view::npos) end = text.size();
+            size_t next = end + 1;
+            lineNo++;
+            while (end > pos && (text[end - 1] == '\r' || text[end - 1] == ' ' || text[end - 1] == '\t')) end--;
+            while (pos < end && (text[pos] == ' ' || text[pos] == '\t')) pos++;
+
+            if (pos == end || text[pos] == ';' || text[pos] == '#')
+            {
+                pos = next;
+                continue;
+            }
+            if (text[pos] == '>')
+            {
+                out.module = std::string(text.substr(pos + 1, end - pos - 1));
+                std::transform(out.module.begin(), out.module.end(), out.module.begin(), ::tolower);
+                pos = next;
+                continue;
+            }
+
+            size_t colon = text.find(':', pos);
+            size_t arrow = text.find("->", pos);
+            uint64_t rva, original, patched;
+            if (colon >= end || arrow >= end || arrow < colon || !parseHex(text, pos, colon, rva) ||
+                !parseHex(text, colon + 1, arrow, original) || !parseHex(text, arrow + 2, end, patched) ||
+                original > 0xFF || patched > 0xFF)
+            {
+                error = "line " + std::to_string(lineNo) + ": expected OFFSET:OLD->NEW";
+                return false;
+            }
+            bytes.push_back({rva, (uint8_t) original, (uint8_t) patched, lineNo});
+            pos = next;
+        }
+
+        if (out.module.empty())
+        {
+            error = "missing >module line";
+            return false;
+        }
+
+        std::stable_sort(bytes.begin(), bytes.end(), [](const PatchByte& a, const PatchByte& b)
+        {
+            return a.rva < b.rva;
+        });
+        for (const PatchByte& byte : bytes)
+        {
+            if (!out.runs.empty())
+            {
+                PatchRun& run = out.runs.back();
+                uint64_t runEnd = run.rva + run.patched.size();
+                if (byte.rva < runEnd)
+                {
+                    error = "line " + std::to_string(byte.line) + ": offset patched more than once";
+                    return false;
+                }
+                if (byte.rva == runEnd)
+                {
+                    run.original.push_back(byte.original);
+                    run.patched.push_back(byte.patched);
+                    continue;
+                }
+            }
+            out.runs.push_back({byte.rva, {byte.original}, {byte.patched}});
+        }
+        return true;
+    }
+
+    bool equal(const uint8_t* a, const uint8_t* b, size_t len)
+    {
+        size_t i = 0;
+        for (; i + 16 <= len; i += 16)
+        {
+            __m128i va = _mm_loadu_si128((const __m128i*) (a + i));
+            __m128i vb = _mm_loadu_si128((const __m128i*) (b + i));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) != 0xFFFF) return false;
+        }
+        return memcmp(a + i, b + i, len - i) == 0;
+    }
+
+    /**
+     * Compares the bytes currently in memory against a run
+     * @param current Memory the run applies to
+     * @param run Run to check
+     * @return Whether the run can be applied, was already applied, or the memory holds something else
+     */
+    PatchState Check(const uint8_t* current, const PatchRun& run)
+    {
+        size_t len = run.original.size();
+        if (equal(current, run.original.data(), len)) return PATCH_APPLICABLE;
+        if (equal(current, run.patched.data(), len)) return PATCH_ALREADY_APPLIED;
+        return PATCH_MISMATCH;
+    }
+}
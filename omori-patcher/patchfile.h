@@ -0,0 +1,39 @@
+#ifndef OMORI_PATCHER_PATCHFILE_H
+#define OMORI_PATCHER_PATCHFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Consecutive bytes patched by a .1337 file
+struct PatchRun
+{
+    // Offset from the module base
+    uint64_t rva;
+    std::vector<uint8_t> original;
+    std::vector<uint8_t> patched;
+};
+
+struct PatchSet
+{
+    // Module the offsets are relative to, lowercase as x64dbg writes it
+    std::string module;
+    std::vector<PatchRun> runs;
+};
+
+enum PatchState
+{
+    PATCH_APPLICABLE,
+    PATCH_ALREADY_APPLIED,
+    PATCH_MISMATCH
+};
+
+namespace PatchFile
+{
+    bool Parse(std::string_view text, PatchSet& out, std::string& error);
+    PatchState Check(const uint8_t* current, const PatchRun& run);
+}
+
+#endif //OMORI_PATCHER_PATCHFILE_H
@@ -0,0 +1,237 @@
+#include <cstdio>
+#include <cstring>
+#include <cwctype>
+#include "prefetch.h"
+#include "mappedfile.h"
+#include "overlaytrace.h"
+
+static const char* HEADER = "# omori-patcher access profile 1";
+
+/**
+ * @param engine Overlay the files are opened through and warmed by
+ * @param includeBase Whether files no mod replaces are recorded and warmed too
+ * @param maxFilesPerScene Files recorded per scene, the ones opened first are kept
+ */
+Prefetcher::Prefetcher(OverlayEngine& engine, bool includeBase, size_t maxFilesPerScene)
+        : engine(engine), includeBase(includeBase), maxFilesPerScene(maxFilesPerScene)
+{
+}
+
+Prefetcher::~Prefetcher()
+{
+    {
+        std::lock_guard lock(queueMutex);
+        stopping = true;
+    }
+    queueReady.notify_one();
+    if (worker.joinable()) worker.join();
+}
+
+/**
+ * Reads the profile recorded by a previous run
+ * @param path Profile to read
+ * @param error Why it couldn't be read
+ * @return false if the file is missing or isn't a profile
+ */
+bool Prefetcher::load(const char* path, std::string& error)
+{
+    MappedFile file;
+    if (!file.open(path))
+    {
+        error = std::string("failed to open ") + path;
+        return false;
+    }
+    std::string_view text(file.data(), file.size());
+    if (text.compare(0, strlen(HEADER), HEADER) != 0)
+    {
+        error = "not an access profile";
+        return false;
+    }
+
+    std::vector<std::wstring>* files = nullptr;
+    for (size_t pos = 0; pos < text.size();)
+    {
+        size_t end = text.find('\n', pos);
+        if (end == std::string_view::npos) end = text.size();
+        std::string_view line = text.substr(pos, end - pos);
+        pos = end + 1;
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        if (line.size() < 2 || line[0] == '#' || line[1] != '\t') continue;
+
+        std::wstring value = OverlayTrace::FromUtf8(line.substr(2));
+        if (line[0] == 'S') files = &profile[value];
+        else if (line[0] == 'F' && files != nullptr) files->push_back(std::move(value));
+    }
+    return true;
+}
+
+/**
+ * Writes this run's scenes over the loaded profile, scenes that weren't visited keep their previous order.
+ * Runs when the game exits, a thread killed while recording leaves its lock taken and the profile isn't written
+ * @param path Profile to write
+ * @return Whether the profile was written
+ */
+bool Prefetcher::save(const char* path)
+{
+    std::unique_lock lock(recordMutex, std::try_to_lock);
+    if (!lock.owns_lock()) return false;
+    Profile merged = profile;
+    for (const auto& [name, files] : recorded) merged[name] = files;
+    lock.unlock();
+
+#ifdef _WIN32
+    FILE* file = nullptr;
+    if (fopen_s(&file, path, "wb") != 0) file = nullptr;
+#else
+    FILE* file = fopen(path, "wb");
+#endif
+    if (file == nullptr) return false;
+    fprintf(file, "%s\n", HEADER);
+    for (const auto& [name, files] : merged)
+    {
+        fprintf(file, "S\t%s\n", OverlayTrace::ToUtf8(name).c_str());
+        for (const std::wstring& path : files) fprintf(file, "F\t%s\n", OverlayTrace::ToUtf8(path).c_str());
+    }
+    return fclose(file) == 0;
+}
+
+/**
+ * Starts warming files, the title scene's right away and every other scene's once its map is opened. Has to be
+ * called after the overlay is frozen
+ */
+void Prefetcher::start()
+{
+    {
+        std::lock_guard lock(queueMutex);
+        if (started || profile.empty()) return;
+        started = true;
+    }
+    worker = std::thread([this]() { run(); });
+    prefetch(L"", L"");
+}
+
+/**
+ * Records a file the first time it's opened in a scene, and counts whether the prefetch got to it first
+ */
+void Prefetcher::opened(std::wstring_view absolute, bool redirected)
+{
+    bool sceneStart = isSceneStart(absolute);
+    if (!sceneStart && !redirected && !includeBase) return;
+    std::wstring path(absolute);
+    {
+        std::lock_guard lock(queueMutex);
+        auto it = states.find(path);
+        if (it != states.end())
+        {
+            if (it->second == STATE_WARMED) used++;
+            else late++;
+            states.erase(it);
+        }
+    }
+
+    if (sceneStart)
+    {
+        {
+            std::lock_guard lock(recordMutex);
+            scene = path;
+            seenInScene.clear();
+            // Only the first visit is recorded, on later ones the files are usually still in memory
+            recordingScene = !recorded.contains(scene);
+            if (recordingScene) recorded[scene];
+        }
+        scenes++;
+        prefetch(path, path);
+        return;
+    }
+
+    std::lock_guard lock(recordMutex);
+    if (!recordingScene) return;
+    std::vector<std::wstring>& files = recorded[scene];
+    if (files.size() < maxFilesPerScene && seenInScene.insert(path).second) files.push_back(std::move(path));
+}
+
+Prefetcher::Stats Prefetcher::stats() const
+{
+    return {scenes.load(), queued.load(), warmed.load(), warmedBytes.load(), used.load(), late.load(), dropped.load()};
+}
+
+/**
+ * Whether opening a file starts a scene: an RPG Maker map, data\Map followed by digits and .json
+ */
+bool Prefetcher::isSceneStart(std::wstring_view absolute)
+{
+    size_t slash = absolute.find_last_of(L"\\/");
+    if (slash == std::wstring_view::npos || slash < 5) return false;
+    std::wstring_view name = absolute.substr(slash + 1);
+    std::wstring_view dir = absolute.substr(slash - 5, 5);
+    auto equals = [](std::wstring_view a, std::wstring_view b) {
+        if (a.size() != b.size()) return false;
+        for (size_t i = 0; i < a.size(); i++)
+        {
+            if ((wchar_t) towlower(a[i]) != b[i]) return false;
+        }
+        return true;
+    };
+    if (!equals(dir.substr(1), L"data") || (dir[0] != L'\\' && dir[0] != L'/')) return false;
+    if (name.size() <= 8 || !equals(name.substr(0, 3), L"map") || !equals(name.substr(name.size() - 5), L".json"))
+    {
+        return false;
+    }
+    for (wchar_t c : name.substr(3, name.size() - 8))
+    {
+        if (c < L'0' || c > L'9') return false;
+    }
+    return true;
+}
+
+/**
+ * Queues the files a scene opened last time, whatever the previous scene didn't get to is dropped
+ * @param name Scene to prefetch
+ * @param skip File the game is opening right now
+ */
+void Prefetcher::prefetch(const std::wstring& name, std::wstring_view skip)
+{
+    auto it = profile.find(name);
+    std::lock_guard lock(queueMutex);
+    if (!started) return;
+    for (const std::wstring& path : queue)
+    {
+        auto state = states.find(path);
+        if (state == states.end() || state->second != STATE_QUEUED) continue;
+        states.erase(state);
+        dropped++;
+    }
+    queue.clear();
+    if (it == profile.end()) return;
+    for (const std::wstring& path : it->second)
+    {
+        if (path == skip || !states.emplace(path, STATE_QUEUED).second) continue;
+        queue.push_back(path);
+        queued++;
+    }
+    queueReady.notify_one();
+}
+
+void Prefetcher::run()
+{
+    std::unique_lock lock(queueMutex);
+    while (true)
+    {
+        queueReady.wait(lock, [this]() { return stopping || !queue.empty(); });
+        if (stopping) return;
+        std::wstring path = std::move(queue.front());
+        queue.pop_front();
+        auto state = states.find(path);
+        // Opened by the game since it was queued
+        if (state == states.end() || state->second != STATE_QUEUED) continue;
+
+        lock.unlock();
+        uint64_t bytes = engine.warm(path);
+        lock.lock();
+        state = states.find(path);
+        if (state == states.end() || state->second != STATE_QUEUED) continue;
+        state->second = STATE_WARMED;
+        warmed++;
+        warmedBytes += bytes;
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef OMORI_PATCHER_PREFETCH_H
+#define OMORI_PATCHER_PREFETCH_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "overlay.h"
+
+/**
+ * Records the order files are first opened in, grouped by scene, and on later runs reads a scene's files in the
+ * background as soon as the scene starts loading. A scene starts when the game opens a map, data\Map*.json, files
+ * opened before the first map belong to the title scene, which is prefetched on start
+ */
+class Prefetcher : public OpenListener
+{
+public:
+    struct Stats
+    {
+        uint64_t scenes;
+        uint64_t queued;
+        uint64_t warmed;
+        uint64_t warmedBytes;
+        // Warmed files the game then opened
+        uint64_t used;
+        // Files the game opened before they were warmed
+        uint64_t late;
+        // Files left in the queue when the next scene started
+        uint64_t dropped;
+    };
+
+    Prefetcher(OverlayEngine& engine, bool includeBase, size_t maxFilesPerScene);
+    ~Prefetcher();
+
+    Prefetcher(const Prefetcher&) = delete;
+    Prefetcher& operator=(const Prefetcher&) = delete;
+
+    bool load(const char* path, std::string& error);
+    bool save(const char* path);
+    void start();
+    void opened(std::wstring_view absolute, bool redirected) override;
+    Stats stats() const;
+
+private:
+    typedef std::map<std::wstring, std::vector<std::wstring>> Profile;
+
+    enum State
+    {
+        STATE_QUEUED,
+        STATE_WARMED
+    };
+
+    OverlayEngine& engine;
+    bool includeBase;
+    size_t maxFilesPerScene;
+
+    // The previous run's profile, read-only once loaded
+    Profile profile;
+
+    std::mutex recordMutex;
+    Profile recorded;
+    std::wstring scene;
+    std::unordered_set<std::wstring> seenInScene;
+    bool recordingScene = true;
+
+    std::mutex queueMutex;
+    std::condition_variable queueReady;
+    std::deque<std::wstring> queue;
+    std::unordered_map<std::wstring, State> states;
+    bool started = false;
+    bool stopping = false;
+    std::thread worker;
+
+    std::atomic<uint64_t> scenes = 0;
+    std::atomic<uint64_t> queued = 0;
+    std::atomic<uint64_t> warmed = 0;
+    std::atomic<uint64_t> warmedBytes = 0;
+    std::atomic<uint64_t> used = 0;
+    std::atomic<uint64_t> late = 0;
+    std::atomic<uint64_t> dropped = 0;
+
+    static bool isSceneStart(std::wstring_view absolute);
+    void prefetch(const std::wstring& scene, std::wstring_view skip);
+    void run();
+};
+
+#endif //OMORI_PATCHER_PREFETCH_H
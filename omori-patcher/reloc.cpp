@@ -0,0 +1,133 @@
+#include <cstring>
+#include "decode.h"
+#include "reloc.h"
+
+namespace Reloc
+{
+    void emit(std::vector<uint8_t>& code, const void* data, size_t len)
+    {
+        code.insert(code.end(), (const uint8_t*) data, (const uint8_t*) data + len);
+    }
+
+    /**
+     * Emits jmp qword ptr [rip+0] followed by the target, reaches any address
+     */
+    void emitAbsJmp(std::vector<uint8_t>& code, uint64_t target)
+    {
+        const uint8_t jmp[] = {0xFF, 0x25, 0x00, 0x00, 0x00, 0x00};
+        emit(code, jmp, sizeof(jmp));
+        emit(code, &target, sizeof(target));
+    }
+
+    /**
+     * Emits call qword ptr [rip+2], a short jmp over the target, and the target
+     */
+    void emitAbsCall(std::vector<uint8_t>& code, uint64_t target)
+    {
+        const uint8_t call[] = {0xFF, 0x15, 0x02, 0x00, 0x00, 0x00, 0xEB, 0x08};
+        emit(code, call, sizeof(call));
+        emit(code, &target, sizeof(target));
+    }
+
+    /**
+     * Copies instructions from the start of src until at least minLen bytes are covered, fixing up rip relative
+     * operands and relative branches for their new location, and appends a jump back to the original code
+     * @param src Code to relocate
+     * @param srcAddr Runtime address of src
+     * @param srcAvailable Bytes readable at src
+     * @param minLen Minimum amount of bytes to relocate
+     * @param dstAddr Runtime address the relocated code will be placed at
+     * @param out Relocated code
+     * @return false if the code can't be relocated
+     */
+    bool Relocate(const uint8_t* src, uint64_t srcAddr, size_t srcAvailable, size_t minLen, uint64_t dstAddr,
+                  Relocation& out)
+    {
+        out.code.clear();
+        out.offsets.clear();
+        out.error = nullptr;
+        std::vector<InsnInfo> insns;
+        if (!Decode::Window(src, srcAddr, srcAvailable, minLen, insns))
+        {
+            out.error = "failed to decode instruction";
+            return false;
+        }
+
+        size_t offset = 0;
+        for (const InsnInfo& insn : insns)
+        {
+            uint64_t newAddr = dstAddr + out.code.size();
+            bool lastInsn = offset + insn.length >= minLen;
+            out.offsets.emplace_back(offset, out.code.size());
+
+            if (!lastInsn && insn.terminator)
+            {
+                out.error = "function is too short to hook";
+                return false;
+            }
+
+            if (insn.relative)
+            {
+                uint64_t target = insn.target;
+                if (target > srcAddr && target < srcAddr + minLen)
+                {
+                    out.error = "branch jumps into the relocated code";
+                    return false;
+                }
+
+                if (insn.mnemonic == ZYDIS_MNEMONIC_JMP)
+                {
+                    emitAbsJmp(out.code, target);
+                }
+                else if (insn.mnemonic == ZYDIS_MNEMONIC_CALL)
+                {
+                    emitAbsCall(out.code, target);
+                }
+                else if (insn.mnemonic == ZYDIS_MNEMONIC_JRCXZ || insn.mnemonic == ZYDIS_MNEMONIC_JECXZ ||
+                         insn.mnemonic == ZYDIS_MNEMONIC_LOOP || insn.mnemonic == ZYDIS_MNEMONIC_LOOPE ||
+                         insn.mnemonic == ZYDIS_MNEMONIC_LOOPNE)
+                {
+                    // Only have a rel8 form, branch over a short jmp to an absolute jmp
+                    emit(out.code, src + offset, insn.length - 1);
+                    const uint8_t rest[] = {0x02, 0xEB, 0x0E};
+                    emit(out.code, rest, sizeof(rest));
+                    emitAbsJmp(out.code, target);
+                }
+                else if (insn.category == ZYDIS_CATEGORY_COND_BR)
+                {
+                    // jcc rel8/rel32 -> inverted jcc over an absolute jmp
+                    uint8_t condition = insn.opcode & 0x0F;
+                    const uint8_t skip[] = {(uint8_t) (0x70 | (condition ^ 1)), 0x0E};
+                    emit(out.code, skip, sizeof(skip));
+                    emitAbsJmp(out.code, target);
+                }
+                else
+                {
+                    out.error = "unsupported relative instruction";
+                    return false;
+                }
+            }
+            else
+            {
+                size_t start = out.code.size();
+                emit(out.code, src + offset, insn.length);
+                if (insn.ripRelative)
+                {
+                    int64_t disp = (int64_t) (insn.ripTarget - (newAddr + insn.length));
+                    if (insn.dispSize != 32 || disp != (int32_t) disp)
+                    {
+                        out.error = "rip relative operand out of range";
+                        return false;
+                    }
+                    auto disp32 = (int32_t) disp;
+                    memcpy(out.code.data() + start + insn.dispOffset, &disp32, sizeof(disp32));
+                }
+            }
+            offset += insn.length;
+        }
+
+        out.sourceLen = offset;
+        emitAbsJmp(out.code, srcAddr + offset);
+        return true;
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef OMORI_PATCHER_RELOC_H
+#define OMORI_PATCHER_RELOC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+struct Relocation
+{
+    // Relocated instructions followed by a jump back to the first instruction that wasn't relocated
+    std::vector<uint8_t> code;
+    // Bytes of original code the relocated instructions cover
+    size_t sourceLen;
+    // Start offset of every relocated instruction, original -> relocated
+    std::vector<std::pair<size_t, size_t>> offsets;
+    // Why relocation failed
+    const char* error;
+};
+
+namespace Reloc
+{
+    bool Relocate(const uint8_t* src, uint64_t srcAddr, size_t srcAvailable, size_t minLen, uint64_t dstAddr,
+                  Relocation& out);
+}
+
+#endif //OMORI_PATCHER_RELOC_H
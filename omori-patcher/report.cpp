@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <json/json.h>
+#include "utils.h"
+#include <psapi.h>
+#include "arena.h"
+#include "config.h"
+#include "report.h"
+
+namespace Report
+{
+    std::map<std::string, ModCost> costs;
+    std::mutex costsMutex;
+
+    /**
+     * Gets the startup cost entry of a mod, creating it if needed
+     * @param modDir Directory name of the mod
+     * @return Cost entry, stays valid for the lifetime of the process
+     */
+    ModCost& For(const std::string& modDir)
+    {
+        std::lock_guard<std::mutex> lock(costsMutex);
+        return costs[modDir];
+    }
+
+    /**
+     * Samples the memory of the process once loading is done, the working set peak covers the whole load
+     */
+    Json::Value memoryUsage()
+    {
+        PROCESS_MEMORY_COUNTERS_EX counters{};
+        counters.cb = sizeof(counters);
+        GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*) &counters, sizeof(counters));
+
+        Json::Value memory;
+        memory["peakWorkingSetBytes"] = (Json::UInt64) counters.PeakWorkingSetSize;
+        memory["workingSetBytes"] = (Json::UInt64) counters.WorkingSetSize;
+        memory["peakPrivateBytes"] = (Json::UInt64) counters.PeakPagefileUsage;
+        memory["privateBytes"] = (Json::UInt64) counters.PrivateUsage;
+        memory["arenaPeakBytes"] = (Json::UInt64) Arena::peakBytes();
+        memory["arenaHeldBytes"] = (Json::UInt64) Arena::totalBytes();
+        return memory;
+    }
+
+    /**
+     * Writes the per-mod startup cost report as JSON and prints a summary sorted by total time
+     */
+    void Write()
+    {
+        const Json::Value& config = Config::Section("report");
+        auto output = config.get("output", "omori-patcher-report.json").asString();
+        double warnParseMs = config.get("warnParseMs", 0.0).asDouble();
+        double warnEvalMs = config.get("warnEvalMs", 0.0).asDouble();
+        auto warnHeapBytes = config.get("warnHeapBytes", 0).asInt64();
+        auto warnFiles = config.get("warnFiles", 0).asUInt64();
+
+        std::vector<std::pair<std::string, ModCost>> sorted;
+        {
+            std::lock_guard<std::mutex> lock(costsMutex);
+            sorted.assign(costs.begin(), costs.end());
+        }
+        std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) {
+            return a.second.parseMs + a.second.overlayMs + a.second.evalMs >
+                   b.second.parseMs + b.second.overlayMs + b.second.evalMs;
+        });
+
+        Json::Value root(Json::objectValue);
+        Json::Value& modsJson = root["mods"] = Json::Value(Json::arrayValue);
+        for (const auto& [modDir, cost] : sorted)
+        {
+            Json::Value entry;
+            entry["dir"] = modDir;
+            entry["id"] = cost.id;
+            entry["parseMs"] = cost.parseMs;
+            entry["overlayMs"] = cost.overlayMs;
+            entry["filesScanned"] = (Json::UInt64) cost.filesScanned;
+            entry["overlayEntries"] = (Json::UInt64) cost.overlayEntries;
+            entry["scriptBytes"] = (Json::UInt64) cost.scriptBytes;
+            entry["evalMs"] = cost.evalMs;
+            entry["heapBytes"] = (Json::Int64) cost.heapBytes;
+            modsJson.append(entry);
+        }
+        const Json::Value& memory = root["memory"] = memoryUsage();
+
+        std::ofstream file(output);
+        if (file)
+        {
+            Json::StreamWriterBuilder builder;
+            builder["indentation"] = "  ";
+            file << Json::writeString(builder, root) << std::endl;
+        }
+        else
+        {
+            Utils::Errorf("[report] Failed to open %s for writing", output.c_str());
+        }
+
+        Utils::Info("[report] mod startup cost (slowest first):");
+        Utils::Info("[report]    total ms    parse ms  overlay ms     eval ms   files overlay  script bytes    heap bytes  mod");
+        for (const auto& [modDir, cost] : sorted)
+        {
+            Utils::Infof("[report] %11.2f %11.2f %11.2f %11.2f %7zu %7zu %13zu %13lld  %s",
+                         cost.parseMs + cost.overlayMs + cost.evalMs, cost.parseMs, cost.overlayMs, cost.evalMs, cost.filesScanned, cost.overlayEntries, cost.scriptBytes,
+                         cost.heapBytes, modDir.c_str());
+
+            if (warnParseMs > 0 && cost.parseMs > warnParseMs)
+                Utils::Warnf("[report] %s took %.2f ms to parse (threshold %.2f ms)", modDir.c_str(), cost.parseMs, warnParseMs);
+            if (warnEvalMs > 0 && cost.evalMs > warnEvalMs)
+                Utils::Warnf("[report] %s took %.2f ms to run (threshold %.2f ms)", modDir.c_str(), cost.evalMs, warnEvalMs);
+            if (warnHeapBytes > 0 && cost.heapBytes > warnHeapBytes)
+                Utils::Warnf("[report] %s grew the javascript heap by %lld bytes (threshold %lld)", modDir.c_str(),
+                             cost.heapBytes, (long long) warnHeapBytes);
+            if (warnFiles > 0 && cost.filesScanned > warnFiles)
+                Utils::Warnf("[report] %s scanned %zu files (threshold %llu)", modDir.c_str(), cost.filesScanned,
+                             (unsigned long long) warnFiles);
+        }
+        Utils::Infof("[report] memory: %.1f MB peak / %.1f MB steady working set, %.1f MB peak / %.1f MB steady private, "
+                     "load arenas peaked at %.1f KB with %.1f KB still held",
+                     memory["peakWorkingSetBytes"].asDouble() / 1048576, memory["workingSetBytes"].asDouble() / 1048576,
+                     memory["peakPrivateBytes"].asDouble() / 1048576, memory["privateBytes"].asDouble() / 1048576,
+                     memory["arenaPeakBytes"].asDouble() / 1024, memory["arenaHeldBytes"].asDouble() / 1024);
+        Utils::Infof("[report] Written to %s", output.c_str());
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef OMORI_PATCHER_REPORT_H
+#define OMORI_PATCHER_REPORT_H
+
+#include <chrono>
+#include <string>
+
+struct ModCost
+{
+    std::string id;
+    double parseMs;
+    double overlayMs;
+    size_t filesScanned;
+    size_t overlayEntries;
+    size_t scriptBytes;
+    double evalMs;
+    long long heapBytes;
+};
+
+namespace Report
+{
+    inline double NowMs()
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    ModCost& For(const std::string& modDir);
+    void Write();
+}
+
+#endif //OMORI_PATCHER_REPORT_H
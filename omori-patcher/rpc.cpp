@@ -1,7 +1,10 @@
 #include "rpc.h"
 #include "utils.h"
 #include "js.h"
+#include "modules.h"
+#include "hookstats.h"
 #include <json/json.h>
+#include <cstring>
 #include <string>
 
 using std::string;
@@ -17,6 +20,8 @@ namespace rpc
         HOOK_REPLACE,
         HOOK_POST,
         HOOK_COMMIT,
+        REQUIRE,
+        HOOK_STATS,
     };
 
     void hookState(js::JSHookType type, const string& name, const string& hookName)
@@ -78,6 +83,12 @@ namespace rpc
             case HOOK_COMMIT:
                 hookCommit(value["name"].asString());
                 break;
+            case REQUIRE:
+                Modules::Require(value["spec"].asString(), value["dir"].asString());
+                break;
+            case HOOK_STATS:
+                HookStats::Dump();
+                break;
             default:
                 Utils::Warnf("Unknown function id: %d, ignoring", funcId);
                 break;
@@ -86,12 +97,18 @@ namespace rpc
 
     void ParseMessage(const char* msg)
     {
-        auto str = Utils::ParseJson(msg);
-        auto func = str.get("func", Json::Value(0)).asInt();
+        int func;
+        Json::Value data;
+        string error;
+        if (!ParseEnvelope(msg, msg + strlen(msg), func, data, error))
+        {
+            Utils::Errorf("Failed to parse JSON: %s\n%s", msg, error.c_str());
+            return;
+        }
 
         if (func != 0)
         {
-            processMessage(func, str["data"]);
+            processMessage(func, data);
         }
     }
 }
\ No newline at end of file
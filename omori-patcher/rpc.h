@@ -1,9 +1,13 @@
 #ifndef OMORI_PATCHER_RPC_H
 #define OMORI_PATCHER_RPC_H
 
+#include <string>
+#include <json/json.h>
+
 namespace rpc
 {
     void ParseMessage(const char* msg);
+    bool ParseEnvelope(const char* begin, const char* end, int& func, Json::Value& data, std::string& error);
 }
 
 #endif //OMORI_PATCHER_RPC_H
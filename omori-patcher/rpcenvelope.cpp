@@ -0,0 +1,27 @@
+#include "rpc.h"
+#include "jsonreader.h"
+
+namespace rpc
+{
+    /**
+     * Splits a message from the game into its function id and arguments, kept apart from the handlers so it runs
+     * without the game
+     * @param begin Start of the message
+     * @param end End of the message
+     * @param func Function id, 0 if the message doesn't name one
+     * @param data Arguments of the function
+     * @param error Reason the message isn't valid JSON
+     * @return Whether the message could be parsed
+     */
+    bool ParseEnvelope(const char* begin, const char* end, int& func, Json::Value& data, std::string& error)
+    {
+        Json::Value root;
+        func = 0;
+        if (!JsonReader::Parse(begin, end, root, error)) return false;
+        if (!root.isObject()) return true;
+        const Json::Value& id = root["func"];
+        if (id.isInt()) func = id.asInt();
+        data = std::move(root["data"]);
+        return true;
+    }
+}
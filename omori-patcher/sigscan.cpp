@@ -0,0 +1,255 @@
+#include <cstring>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include "sigscan.h"
+
+// MSVC accepts AVX2 intrinsics in any function, GCC and Clang need them enabled per function
+#if defined(__GNUC__) || defined(__clang__)
+#define SIGSCAN_AVX2 __attribute__((target("avx2")))
+#else
+#define SIGSCAN_AVX2
+#endif
+
+namespace SigScan
+{
+    inline unsigned lowestBit(uint32_t bits)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, bits);
+        return index;
+#else
+        return __builtin_ctz(bits);
+#endif
+    }
+
+    int hexDigit(char c)
+    {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    /**
+     * Parses a pattern like "48 8B 05 ?? ?? ?? ?? C3", ? and ?? are wildcards
+     * @param text Pattern text
+     * @param out Parsed pattern
+     * @return false if the text isn't a valid pattern or has no fixed bytes
+     */
+    bool Parse(const std::string& text, Pattern& out)
+    {
+        out.bytes.clear();
+        out.mask.clear();
+        bool anyFixed = false;
+        for (size_t i = 0; i < text.size();)
+        {
+            if (text[i] == ' ')
+            {
+                i++;
+                continue;
+            }
+            if (text[i] == '?')
+            {
+                out.bytes.push_back(0);
+                out.mask.push_back(0x00);
+                i += i + 1 < text.size() && text[i + 1] == '?' ? 2 : 1;
+                continue;
+            }
+            if (i + 1 >= text.size() || hexDigit(text[i]) < 0 || hexDigit(text[i + 1]) < 0) return false;
+            out.bytes.push_back((uint8_t) (hexDigit(text[i]) << 4 | hexDigit(text[i + 1])));
+            out.mask.push_back(0xFF);
+            anyFixed = true;
+            i += 2;
+        }
+        return anyFixed;
+    }
+
+    /**
+     * Formats a pattern back into its text form
+     */
+    std::string Format(const Pattern& pattern)
+    {
+        static const char digits[] = "0123456789ABCDEF";
+        std::string text;
+        for (size_t i = 0; i < pattern.bytes.size(); i++)
+        {
+            if (i > 0) text += ' ';
+            if (pattern.mask[i] == 0x00)
+            {
+                text += "??";
+                continue;
+            }
+            text += digits[pattern.bytes[i] >> 4];
+            text += digits[pattern.bytes[i] & 0xF];
+        }
+        return text;
+    }
+
+    bool matches(const uint8_t* at, const Pattern& pattern)
+    {
+        for (size_t i = 0; i < pattern.bytes.size(); i++)
+        {
+            if ((at[i] & pattern.mask[i]) != pattern.bytes[i]) return false;
+        }
+        return true;
+    }
+
+    // Candidates are filtered on the first and last fixed byte before the whole pattern is compared
+    struct Anchors
+    {
+        size_t first;
+        size_t last;
+    };
+
+    Anchors anchorsOf(const Pattern& pattern)
+    {
+        Anchors anchors{0, 0};
+        while (pattern.mask[anchors.first] == 0x00) anchors.first++;
+        anchors.last = pattern.bytes.size() - 1;
+        while (pattern.mask[anchors.last] == 0x00) anchors.last--;
+        return anchors;
+    }
+
+    template<typename OnMatch>
+    void scanScalar(const uint8_t* data, size_t end, size_t start, const Pattern& pattern, Anchors anchors,
+                    OnMatch& onMatch)
+    {
+        uint8_t first = pattern.bytes[anchors.first];
+        for (size_t pos = start; pos < end;)
+        {
+            auto hit = (const uint8_t*) memchr(data + pos + anchors.first, first, end - pos);
+            if (hit == nullptr) return;
+            pos = hit - data - anchors.first;
+            if (matches(data + pos, pattern) && !onMatch(data + pos)) return;
+            pos++;
+        }
+    }
+
+    template<typename OnMatch>
+    size_t scanSse2(const uint8_t* data, size_t end, const Pattern& pattern, Anchors anchors, OnMatch& onMatch)
+    {
+        __m128i first = _mm_set1_epi8((char) pattern.bytes[anchors.first]);
+        __m128i last = _mm_set1_epi8((char) pattern.bytes[anchors.last]);
+        size_t pos = 0;
+        for (; pos + 16 <= end; pos += 16)
+        {
+            __m128i a = _mm_loadu_si128((const __m128i*) (data + pos + anchors.first));
+            __m128i b = _mm_loadu_si128((const __m128i*) (data + pos + anchors.last));
+            auto bits = (uint32_t) _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+            while (bits != 0)
+            {
+                size_t candidate = pos + lowestBit(bits);
+                if (matches(data + candidate, pattern) && !onMatch(data + candidate)) return SIZE_MAX;
+                bits &= bits - 1;
+            }
+        }
+        return pos;
+    }
+
+    template<typename OnMatch>
+    SIGSCAN_AVX2 size_t scanAvx2(const uint8_t* data, size_t end, const Pattern& pattern, Anchors anchors,
+                                 OnMatch& onMatch)
+    {
+        __m256i first = _mm256_set1_epi8((char) pattern.bytes[anchors.first]);
+        __m256i last = _mm256_set1_epi8((char) pattern.bytes[anchors.last]);
+        size_t pos = 0;
+        for (; pos + 32 <= end; pos += 32)
+        {
+            __m256i a = _mm256_loadu_si256((const __m256i*) (data + pos + anchors.first));
+            __m256i b = _mm256_loadu_si256((const __m256i*) (data + pos + anchors.last));
+            auto bits = (uint32_t) _mm256_movemask_epi8(
+                    _mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+            while (bits != 0)
+            {
+                size_t candidate = pos + lowestBit(bits);
+                if (matches(data + candidate, pattern) && !onMatch(data + candidate)) return SIZE_MAX;
+                bits &= bits - 1;
+            }
+        }
+        return pos;
+    }
+
+    bool hasAvx2()
+    {
+        static const bool supported = []
+        {
+#ifdef _MSC_VER
+            int info[4];
+            __cpuid(info, 0);
+            if (info[0] < 7) return false;
+            __cpuid(info, 1);
+            // OSXSAVE and AVX, then the OS has to save the ymm registers
+            if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) return false;
+            if ((_xgetbv(0) & 6) != 6) return false;
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+#else
+            return __builtin_cpu_supports("avx2") != 0;
+#endif
+        }();
+        return supported;
+    }
+
+    /**
+     * Calls onMatch for every match in order until it returns false
+     */
+    template<typename OnMatch>
+    void scan(const uint8_t* data, size_t len, const Pattern& pattern, OnMatch onMatch)
+    {
+        if (pattern.bytes.empty() || len < pattern.bytes.size()) return;
+        Anchors anchors = anchorsOf(pattern);
+        // Every candidate position where the whole pattern still fits in data
+        size_t end = len - pattern.bytes.size() + 1;
+        size_t pos = hasAvx2() ? scanAvx2(data, end, pattern, anchors, onMatch)
+                               : scanSse2(data, end, pattern, anchors, onMatch);
+        if (pos == SIZE_MAX) return;
+        scanScalar(data, end, pos, pattern, anchors, onMatch);
+    }
+
+    /**
+     * Finds the first match of a pattern
+     * @param data Memory to scan
+     * @param len Length of data
+     * @param pattern Pattern to look for
+     * @return Start of the first match, nullptr if there's none
+     */
+    const uint8_t* Find(const uint8_t* data, size_t len, const Pattern& pattern)
+    {
+        const uint8_t* found = nullptr;
+        scan(data, len, pattern, [&](const uint8_t* match)
+        {
+            found = match;
+            return false;
+        });
+        return found;
+    }
+
+    /**
+     * Counts matches of a pattern
+     * @param data Memory to scan
+     * @param len Length of data
+     * @param pattern Pattern to look for
+     * @param limit Stop counting after this many matches
+     * @return Amount of matches, at most limit
+     */
+    size_t Count(const uint8_t* data, size_t len, const Pattern& pattern, size_t limit)
+    {
+        size_t count = 0;
+        scan(data, len, pattern, [&](const uint8_t*)
+        {
+            return ++count < limit;
+        });
+        return count;
+    }
+
+    /**
+     * Name of the vector instructions used for scanning on this CPU
+     */
+    const char* Backend()
+    {
+        return hasAvx2() ? "AVX2" : "SSE2";
+    }
+}
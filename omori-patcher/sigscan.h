@@ -0,0 +1,25 @@
+#ifndef OMORI_PATCHER_SIGSCAN_H
+#define OMORI_PATCHER_SIGSCAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct Pattern
+{
+    std::vector<uint8_t> bytes;
+    // 0xFF for bytes that have to match, 0x00 for wildcards
+    std::vector<uint8_t> mask;
+};
+
+namespace SigScan
+{
+    bool Parse(const std::string& text, Pattern& out);
+    std::string Format(const Pattern& pattern);
+    const uint8_t* Find(const uint8_t* data, size_t len, const Pattern& pattern);
+    size_t Count(const uint8_t* data, size_t len, const Pattern& pattern, size_t limit);
+    const char* Backend();
+}
+
+#endif //OMORI_PATCHER_SIGSCAN_H
@@ -0,0 +1,94 @@
+#include <atomic>
+#include <string>
+#include <thread>
+#include "startup.h"
+#include "config.h"
+#include "report.h"
+#include "trace.h"
+#include "utils.h"
+
+namespace Startup
+{
+    HANDLE readyEvent = nullptr;
+    std::atomic<bool> ready = false;
+    // Set after a wait timed out, nothing waits again once initialization is known to be stuck
+    std::atomic<bool> gaveUp = false;
+    // Set on the worker and the threads it hands work to, they'd otherwise wait for themselves
+    thread_local bool workerThread = false;
+    std::wstring gameDir;
+
+    /**
+     * Runs the part of the initialization the game doesn't need right away on a worker thread. The thread only starts
+     * once DllMain returns and the loader lock is released, so it overlaps with the game's own startup
+     * @param work Initialization to run
+     */
+    void Begin(std::function<void()> work)
+    {
+        wchar_t dir[MAX_PATH];
+        DWORD len = GetCurrentDirectoryW(MAX_PATH, dir);
+        gameDir.assign(dir, len);
+        readyEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+
+        std::thread([work]() {
+            MarkWorkerThread();
+            double start = Report::NowMs();
+            {
+                TRACE_SCOPE("Startup worker");
+                work();
+            }
+            ready.store(true, std::memory_order_release);
+            SetEvent(readyEvent);
+            Utils::Infof("[startup] Background initialization finished in %.1f ms", Report::NowMs() - start);
+        }).detach();
+    }
+
+    /**
+     * Marks the calling thread as part of the background initialization, needed on any thread the worker waits for
+     * that opens files in the game directory
+     */
+    void MarkWorkerThread()
+    {
+        workerThread = true;
+    }
+
+    bool IsReady()
+    {
+        return ready.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Blocks until the background initialization finished, or startup.waitTimeoutMs passed
+     * @param reason What needs the initialization, for the log
+     * @return false if the wait timed out or the caller is doing the initialization itself
+     */
+    bool WaitReady(const char* reason)
+    {
+        if (IsReady()) return true;
+        if (readyEvent == nullptr || gaveUp || workerThread) return false;
+
+        auto timeoutMs = Config::Section("startup").get("waitTimeoutMs", 30000).asUInt();
+        double start = Report::NowMs();
+        if (WaitForSingleObject(readyEvent, timeoutMs) != WAIT_OBJECT_0)
+        {
+            Utils::Warnf("[startup] Gave up waiting for mods at %s after %u ms", reason, timeoutMs);
+            gaveUp = true;
+            return false;
+        }
+        Utils::Infof("[startup] %s waited %.1f ms for mods", reason, Report::NowMs() - start);
+        return true;
+    }
+
+    /**
+     * Waits for the overlay before the first file in the game directory is opened, files elsewhere are never
+     * overlaid and don't wait
+     * @param fileName File about to be opened
+     */
+    void WaitForFile(LPCWSTR fileName)
+    {
+        if (IsReady() || fileName == nullptr) return;
+        const wchar_t* absolute = Utils::GetAbsolutePathW(fileName);
+        bool inGameDir = _wcsnicmp(absolute, gameDir.c_str(), gameDir.size()) == 0;
+        free((void*) absolute);
+        if (inGameDir) WaitReady("CreateFileW");
+    }
+}
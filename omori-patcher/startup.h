@@ -0,0 +1,16 @@
+#ifndef OMORI_PATCHER_STARTUP_H
+#define OMORI_PATCHER_STARTUP_H
+
+#include <functional>
+#include "pch.h"
+
+namespace Startup
+{
+    void Begin(std::function<void()> work);
+    void MarkWorkerThread();
+    bool IsReady();
+    bool WaitReady(const char* reason);
+    void WaitForFile(LPCWSTR fileName);
+}
+
+#endif //OMORI_PATCHER_STARTUP_H
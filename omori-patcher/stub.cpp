@@ -0,0 +1,22 @@
+#include <cstring>
+#include "stub.h"
+
+namespace Stub
+{
+    /**
+     * Copies a stub and fills in its addresses
+     * @param stub Stub to copy, must have been built without error
+     * @param hookFn Function the stub calls
+     * @param cbFn Callback asm the stub calls before the hook, ignored if the stub has no callback slot
+     * @param stats Counters the stub updates, ignored if the stub has no stats slot
+     * @param out Machine code of the stub
+     */
+    void Instantiate(const StubTemplate& stub, uint64_t hookFn, uint64_t cbFn, uint64_t stats,
+                     std::vector<uint8_t>& out)
+    {
+        out.assign(stub.code, stub.code + stub.size);
+        memcpy(out.data() + stub.hookSlot, &hookFn, sizeof(hookFn));
+        if (stub.callbackSlot != 0) memcpy(out.data() + stub.callbackSlot, &cbFn, sizeof(cbFn));
+        if (stub.statsSlot != 0) memcpy(out.data() + stub.statsSlot, &stats, sizeof(stats));
+    }
+}
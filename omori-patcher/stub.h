@@ -0,0 +1,378 @@
+#ifndef OMORI_PATCHER_STUB_H
+#define OMORI_PATCHER_STUB_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "hookstats.h"
+
+// General purpose registers in encoding order
+enum StubGp
+{
+    GP_RAX, GP_RCX, GP_RDX, GP_RBX, GP_RSP, GP_RBP, GP_RSI, GP_RDI,
+    GP_R8, GP_R9, GP_R10, GP_R11, GP_R12, GP_R13, GP_R14, GP_R15
+};
+
+struct StubSpec
+{
+    // Registers saved around the hook call, one bit per register
+    uint16_t gpMask;
+    uint16_t xmmMask;
+    bool saveFlags;
+    // Arguments past the fourth, copied from the hooked function's stack for the hook
+    uint8_t stackArgs;
+};
+
+namespace Stub
+{
+    // Everything the Win64 calling convention lets a call clobber, for hooks placed in the middle of a function
+    constexpr StubSpec volatileSpec = {
+            (1 << GP_RAX) | (1 << GP_RCX) | (1 << GP_RDX) | (1 << GP_R8) | (1 << GP_R9) | (1 << GP_R10) | (1 << GP_R11),
+            0b111111,
+            true,
+            0
+    };
+
+    template<typename T>
+    struct Signature;
+
+    /**
+     * Derives the registers a function entry hook has to preserve from the hook's signature, only the argument
+     * registers are live at a function entry, everything else is either dead or preserved by the hook itself
+     */
+    template<typename R, typename... Args>
+    struct Signature<R(*)(Args...)>
+    {
+        static constexpr StubSpec spec()
+        {
+            constexpr bool floating[] = {std::is_floating_point_v<Args>..., false};
+            constexpr StubGp argRegs[] = {GP_RCX, GP_RDX, GP_R8, GP_R9};
+            StubSpec spec = {0, 0, false, sizeof...(Args) > 4 ? (uint8_t) (sizeof...(Args) - 4) : (uint8_t) 0};
+            for (std::size_t i = 0; i < sizeof...(Args) && i < 4; i++)
+            {
+                if (floating[i]) spec.xmmMask |= (uint16_t) (1 << i);
+                else spec.gpMask |= (uint16_t) (1 << argRegs[i]);
+            }
+            return spec;
+        }
+    };
+
+    template<typename Hook, typename Target>
+    struct ParameterPrefix : std::false_type {};
+
+    /**
+     * True if the hook's parameters are the first parameters of the target, the hook may leave off trailing ones
+     */
+    template<typename HookR, typename... HookArgs, typename TargetR, typename... TargetArgs>
+    struct ParameterPrefix<HookR(*)(HookArgs...), TargetR(*)(TargetArgs...)>
+    {
+        template<std::size_t... I>
+        static constexpr bool matches(std::index_sequence<I...>)
+        {
+            return (std::is_same_v<std::tuple_element_t<I, std::tuple<HookArgs...>>,
+                                   std::tuple_element_t<I, std::tuple<TargetArgs...>>> && ...);
+        }
+
+        static constexpr bool check()
+        {
+            if constexpr (sizeof...(HookArgs) > sizeof...(TargetArgs)) return false;
+            else return matches(std::index_sequence_for<HookArgs...>());
+        }
+
+        static constexpr bool value = check();
+    };
+
+    /**
+     * Spec for a hook on a function entry: every argument register of the target is preserved, even the ones the
+     * hook doesn't take, while only the stack arguments the hook takes are copied
+     */
+    template<typename TargetFn, typename HookFn>
+    constexpr StubSpec EntrySpec()
+    {
+        StubSpec spec = Signature<TargetFn>::spec();
+        spec.stackArgs = Signature<HookFn>::spec().stackArgs;
+        return spec;
+    }
+
+    // Large enough for every spec with up to MAX_STACK_ARGS stack arguments
+    constexpr std::size_t MAX_STUB_SIZE = 768;
+    constexpr uint8_t MAX_STACK_ARGS = 16;
+
+    /**
+     * Machine code of a stub with the addresses left out, they're patched into the slots when a hook is installed
+     */
+    struct StubTemplate
+    {
+        uint8_t code[MAX_STUB_SIZE];
+        std::size_t size;
+        // Offsets of the imm64 operands holding the hook and callback addresses, the callback slot is 0 without one
+        std::size_t hookSlot;
+        std::size_t callbackSlot;
+        // Offset of the imm64 holding the hook's HookCpuStats array, 0 unless built with OMORI_HOOK_STATS
+        std::size_t statsSlot;
+        const char* error;
+    };
+
+    class Encoder
+    {
+    public:
+        StubTemplate& out;
+
+        constexpr explicit Encoder(StubTemplate& out) : out(out) {}
+
+        constexpr void byte(uint8_t value)
+        {
+            if (out.size < MAX_STUB_SIZE) out.code[out.size] = value;
+            else out.error = "stub too large";
+            out.size++;
+        }
+
+        constexpr void bytes(std::initializer_list<uint8_t> values)
+        {
+            for (uint8_t value : values) byte(value);
+        }
+
+        constexpr void imm32(int32_t value)
+        {
+            for (int i = 0; i < 4; i++) byte((uint8_t) ((uint32_t) value >> (i * 8)));
+        }
+
+        constexpr void push(int reg)
+        {
+            if (reg >= 8) byte(0x41);
+            byte((uint8_t) (0x50 + (reg & 7)));
+        }
+
+        constexpr void pop(int reg)
+        {
+            if (reg >= 8) byte(0x41);
+            byte((uint8_t) (0x58 + (reg & 7)));
+        }
+
+        // sub/add rsp, imm
+        constexpr void adjustRsp(bool add, int32_t value)
+        {
+            uint8_t modrm = add ? 0xC4 : 0xEC;
+            if (value <= 127) bytes({0x48, 0x83, modrm, (uint8_t) value});
+            else
+            {
+                bytes({0x48, 0x81, modrm});
+                imm32(value);
+            }
+        }
+
+        // ModRM, SIB and displacement for [rsp+disp] or [rbx+disp]
+        constexpr void memOperand(int reg, int base, int32_t disp)
+        {
+            bool short8 = disp >= -128 && disp <= 127;
+            byte((uint8_t) ((short8 ? 0x40 : 0x80) | (reg & 7) << 3 | base));
+            if (base == GP_RSP) byte(0x24);
+            if (short8) byte((uint8_t) disp);
+            else imm32(disp);
+        }
+
+        // movdqu [rsp+disp], xmm / movdqu xmm, [rsp+disp]
+        constexpr void movdqu(bool store, int xmm, int32_t disp)
+        {
+            byte(0xF3);
+            if (xmm >= 8) byte(0x44);
+            bytes({0x0F, (uint8_t) (store ? 0x7F : 0x6F)});
+            memOperand(xmm, GP_RSP, disp);
+        }
+
+        // mov rax/r10, imm64 with a zero immediate, returns the offset of the immediate
+        constexpr std::size_t movRaxSlot(bool r10 = false)
+        {
+            if (r10) bytes({0x49, 0xBA});
+            else bytes({0x48, 0xB8});
+            std::size_t slot = out.size;
+            for (int i = 0; i < 8; i++) byte(0);
+            return slot;
+        }
+    };
+
+#ifdef OMORI_HOOK_STATS
+    static_assert(sizeof(HookCpuStats) == 64 && (HOOK_STATS_CPUS & (HOOK_STATS_CPUS - 1)) == 0);
+    static_assert(HOOK_STATS_SAMPLE_INTERVAL <= 128 && (HOOK_STATS_SAMPLE_INTERVAL & (HOOK_STATS_SAMPLE_INTERVAL - 1)) == 0);
+
+    /**
+     * Counts the call on the current CPU and stores the timestamp, whether the call is sampled and the CPU's counters
+     * in the 32 byte stats area at [rsp+area]. Clobbers rax, rcx, rdx, r10, r11 and flags, which are either saved by
+     * the stub or dead, and reloads rcx and rdx if they're saved because they might hold arguments
+     */
+    constexpr void encodeStatsEnter(Encoder& e, int32_t area, int rcxPush, int rdxPush)
+    {
+        e.bytes({0x0F, 0x01, 0xF9}); // rdtscp, ecx = processor number
+        e.bytes({0x48, 0xC1, 0xE2, 0x20}); // shl rdx, 32
+        e.bytes({0x48, 0x09, 0xD0}); // or rax, rdx
+        e.bytes({0x83, 0xE1, (uint8_t) (HOOK_STATS_CPUS - 1)}); // and ecx, cpus - 1
+        e.bytes({0xC1, 0xE1, 0x06}); // shl ecx, 6
+        e.out.statsSlot = e.movRaxSlot(true); // mov r10, cpus
+        e.bytes({0x49, 0x01, 0xCA}); // add r10, rcx
+        e.bytes({0x41, 0xBB, 0x01, 0x00, 0x00, 0x00}); // mov r11d, 1
+        e.bytes({0xF0, 0x4D, 0x0F, 0xC1, 0x1A}); // lock xadd [r10], r11
+        e.bytes({0x41, 0x83, 0xE3, (uint8_t) (HOOK_STATS_SAMPLE_INTERVAL - 1)}); // and r11d, interval - 1
+        e.bytes({0x48, 0x89});
+        e.memOperand(GP_RAX, GP_RSP, area); // mov [rsp+area], rax
+        e.bytes({0x4C, 0x89});
+        e.memOperand(GP_R11, GP_RSP, area + 8); // mov [rsp+area+8], r11
+        e.bytes({0x4C, 0x89});
+        e.memOperand(GP_R10, GP_RSP, area + 16); // mov [rsp+area+16], r10
+        if (rcxPush >= 0)
+        {
+            e.bytes({0x48, 0x8B});
+            e.memOperand(GP_RCX, GP_RBX, -(rcxPush + 1) * 8); // mov rcx, [rbx-slot]
+        }
+        if (rdxPush >= 0)
+        {
+            e.bytes({0x48, 0x8B});
+            e.memOperand(GP_RDX, GP_RBX, -(rdxPush + 1) * 8);
+        }
+    }
+
+    /**
+     * Adds the cycles since encodeStatsEnter to the counters of the CPU the call started on, if the call is sampled
+     */
+    constexpr void encodeStatsExit(Encoder& e, int32_t area)
+    {
+        e.bytes({0x48, 0x83});
+        e.memOperand(7, GP_RSP, area + 8);
+        e.byte(0x00); // cmp qword [rsp+area+8], 0
+        e.byte(0x75); // jne over the rest
+        std::size_t jump = e.out.size;
+        e.byte(0x00);
+        e.bytes({0x0F, 0x31}); // rdtsc
+        e.bytes({0x48, 0xC1, 0xE2, 0x20});
+        e.bytes({0x48, 0x09, 0xD0});
+        e.bytes({0x48, 0x2B});
+        e.memOperand(GP_RAX, GP_RSP, area); // sub rax, [rsp+area]
+        e.bytes({0x4C, 0x8B});
+        e.memOperand(GP_R10, GP_RSP, area + 16); // mov r10, [rsp+area+16]
+        e.bytes({0xF0, 0x49, 0x01, 0x42, 0x08}); // lock add [r10+8], rax
+        e.bytes({0xF0, 0x49, 0xFF, 0x42, 0x10}); // lock inc qword [r10+16]
+        if (jump < MAX_STUB_SIZE) e.out.code[jump] = (uint8_t) (e.out.size - jump - 1);
+    }
+#endif
+
+    /**
+     * Encodes the stub a hooked instruction jumps to, it saves the registers in spec, calls the callback and the
+     * hook, and restores them. Evaluated at compile time for every spec known at compile time
+     * @param spec Registers to preserve and stack arguments to forward
+     * @param callback Whether the stub calls custom asm before the hook
+     * @return The stub, error is set if it can't be encoded
+     */
+    constexpr StubTemplate Build(const StubSpec& spec, bool callback)
+    {
+        StubTemplate out{};
+        Encoder e(out);
+        if (spec.stackArgs > MAX_STACK_ARGS)
+        {
+            out.error = "too many stack arguments";
+            return out;
+        }
+
+        if (spec.saveFlags) e.byte(0x9C); // pushfq
+
+        // rbx keeps the stack pointer of the hooked code, the hook preserves it for us
+        e.push(GP_RBX);
+        e.bytes({0x48, 0x89, 0xE3}); // mov rbx, rsp
+
+        int pushed = 0;
+        [[maybe_unused]] int rcxPush = -1;
+        [[maybe_unused]] int rdxPush = -1;
+        for (int i = 0; i < 16; ++i)
+        {
+            if ((spec.gpMask & (1 << i)) == 0 || i == GP_RBX || i == GP_RSP) continue;
+            if (i == GP_RCX) rcxPush = pushed;
+            if (i == GP_RDX) rdxPush = pushed;
+            e.push(i);
+            pushed++;
+        }
+
+        // The hook can be placed anywhere, align the stack ourselves
+        e.bytes({0x48, 0x83, 0xE4, 0xF0}); // and rsp, -16
+#ifdef OMORI_HOOK_STATS
+        e.adjustRsp(false, 32);
+#endif
+
+        int xmmCount = 0;
+        for (int i = 0; i < 16; ++i)
+        {
+            if ((spec.xmmMask & (1 << i)) != 0) xmmCount++;
+        }
+        if (xmmCount > 0)
+        {
+            e.adjustRsp(false, xmmCount * 16);
+            for (int i = 0, slot = 0; i < 16; ++i)
+            {
+                if ((spec.xmmMask & (1 << i)) == 0) continue;
+                e.movdqu(true, i, slot++ * 16);
+            }
+        }
+#ifdef OMORI_HOOK_STATS
+        encodeStatsEnter(e, xmmCount * 16, rcxPush, rdxPush);
+#endif
+
+        // Shadow space and the arguments passed on the stack, copied from above the hooked function's return address
+        int frame = 32 + ((spec.stackArgs * 8 + 15) & ~15);
+        e.adjustRsp(false, frame);
+        int stackArgsOffset = 8 + (spec.saveFlags ? 8 : 0) + 40;
+        for (int i = 0; i < spec.stackArgs; ++i)
+        {
+            e.byte(0x48);
+            e.byte(0x8B);
+            e.memOperand(GP_RAX, GP_RBX, stackArgsOffset + i * 8); // mov rax, [rbx+offset]
+            e.byte(0x48);
+            e.byte(0x89);
+            e.memOperand(GP_RAX, GP_RSP, 32 + i * 8); // mov [rsp+32+i*8], rax
+        }
+
+        if (callback)
+        {
+            out.callbackSlot = e.movRaxSlot();
+            e.bytes({0xFF, 0xD0}); // call rax
+        }
+        out.hookSlot = e.movRaxSlot();
+        e.bytes({0xFF, 0xD0});
+
+        e.adjustRsp(true, frame);
+#ifdef OMORI_HOOK_STATS
+        encodeStatsExit(e, xmmCount * 16);
+#endif
+
+        // Restore the original register values
+        for (int i = 0, slot = 0; i < 16; ++i)
+        {
+            if ((spec.xmmMask & (1 << i)) == 0) continue;
+            e.movdqu(false, i, slot++ * 16);
+        }
+
+        e.byte(0x48);
+        e.byte(0x8D);
+        e.memOperand(GP_RSP, GP_RBX, -pushed * 8); // lea rsp, [rbx-pushed*8]
+        for (int i = 15; i >= 0; --i)
+        {
+            if ((spec.gpMask & (1 << i)) == 0 || i == GP_RBX || i == GP_RSP) continue;
+            e.pop(i);
+        }
+
+        e.pop(GP_RBX);
+        if (spec.saveFlags) e.byte(0x9D); // popfq
+        return out;
+    }
+
+    /**
+     * Stub for a spec known at compile time, encoded by the compiler
+     */
+    template<StubSpec S, bool Callback>
+    inline constexpr StubTemplate Precompiled = Build(S, Callback);
+
+    void Instantiate(const StubTemplate& stub, uint64_t hookFn, uint64_t cbFn, uint64_t stats,
+                     std::vector<uint8_t>& out);
+}
+
+#endif //OMORI_PATCHER_STUB_H
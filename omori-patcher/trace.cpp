@@ -0,0 +1,151 @@
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "pch.h"
+#include "trace.h"
+#include "config.h"
+#include "utils.h"
+
+namespace Trace
+{
+    struct Event
+    {
+        const char* name;
+        std::string detail;
+        double startUs;
+        // Negative until the span ends
+        double durationUs;
+    };
+
+    // Events of one thread, the lock is only ever contended while dumping
+    struct ThreadBuffer
+    {
+        DWORD threadId;
+        std::mutex mutex;
+        std::vector<Event> events;
+    };
+
+    std::mutex buffersMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    std::string output;
+    const auto origin = std::chrono::steady_clock::now();
+
+    ThreadBuffer& threadBuffer()
+    {
+        thread_local ThreadBuffer* buffer = nullptr;
+        if (buffer == nullptr)
+        {
+            std::lock_guard lock(buffersMutex);
+            buffers.push_back(std::make_unique<ThreadBuffer>());
+            buffer = buffers.back().get();
+            buffer->threadId = GetCurrentThreadId();
+        }
+        return *buffer;
+    }
+
+    /**
+     * Enables tracing if trace.enabled is set in the configuration
+     */
+    void Init()
+    {
+        const Json::Value& config = Config::Section("trace");
+        enabled = config.get("enabled", false).asBool();
+        output = config.get("output", "omori-patcher-trace.json").asString();
+        if (enabled) Utils::Infof("[trace] Tracing startup into %s", output.c_str());
+    }
+
+    /**
+     * Microseconds since the patcher was loaded
+     */
+    double NowUs()
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+    /**
+     * Starts a span on the calling thread
+     * @return Index of the span to pass to End
+     */
+    size_t Begin(const char* name, std::string detail)
+    {
+        ThreadBuffer& buffer = threadBuffer();
+        double startUs = NowUs();
+        std::lock_guard lock(buffer.mutex);
+        buffer.events.push_back({name, std::move(detail), startUs, -1});
+        return buffer.events.size() - 1;
+    }
+
+    /**
+     * Ends a span started by Begin on the same thread
+     */
+    void End(size_t event)
+    {
+        ThreadBuffer& buffer = threadBuffer();
+        double endUs = NowUs();
+        std::lock_guard lock(buffer.mutex);
+        Event& span = buffer.events[event];
+        span.durationUs = endUs - span.startUs;
+    }
+
+    /**
+     * Formats an address for span details
+     */
+    std::string Hex(unsigned long long value)
+    {
+        char buf[19];
+        snprintf(buf, sizeof(buf), "0x%llX", value);
+        return buf;
+    }
+
+    void writeEscaped(FILE* file, const std::string& str)
+    {
+        for (char c : str)
+        {
+            if (c == '"' || c == '\\') fprintf(file, "\\%c", c);
+            else if ((unsigned char) c < 0x20) fprintf(file, "\\u%04x", c);
+            else fputc(c, file);
+        }
+    }
+
+    /**
+     * Writes every span recorded so far as Chrome trace event JSON, loadable in Perfetto or about:tracing
+     */
+    void Dump()
+    {
+        if (!enabled) return;
+        FILE* file;
+        if (fopen_s(&file, output.c_str(), "w") != 0 || file == nullptr)
+        {
+            Utils::Errorf("[trace] Failed to open %s for writing", output.c_str());
+            return;
+        }
+
+        size_t count = 0;
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        std::lock_guard lock(buffersMutex);
+        for (const auto& buffer : buffers)
+        {
+            std::lock_guard bufferLock(buffer->mutex);
+            for (const Event& event : buffer->events)
+            {
+                // Still running, e.g. the span Dump is called from
+                if (event.durationUs < 0) continue;
+                fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f",
+                        count++ == 0 ? "" : ",\n", event.name, (unsigned long) buffer->threadId, event.startUs,
+                        event.durationUs);
+                if (!event.detail.empty())
+                {
+                    fprintf(file, ",\"args\":{\"detail\":\"");
+                    writeEscaped(file, event.detail);
+                    fprintf(file, "\"}");
+                }
+                fprintf(file, "}");
+            }
+        }
+        fprintf(file, "\n]}\n");
+        fclose(file);
+        Utils::Infof("[trace] Wrote %zu spans to %s", count, output.c_str());
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef OMORI_PATCHER_TRACE_H
+#define OMORI_PATCHER_TRACE_H
+
+#include <string>
+
+namespace Trace
+{
+    // Set once by Init before any other thread traces, spans only record anything while it's set
+    inline bool enabled = false;
+
+    void Init();
+    double NowUs();
+    size_t Begin(const char* name, std::string detail);
+    void End(size_t event);
+    void Dump();
+    std::string Hex(unsigned long long value);
+
+    /**
+     * Records a span from construction to destruction, while tracing is disabled it's a single branch on each end
+     */
+    class Scope
+    {
+    public:
+        explicit Scope(const char* name) : event(enabled ? Begin(name, {}) : NONE) {}
+
+        /**
+         * @param detail Callable returning the span's detail, only called while tracing
+         */
+        template<typename Detail>
+        Scope(const char* name, Detail&& detail) : event(enabled ? Begin(name, detail()) : NONE) {}
+
+        ~Scope()
+        {
+            if (event != NONE) End(event);
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        static constexpr size_t NONE = (size_t) -1;
+        // Index of the span in this thread's buffer, the detail is kept there instead of in the scope
+        size_t event;
+    };
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+// Traces the rest of the enclosing block, name has to be a string literal
+#define TRACE_SCOPE(name) Trace::Scope TRACE_CONCAT(traceScope, __LINE__)(name)
+// Same as TRACE_SCOPE with a detail shown in the span's args, value is only evaluated while tracing
+#define TRACE_SCOPE_DETAIL(name, value) \
+    Trace::Scope TRACE_CONCAT(traceScope, __LINE__)(name, [&] { return std::string(value); })
+
+#endif //OMORI_PATCHER_TRACE_H
@@ -1,11 +1,15 @@
 #include <fcntl.h>
+#include <cstdarg>
 #include <cstdio>
 #include <iostream>
 #include <codecvt>
+#include <memory>
 #include "utils.h"
 #include "pch.h"
 #include "io.h"
 #include "consts.h"
+#include "log.h"
+#include "jsonreader.h"
 
 using std::string;
 
@@ -124,112 +128,97 @@ namespace Utils
         }
     }
 
+    void logf(LogLevel level, const char* format, va_list args)
+    {
+        char buf[1024];
+        va_list copy;
+        va_copy(copy, args);
+        int len = vsnprintf(buf, sizeof(buf), format, args);
+        if (len < 0)
+        {
+            va_end(copy);
+            return;
+        }
+        if ((size_t) len < sizeof(buf))
+        {
+            Log::Write(level, buf, len);
+        }
+        else
+        {
+            std::string str(len + 1, '\0');
+            vsnprintf(str.data(), str.size(), format, copy);
+            Log::Write(level, str.data(), len);
+        }
+        va_end(copy);
+    }
+
     void Info(const char* msg)
     {
-        HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-        SetConsoleTextAttribute(hConsole, Consts::INFO);
-        std::cout << "[INFO] ";
-        SetConsoleTextAttribute(hConsole, Consts::RESET);
-        std::cout << msg << std::endl;
+        Log::Write(LOG_INFO, msg, strlen(msg));
     }
 
     void Infof(const char* format, ...)
     {
         va_list argptr;
         va_start(argptr, format);
-
-        HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-        SetConsoleTextAttribute(hConsole, Consts::INFO);
-        std::cout << "[INFO] ";
-        SetConsoleTextAttribute(hConsole, Consts::RESET);
-
-        vprintf(format, argptr);
+        logf(LOG_INFO, format, argptr);
         va_end(argptr);
-        std::cout << std::endl;
     }
 
     void Success(const char* msg)
     {
-        HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-        SetConsoleTextAttribute(hConsole, Consts::SUCCESS);
-        std::cout << "[SUCCESS] ";
-        SetConsoleTextAttribute(hConsole, Consts::RESET);
-        std::cout << msg << std::endl;
+        Log::Write(LOG_SUCCESS, msg, strlen(msg));
     }
 
     void Successf(const char* format, ...)
     {
         va_list argptr;
         va_start(argptr, format);
-
-        HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-        SetConsoleTextAttribute(hConsole, Consts::SUCCESS);
-        std::cout << "[SUCCESS] ";
-        SetConsoleTextAttribute(hConsole, Consts::RESET);
-
-        vprintf(format, argptr);
+        logf(LOG_SUCCESS, format, argptr);
         va_end(argptr);
-        std::cout << std::endl;
     }
 
     void Warn(const char* msg)
     {
-        HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-        SetConsoleTextAttribute(hConsole, Consts::WARN);
-        std::cout << "[WARN] ";
-        SetConsoleTextAttribute(hConsole, Consts::RESET);
-        std::cout << msg << std::endl;
+        Log::Write(LOG_WARN, msg, strlen(msg));
     }
 
     void Warnf(const char* format, ...)
     {
         va_list argptr;
         va_start(argptr, format);
-
-        HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-        SetConsoleTextAttribute(hConsole, Consts::WARN);
-        std::cout << "[WARN] ";
-        SetConsoleTextAttribute(hConsole, Consts::RESET);
-
-        vprintf(format, argptr);
+        logf(LOG_WARN, format, argptr);
         va_end(argptr);
-        std::cout << std::endl;
     }
 
     void Error(const char* msg)
     {
-        HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-        SetConsoleTextAttribute(hConsole, Consts::ERR);
-        std::cout << "[ERROR] ";
-        SetConsoleTextAttribute(hConsole, Consts::RESET);
-        std::cout << msg << std::endl;
+        Log::Write(LOG_ERROR, msg, strlen(msg));
     }
 
     void Errorf(const char* format, ...)
     {
         va_list argptr;
         va_start(argptr, format);
-
-        HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-        SetConsoleTextAttribute(hConsole, Consts::ERR);
-        std::cout << "[ERROR] ";
-        SetConsoleTextAttribute(hConsole, Consts::RESET);
-
-        vprintf(format, argptr);
+        logf(LOG_ERROR, format, argptr);
         va_end(argptr);
-        std::cout << std::endl;
     }
 
     bool PathExists(const char* path)
     {
-        return GetFileAttributesA(path) != 0;
+        return GetFileAttributesA(path) != INVALID_FILE_ATTRIBUTES;
     }
 
+    /**
+     * Reads a whole file into a new buffer the caller frees, the buffer is followed by a NUL byte
+     * @param filename File to read
+     * @return The buffer and the file size, data is null if the file couldn't be read
+     */
     FileData ReadFileData(const char* filename)
     {
-        OFSTRUCT finfo;
-        auto handle = (HANDLE) OpenFile(filename, &finfo, OF_READ);
-        if (handle == nullptr)
+        HANDLE handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (handle == INVALID_HANDLE_VALUE)
         {
             Utils::Errorf("Failed to open file for reading: %s", filename);
             return {
@@ -239,32 +228,30 @@ namespace Utils
         }
 
         DWORD size = GetFileSize(handle, nullptr);
-        void* buffer = malloc(size);
-
-        if (!ReadFile(handle, buffer, size, nullptr, nullptr))
+        auto buffer = (BYTE*) malloc(size + 1);
+        DWORD read = 0;
+        if (buffer == nullptr || !ReadFile(handle, buffer, size, &read, nullptr) || read != size)
         {
             Utils::Errorf("Failed to read file: %s", filename);
+            free(buffer);
+            CloseHandle(handle);
             return {
                     nullptr,
-                    size
+                    0
             };
         }
         CloseHandle(handle);
+        buffer[size] = 0;
 
         return {
-            (BYTE*)buffer,
+            buffer,
             size
         };
     }
 
     char* ReadFileStr(const char* filename)
     {
-        auto file = ReadFileData(filename);
-        char* newBuffer = (char*) malloc(file.size + 1);
-        memset(newBuffer, 0, file.size+1);
-        memcpy(newBuffer, file.data, file.size);
-        free(file.data);
-        return newBuffer;
+        return (char*) ReadFileData(filename).data;
     }
 
     bool WriteFileData(const char* filename, void* data, size_t dataLen, bool replaceExisting)
@@ -297,13 +284,21 @@ namespace Utils
         return true;
     }
 
+    /**
+     * Parses JSON straight from a buffer without copying it, see JsonReader::Parse
+     */
+    bool ParseJson(const char* begin, const char* end, Json::Value& out, string& error)
+    {
+        return JsonReader::Parse(begin, end, out, error);
+    }
+
     Json::Value ParseJson(const char* str)
     {
         Json::Value root;
-        Json::Reader reader;
-        if (!reader.parse(string(str), root))
+        string error;
+        if (!ParseJson(str, str + strlen(str), root, error))
         {
-            Errorf("Failed to parse JSON: %s", str);
+            Errorf("Failed to parse JSON: %s\n%s", str, error.c_str());
         }
         return root;
     }
@@ -318,6 +313,40 @@ namespace Utils
         return buff;
     }
 
+    /**
+     * Gets the absolute path of a file into an arena, unlike GetAbsolutePath there's no length limit
+     * @param path Path to resolve
+     * @param arena Arena the result is allocated from
+     * @return The absolute path
+     */
+    const char* GetAbsolutePath(const char* path, Arena& arena)
+    {
+        DWORD len = GetFullPathNameA(path, 0, nullptr, nullptr);
+        auto buff = arena.allocArray<char>(len + 1);
+        buff[GetFullPathNameA(path, len + 1, buff, nullptr)] = 0;
+        return buff;
+    }
+
+    const wchar_t* GetAbsolutePathW(const wchar_t* path, Arena& arena)
+    {
+        DWORD len = GetFullPathNameW(path, 0, nullptr, nullptr);
+        auto buff = arena.allocArray<wchar_t>(len + 1);
+        buff[GetFullPathNameW(path, len + 1, buff, nullptr)] = 0;
+        return buff;
+    }
+
+    /**
+     * Converts a string in the current code page to a wide one in an arena
+     */
+    const wchar_t* Widen(const char* str, Arena& arena)
+    {
+        size_t len = strlen(str) + 1;
+        auto buff = arena.allocArray<wchar_t>(len);
+        size_t convertedChars = 0;
+        mbstowcs_s(&convertedChars, buff, len, str, _TRUNCATE);
+        return buff;
+    }
+
     const wchar_t* GetAbsolutePathW(const wchar_t* p1)
     {
         TCHAR newPath[4096] = TEXT("");
@@ -2,6 +2,7 @@
 #include "pch.h"
 #include <json/json.h>
 #include <cstring>
+#include "arena.h"
 
 typedef unsigned int natural;
 
@@ -25,7 +26,11 @@ namespace Utils
     FileData ReadFileData(const char* filename);
     char* ReadFileStr(const char* filename);
     bool WriteFileData(const char* filename, void* data, size_t dataLen, bool replaceExisting);
+    bool ParseJson(const char* begin, const char* end, Json::Value& out, std::string& error);
     Json::Value ParseJson(const char* str);
     const char* GetAbsolutePath(const char* p1);
     const wchar_t* GetAbsolutePathW(const wchar_t* p1);
+    const char* GetAbsolutePath(const char* path, Arena& arena);
+    const wchar_t* GetAbsolutePathW(const wchar_t* path, Arena& arena);
+    const wchar_t* Widen(const char* str, Arena& arena);
 }
\ No newline at end of file
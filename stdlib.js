@@ -53,6 +53,57 @@ try {
 		};
 		rpc(6, data);
 	}
+
+	// Prints native hook statistics, only available in builds with OMORI_HOOK_STATS
+	function mp_hookStats() {
+		rpc(8, {});
+	}
+
+	// Shared module system, every module is evaluated once and shared between all mods requiring it
+	var mp_modules = {};
+	var mp_resolutions = {};
+
+	function mp_define(id, factory) {
+		if (!(id in mp_modules)) {
+			mp_modules[id] = { 'factory': factory, 'module': null };
+		}
+	}
+
+	function mp_resolved(dir, spec, id) {
+		mp_resolutions[dir + '\n' + spec] = id;
+	}
+
+	function mp_dirname(id) {
+		const i = id.lastIndexOf('/');
+		return i < 0 ? '' : id.substring(0, i);
+	}
+
+	function mp_makeRequire(dir) {
+		return function require(spec) {
+			const key = dir + '\n' + spec;
+			if (!(key in mp_resolutions)) {
+				// Not seen by the up front resolution (e.g. a computed name), ask the patcher
+				rpc(7, { 'spec': spec, 'dir': dir });
+			}
+			const id = mp_resolutions[key];
+			if (id === undefined || !(id in mp_modules)) {
+				throw new Error("Cannot find module '" + spec + "' from '" + dir + "'");
+			}
+			const entry = mp_modules[id];
+			if (entry.module === null) {
+				// Cached before the factory runs so circular requires see the partial exports
+				entry.module = { 'id': id, 'exports': {} };
+				try {
+					entry.factory.call(entry.module.exports, entry.module, entry.module.exports, mp_makeRequire(mp_dirname(id)));
+				} catch (ex) {
+					// A module that failed to load is retried by the next require instead of handing out half its exports
+					entry.module = null;
+					throw ex;
+				}
+			}
+			return entry.module.exports;
+		};
+	}
 	
 	console.log('stdlib: initialized');
 } catch (ex) {
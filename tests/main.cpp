@@ -0,0 +1,62 @@
+#include <cstdio>
+#include <cstring>
+#include "test.h"
+
+// Runs the patcher's host tests. Without arguments every test runs, otherwise only the ones whose name starts with
+// one of the arguments. The exit code is 1 if any check failed
+
+namespace Test
+{
+    int failures = 0;
+
+    std::vector<Case>& Cases()
+    {
+        static std::vector<Case> cases;
+        return cases;
+    }
+
+    void Fail(const char* file, int line, const char* expr)
+    {
+        fprintf(stderr, "  %s:%d: CHECK(%s) failed\n", file, line, expr);
+        failures++;
+    }
+}
+
+bool selected(const std::string& name, int argc, char** argv)
+{
+    if (argc < 2) return true;
+    for (int i = 1; i < argc; i++)
+    {
+        if (name.compare(0, strlen(argv[i]), argv[i]) == 0) return true;
+    }
+    return false;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc == 2 && strcmp(argv[1], "--list") == 0)
+    {
+        for (const Test::Case& test : Test::Cases()) printf("%s\n", test.name.c_str());
+        return 0;
+    }
+
+    int run = 0;
+    int failed = 0;
+    for (const Test::Case& test : Test::Cases())
+    {
+        if (!selected(test.name, argc, argv)) continue;
+        int before = Test::failures;
+        test.fn();
+        run++;
+        bool ok = Test::failures == before;
+        if (!ok) failed++;
+        printf("%-4s %s\n", ok ? "ok" : "FAIL", test.name.c_str());
+    }
+    if (run == 0)
+    {
+        fprintf(stderr, "No tests matched\n");
+        return 1;
+    }
+    printf("%d of %d tests passed\n", run - failed, run);
+    return failed == 0 ? 0 : 1;
+}
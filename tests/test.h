@@ -0,0 +1,40 @@
+#ifndef OMORI_PATCHER_TEST_H
+#define OMORI_PATCHER_TEST_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace Test
+{
+    typedef std::function<void()> Fn;
+
+    struct Case
+    {
+        std::string name;
+        Fn fn;
+    };
+
+    std::vector<Case>& Cases();
+    void Fail(const char* file, int line, const char* expr);
+
+    /**
+     * Registers a test from a static initializer, names are "group/case" and ctest runs each group separately
+     */
+    struct Register
+    {
+        Register(const char* name, Fn fn)
+        {
+            Cases().push_back({name, std::move(fn)});
+        }
+    };
+}
+
+// Reports a failed check and keeps going
+#define CHECK(...) \
+    do { if (!(__VA_ARGS__)) Test::Fail(__FILE__, __LINE__, #__VA_ARGS__); } while (0)
+// Reports a failed check and leaves the test, for checks the rest of the test depends on
+#define REQUIRE(...) \
+    do { if (!(__VA_ARGS__)) { Test::Fail(__FILE__, __LINE__, #__VA_ARGS__); return; } } while (0)
+
+#endif //OMORI_PATCHER_TEST_H
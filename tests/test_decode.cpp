@@ -0,0 +1,130 @@
+#include <vector>
+#include "test.h"
+#include "decode.h"
+
+namespace
+{
+    // Bytes a 14 byte absolute jump overwrites
+    const size_t HOOK_LEN = 14;
+
+    struct Prologue
+    {
+        const char* name;
+        std::vector<uint8_t> code;
+        // Lengths of the instructions covering HOOK_LEN bytes
+        std::vector<uint8_t> lengths;
+    };
+
+    // Function entries as MSVC and Clang emit them, the decoder has to find the instruction boundaries in each
+    const Prologue CORPUS[] = {
+            {"spill two, push, sub", {0x48, 0x89, 0x5C, 0x24, 0x08, 0x48, 0x89, 0x74, 0x24, 0x10, 0x57, 0x48, 0x83,
+                                      0xEC, 0x20, 0xCC}, {5, 5, 1, 4}},
+            {"rex push, sub, mov, call", {0x40, 0x53, 0x48, 0x83, 0xEC, 0x20, 0x48, 0x8B, 0xD9, 0xE8, 0x10, 0x20,
+                                          0x30, 0x00, 0xCC}, {2, 4, 3, 5}},
+            {"frame through rax", {0x48, 0x8B, 0xC4, 0x48, 0x89, 0x58, 0x08, 0x48, 0x89, 0x68, 0x10, 0x48, 0x89,
+                                   0x70, 0x18, 0xCC}, {3, 4, 4, 4}},
+            {"frame through r11", {0x4C, 0x8B, 0xDC, 0x49, 0x89, 0x5B, 0x10, 0x55, 0x56, 0x57, 0x41, 0x54, 0x41,
+                                   0x55, 0xCC}, {3, 4, 1, 1, 1, 2, 2}},
+            {"rip load, test, je", {0x48, 0x8B, 0x05, 0x44, 0x33, 0x22, 0x00, 0x48, 0x85, 0xC0, 0x74, 0x05, 0x48,
+                                    0x8B, 0x40, 0x08, 0xCC}, {7, 3, 2, 4}},
+            {"large frame, lea rbp, movaps", {0x48, 0x81, 0xEC, 0x28, 0x01, 0x00, 0x00, 0x48, 0x8D, 0x6C, 0x24, 0x20,
+                                              0x0F, 0x29, 0x74, 0x24, 0x70, 0xCC}, {7, 5, 5}},
+            {"jmp thunk", {0xE9, 0x00, 0x10, 0x00, 0x00, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC, 0xCC,
+                           0xCC}, {5, 1, 1, 1, 1, 1, 1, 1, 1, 1}},
+    };
+
+    Test::Register corpus("decode/prologue_corpus", [] {
+        uint64_t addr = 0x140010000;
+        for (const Prologue& prologue : CORPUS)
+        {
+            addr += 0x1000;
+            std::vector<InsnInfo> insns;
+            bool ok = Decode::Window(prologue.code.data(), addr, prologue.code.size(), HOOK_LEN, insns);
+            CHECK(ok);
+            if (!ok) continue;
+            std::vector<uint8_t> lengths;
+            uint64_t next = addr;
+            for (const InsnInfo& insn : insns)
+            {
+                lengths.push_back(insn.length);
+                CHECK(insn.address == next);
+                next += insn.length;
+            }
+            if (lengths != prologue.lengths) Test::Fail(__FILE__, __LINE__, prologue.name);
+        }
+    });
+
+    Test::Register branches("decode/branches", [] {
+        InsnInfo insn;
+        // call rel32
+        const uint8_t call[] = {0xE8, 0x10, 0x20, 0x30, 0x00};
+        REQUIRE(Decode::At(call, 0x140020000, sizeof(call), insn));
+        CHECK(insn.relative && insn.target == 0x140020005 + 0x302010);
+        CHECK(insn.immOffset == 1 && insn.immSize == 32);
+        CHECK(insn.mnemonic == ZYDIS_MNEMONIC_CALL && !insn.terminator);
+
+        // je rel8 -2, backwards
+        const uint8_t je[] = {0x74, 0xFE};
+        REQUIRE(Decode::At(je, 0x140020100, sizeof(je), insn));
+        CHECK(insn.relative && insn.target == 0x140020100);
+        CHECK(insn.category == ZYDIS_CATEGORY_COND_BR && insn.opcode == 0x74);
+        CHECK(insn.immOffset == 1 && insn.immSize == 8);
+
+        const uint8_t ret[] = {0xC3};
+        REQUIRE(Decode::At(ret, 0x140020200, sizeof(ret), insn));
+        CHECK(insn.terminator && !insn.relative);
+        const uint8_t int3[] = {0xCC};
+        REQUIRE(Decode::At(int3, 0x140020201, sizeof(int3), insn));
+        CHECK(insn.terminator);
+        // jmp rel32
+        const uint8_t jmp[] = {0xE9, 0x00, 0x01, 0x00, 0x00};
+        REQUIRE(Decode::At(jmp, 0x140020300, sizeof(jmp), insn));
+        CHECK(insn.terminator && insn.relative && insn.target == 0x140020405);
+    });
+
+    Test::Register ripRelative("decode/rip_relative", [] {
+        InsnInfo insn;
+        // mov rax, [rip+0x223344]
+        const uint8_t load[] = {0x48, 0x8B, 0x05, 0x44, 0x33, 0x22, 0x00};
+        REQUIRE(Decode::At(load, 0x140030000, sizeof(load), insn));
+        CHECK(insn.ripRelative && !insn.relative);
+        CHECK(insn.ripTarget == 0x140030007 + 0x223344);
+        CHECK(insn.dispOffset == 3 && insn.dispSize == 32);
+
+        // jmp [rip+0], the absolute jump hooks are made of
+        const uint8_t absJmp[] = {0xFF, 0x25, 0x00, 0x00, 0x00, 0x00};
+        REQUIRE(Decode::At(absJmp, 0x140030100, sizeof(absJmp), insn));
+        CHECK(insn.ripRelative && !insn.relative && insn.ripTarget == 0x140030106);
+        CHECK(insn.terminator);
+    });
+
+    Test::Register bounds("decode/bounds", [] {
+        InsnInfo insn;
+        std::vector<InsnInfo> insns;
+        const uint8_t spill[] = {0x48, 0x89, 0x5C, 0x24, 0x08};
+        CHECK(!Decode::At(spill, 0x140040000, 4, insn));
+        CHECK(Decode::At(spill, 0x140040000, 5, insn) && insn.length == 5);
+        // Cached now, a shorter readable range still has to fail
+        CHECK(!Decode::At(spill, 0x140040000, 4, insn));
+        CHECK(!Decode::Window(spill, 0x140040000, sizeof(spill), HOOK_LEN, insns));
+    });
+
+    // Cached decodes are tied to the bytes they came from, not only the address
+    Test::Register cache("decode/cache", [] {
+        InsnInfo insn;
+        const uint64_t addr = 0x140050000;
+        const uint8_t push[] = {0x57, 0x90};
+        const uint8_t call[] = {0xE8, 0x00, 0x00, 0x00, 0x00};
+        REQUIRE(Decode::At(push, addr, sizeof(push), insn));
+        CHECK(insn.length == 1);
+        // A copy of different code at the same runtime address, e.g. a function patched since
+        REQUIRE(Decode::At(call, addr, sizeof(call), insn));
+        CHECK(insn.length == 5 && insn.relative && insn.target == addr + 5);
+        REQUIRE(Decode::At(push, addr, sizeof(push), insn));
+        CHECK(insn.length == 1 && !insn.relative);
+
+        Decode::Invalidate(addr, 1);
+        REQUIRE(Decode::At(call, addr, sizeof(call), insn));
+        CHECK(insn.length == 5);
+    });
+}
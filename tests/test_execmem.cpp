@@ -0,0 +1,201 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+#include "test.h"
+#include "execmem.h"
+
+namespace
+{
+    struct Allocation
+    {
+        uint8_t* ptr;
+        size_t size;
+        uint8_t fill;
+    };
+
+    // Stands in for the module base, everything handed out has to be in rel32 reach of it
+    const int anchor = 0;
+
+    bool init()
+    {
+        return ExecMem::Init((uintptr_t) &anchor, 64 * 1024);
+    }
+
+    /**
+     * Protection of the mapping containing addr as listed in /proc/self/maps, e.g. "r-xp"
+     */
+    std::string protectionOf(const void* addr)
+    {
+        FILE* maps = fopen("/proc/self/maps", "r");
+        if (maps == nullptr) return "";
+        char line[512];
+        std::string res;
+        while (fgets(line, sizeof(line), maps) != nullptr)
+        {
+            unsigned long long start, end;
+            char perms[8];
+            if (sscanf(line, "%llx-%llx %7s", &start, &end, perms) != 3) continue;
+            if ((uintptr_t) addr >= start && (uintptr_t) addr < end)
+            {
+                res = perms;
+                break;
+            }
+        }
+        fclose(maps);
+        return res;
+    }
+
+    bool intact(const Allocation& allocation)
+    {
+        for (size_t i = 0; i < allocation.size; i++)
+        {
+            if (allocation.ptr[i] != allocation.fill) return false;
+        }
+        return true;
+    }
+
+    bool overlapping(std::vector<Allocation> live)
+    {
+        std::sort(live.begin(), live.end(), [](const Allocation& a, const Allocation& b) { return a.ptr < b.ptr; });
+        for (size_t i = 1; i < live.size(); i++)
+        {
+            if (live[i - 1].ptr + live[i - 1].size > live[i].ptr) return true;
+        }
+        return false;
+    }
+
+    Test::Register writeBatch("execmem/write_batch", [] {
+        REQUIRE(init());
+        ExecMem::BeginWrite();
+        auto ptr = (uint8_t*) ExecMem::Alloc(100);
+        REQUIRE(ptr != nullptr);
+        // Still writable after Alloc returned, until the batch ends
+        CHECK(protectionOf(ptr) == "rwxp");
+        memset(ptr, 0xCC, 100);
+        ExecMem::EndWrite();
+        CHECK(protectionOf(ptr) == "r-xp");
+        CHECK(ptr[0] == 0xCC && ptr[99] == 0xCC);
+        CHECK(ExecMem::InReach((uintptr_t) ptr, (uintptr_t) &anchor));
+        ExecMem::Free(ptr, 100);
+    });
+
+    Test::Register reuse("execmem/reuse", [] {
+        REQUIRE(init());
+        ExecMem::BeginWrite();
+        void* first = ExecMem::Alloc(40);
+        ExecMem::Free(first, 40);
+        // Same size class, handed out again before carving new memory
+        void* second = ExecMem::Alloc(64);
+        void* large = ExecMem::Alloc(10000);
+        ExecMem::Free(large, 10000);
+        void* largeAgain = ExecMem::Alloc(9000);
+        ExecMem::EndWrite();
+        CHECK(first != nullptr && second == first);
+        CHECK(large != nullptr && largeAgain == large);
+        ExecMem::Free(second, 64);
+        ExecMem::Free(largeAgain, 9000);
+    });
+
+#if defined(__x86_64__)
+    Test::Register execute("execmem/execute", [] {
+        REQUIRE(init());
+        ExecMem::BeginWrite();
+        auto code = (uint8_t*) ExecMem::Alloc(6);
+        REQUIRE(code != nullptr);
+        const uint8_t movEaxRet[] = {0xB8, 0x78, 0x56, 0x34, 0x12, 0xC3}; // mov eax, 0x12345678; ret
+        memcpy(code, movEaxRet, sizeof(movEaxRet));
+        ExecMem::EndWrite();
+        CHECK(((int (*)()) code)() == 0x12345678);
+        ExecMem::Free(code, 6);
+    });
+#endif
+
+    // Random batches of allocations and frees of every size class and large blocks, across several regions
+    Test::Register stress("execmem/stress", [] {
+        REQUIRE(init());
+        std::mt19937 random(1234);
+        std::vector<Allocation> live;
+        for (int batch = 0; batch < 200; batch++)
+        {
+            ExecMem::BeginWrite();
+            for (int op = 0; op < 50; op++)
+            {
+                if (!live.empty() && random() % 3 == 0)
+                {
+                    size_t index = random() % live.size();
+                    CHECK(intact(live[index]));
+                    ExecMem::Free(live[index].ptr, live[index].size);
+                    live[index] = live.back();
+                    live.pop_back();
+                    continue;
+                }
+                size_t size = random() % 8 == 0 ? 2049 + random() % 12000 : 1 + random() % 2048;
+                auto ptr = (uint8_t*) ExecMem::Alloc(size);
+                REQUIRE(ptr != nullptr);
+                auto fill = (uint8_t) random();
+                memset(ptr, fill, size);
+                live.push_back({ptr, size, fill});
+            }
+            ExecMem::EndWrite();
+        }
+
+        CHECK(!overlapping(live));
+        for (const Allocation& allocation : live)
+        {
+            CHECK(intact(allocation));
+            CHECK(ExecMem::InReach((uintptr_t) allocation.ptr, (uintptr_t) &anchor));
+            CHECK(protectionOf(allocation.ptr) == "r-xp");
+            ExecMem::Free(allocation.ptr, allocation.size);
+        }
+    });
+
+    // Batches hold the pool lock, threads allocating at the same time never see each other's memory
+    Test::Register threads("execmem/threads", [] {
+        REQUIRE(init());
+        std::vector<std::vector<Allocation>> perThread(4);
+        std::vector<std::thread> workers;
+        for (size_t t = 0; t < perThread.size(); t++)
+        {
+            workers.emplace_back([t, &perThread] {
+                std::mt19937 random((unsigned) t);
+                std::vector<Allocation>& live = perThread[t];
+                for (int op = 0; op < 2000; op++)
+                {
+                    ExecMem::BeginWrite();
+                    if (live.size() > 64)
+                    {
+                        ExecMem::Free(live.front().ptr, live.front().size);
+                        live.erase(live.begin());
+                    }
+                    size_t size = 1 + random() % 512;
+                    auto ptr = (uint8_t*) ExecMem::Alloc(size);
+                    if (ptr != nullptr)
+                    {
+                        memset(ptr, (uint8_t) (t + 1), size);
+                        live.push_back({ptr, size, (uint8_t) (t + 1)});
+                    }
+                    ExecMem::EndWrite();
+                }
+            });
+        }
+        for (std::thread& worker : workers) worker.join();
+
+        std::vector<Allocation> all;
+        for (const auto& live : perThread)
+        {
+            CHECK(live.size() == 65);
+            for (const Allocation& allocation : live)
+            {
+                CHECK(intact(allocation));
+                all.push_back(allocation);
+            }
+        }
+        CHECK(!overlapping(all));
+        ExecMem::BeginWrite();
+        for (const Allocation& allocation : all) ExecMem::Free(allocation.ptr, allocation.size);
+        ExecMem::EndWrite();
+    });
+}
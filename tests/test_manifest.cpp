@@ -0,0 +1,51 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "test.h"
+#include "jsonreader.h"
+#include "manifest.h"
+
+namespace
+{
+    bool validate(const std::string& text, std::string& error)
+    {
+        Json::Value root;
+        return JsonReader::Parse(text.data(), text.data() + text.size(), root, error) &&
+               Manifest::Validate(root, error);
+    }
+
+    Test::Register valid("manifest/valid", [] {
+        std::string error;
+        CHECK(validate(R"({"id": "mod"})", error));
+        CHECK(validate(R"({"id": "mod", "name": "Mod", "description": "", "version": "1.0", "main": "main.js",
+                           "files": {"img": ["img/"], "data": []}, "patches": ["fix.1337"], "extra": 5})", error));
+    });
+
+    Test::Register invalid("manifest/invalid", [] {
+        const std::pair<const char*, const char*> cases[] = {
+                {R"([])", "top level value isn't an object"},
+                {R"({})", "\"id\" has to be a non-empty string"},
+                {R"({"id": ""})", "\"id\" has to be a non-empty string"},
+                {R"({"id": 5})", "\"id\" has to be a non-empty string"},
+                {R"({"id": "mod", "main": ["main.js"]})", "\"main\" has to be a string"},
+                {R"({"id": "mod", "files": []})", "\"files\" has to be an object"},
+                {R"({"id": "mod", "files": {"img": "img/"}})", "\"files.img\" has to be an array of strings"},
+                {R"({"id": "mod", "files": {"img": ["a", 1]}})", "\"files.img\" has to be an array of strings"},
+                {R"({"id": "mod", "patches": "fix.1337"})", "\"patches\" has to be an array of strings"},
+        };
+        for (const auto& [text, expected] : cases)
+        {
+            std::string error;
+            if (validate(text, error) || error != expected) Test::Fail(__FILE__, __LINE__, text);
+        }
+    });
+
+    // Load order has to match what FindFirstFileA returns on NTFS, which compares uppercased names
+    Test::Register dirOrder("manifest/dir_order", [] {
+        std::vector<std::string> dirs = {"zeta", "_base", "Alpha", "beta", "ALPHA2", "alpha1", "Zeta_fix", "1st"};
+        std::sort(dirs.begin(), dirs.end(), Manifest::DirLess);
+        CHECK(dirs == std::vector<std::string>{"1st", "Alpha", "alpha1", "ALPHA2", "beta", "zeta", "Zeta_fix",
+                                               "_base"});
+        CHECK(!Manifest::DirLess("Mod", "mod") && !Manifest::DirLess("mod", "Mod"));
+    });
+}
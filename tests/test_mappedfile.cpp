@@ -0,0 +1,111 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <unistd.h>
+#include "test.h"
+#include "mappedfile.h"
+
+namespace
+{
+    // Directory the test files are written to, removed at exit once the tests deleted their files
+    struct TempDir
+    {
+        std::string path;
+
+        TempDir()
+        {
+            char pattern[] = "/tmp/omori-mappedfile-XXXXXX";
+            if (mkdtemp(pattern) != nullptr) path = pattern;
+        }
+
+        ~TempDir()
+        {
+            if (!path.empty()) rmdir(path.c_str());
+        }
+    };
+
+    /**
+     * Writes a file of the given size filled with non-zero bytes into the temporary directory
+     */
+    std::string writeFile(const char* name, size_t size, std::string& contents)
+    {
+        static const TempDir dir;
+        if (dir.path.empty()) return "";
+        std::string path = dir.path + "/" + name;
+        contents.resize(size);
+        for (size_t i = 0; i < size; i++) contents[i] = (char) ('a' + i % 26);
+        FILE* file = fopen(path.c_str(), "wb");
+        if (file == nullptr) return "";
+        fwrite(contents.data(), 1, size, file);
+        fclose(file);
+        return path;
+    }
+
+    bool viewMatches(const MappedFile& file, const std::string& contents)
+    {
+        return file.isOpen() && file.size() == contents.size() && file.end() == file.data() + file.size() &&
+               std::string(file.data(), file.size()) == contents && file.data()[file.size()] == '\0';
+    }
+
+    // Every size the view is set up differently for, the page multiples need the separate sentinel page
+    Test::Register sizes("mappedfile/sizes", [] {
+        auto page = (size_t) sysconf(_SC_PAGESIZE);
+        for (size_t size : {(size_t) 0, (size_t) 1, page - 1, page, page + 1, 2 * page, 16 * page})
+        {
+            std::string contents;
+            std::string path = writeFile(("size" + std::to_string(size)).c_str(), size, contents);
+            REQUIRE(!path.empty());
+            MappedFile file(path.c_str());
+            if (!viewMatches(file, contents)) Test::Fail(__FILE__, __LINE__, ("size " + std::to_string(size)).c_str());
+            unlink(path.c_str());
+        }
+    });
+
+    // The sentinel makes the view usable as a C string without copying
+    Test::Register cString("mappedfile/c_string", [] {
+        auto page = (size_t) sysconf(_SC_PAGESIZE);
+        std::string contents;
+        std::string path = writeFile("page.txt", page, contents);
+        REQUIRE(!path.empty());
+        MappedFile file(path.c_str());
+        REQUIRE(file.isOpen());
+        CHECK(std::string(file.data()) == contents);
+        unlink(path.c_str());
+    });
+
+    Test::Register missing("mappedfile/missing", [] {
+        MappedFile file;
+        CHECK(!file.open("/nonexistent/omori-patcher/mod.json"));
+        CHECK(!file.isOpen());
+        CHECK(file.size() == 0);
+    });
+
+    Test::Register ownership("mappedfile/ownership", [] {
+        auto page = (size_t) sysconf(_SC_PAGESIZE);
+        std::string small, large;
+        std::string smallPath = writeFile("small.txt", 10, small);
+        std::string largePath = writeFile("large.txt", 2 * page, large);
+        REQUIRE(!smallPath.empty() && !largePath.empty());
+
+        MappedFile first(smallPath.c_str());
+        MappedFile second(std::move(first));
+        CHECK(!first.isOpen() && first.size() == 0);
+        CHECK(viewMatches(second, small));
+
+        MappedFile third(largePath.c_str());
+        third = std::move(second);
+        CHECK(!second.isOpen());
+        CHECK(viewMatches(third, small));
+
+        // Reopening replaces the view, closing twice is harmless
+        CHECK(third.open(largePath.c_str()));
+        CHECK(viewMatches(third, large));
+        third.close();
+        third.close();
+        CHECK(!third.isOpen() && third.size() == 0);
+
+        unlink(smallPath.c_str());
+        unlink(largePath.c_str());
+    });
+}
@@ -0,0 +1,91 @@
+#include <string>
+#include <vector>
+#include "test.h"
+#include "patchfile.h"
+
+namespace
+{
+    Test::Register parse("patchfile/parse", [] {
+        PatchSet set;
+        std::string error;
+        REQUIRE(PatchFile::Parse(">OMORI.exe\r\n"
+                                 "; comment\r\n"
+                                 "\r\n"
+                                 "  00001000:74->EB  \r\n"
+                                 "0000ab10:0F->90\n"
+                                 "0000AB11:85->90", set, error));
+        CHECK(set.module == "omori.exe");
+        REQUIRE(set.runs.size() == 2);
+        CHECK(set.runs[0].rva == 0x1000);
+        CHECK(set.runs[0].original == std::vector<uint8_t>{0x74});
+        CHECK(set.runs[0].patched == std::vector<uint8_t>{0xEB});
+        CHECK(set.runs[1].rva == 0xAB10);
+        CHECK(set.runs[1].original == std::vector<uint8_t>{0x0F, 0x85});
+        CHECK(set.runs[1].patched == std::vector<uint8_t>{0x90, 0x90});
+    });
+
+    // x64dbg writes bytes in the order they were patched, runs are merged after sorting by offset
+    Test::Register merge("patchfile/merge_runs", [] {
+        PatchSet set;
+        std::string error;
+        REQUIRE(PatchFile::Parse(">omori.exe\n"
+                                 "2002:03->13\n"
+                                 "3000:AA->BB\n"
+                                 "2000:01->11\n"
+                                 "2001:02->12\n"
+                                 "2004:05->15\n", set, error));
+        REQUIRE(set.runs.size() == 3);
+        CHECK(set.runs[0].rva == 0x2000);
+        CHECK(set.runs[0].original == std::vector<uint8_t>{0x01, 0x02, 0x03});
+        CHECK(set.runs[0].patched == std::vector<uint8_t>{0x11, 0x12, 0x13});
+        // A gap of one byte starts a new run
+        CHECK(set.runs[1].rva == 0x2004 && set.runs[1].patched.size() == 1);
+        CHECK(set.runs[2].rva == 0x3000 && set.runs[2].patched == std::vector<uint8_t>{0xBB});
+    });
+
+    Test::Register errors("patchfile/errors", [] {
+        PatchSet set;
+        std::string error;
+        CHECK(!PatchFile::Parse("1000:74->EB\n", set, error));
+        CHECK(error == "missing >module line");
+
+        CHECK(!PatchFile::Parse(">omori.exe\n1000:74->EB\n1000:74->90\n", set, error));
+        CHECK(error == "line 3: offset patched more than once");
+
+        const char* malformed[] = {
+                ">omori.exe\n1000:74-EB\n",
+                ">omori.exe\n1000 74->EB\n",
+                ">omori.exe\n1000:174->EB\n",
+                ">omori.exe\n1000:74->\n",
+                ">omori.exe\n:74->EB\n",
+                ">omori.exe\n10G0:74->EB\n",
+                ">omori.exe\n11112222333344445:74->EB\n",
+                ">omori.exe\n1000->74:EB\n",
+        };
+        for (const char* text : malformed)
+        {
+            bool ok = PatchFile::Parse(text, set, error);
+            if (ok || error != "line 2: expected OFFSET:OLD->NEW") Test::Fail(__FILE__, __LINE__, text);
+        }
+    });
+
+    Test::Register check("patchfile/check", [] {
+        PatchRun run = {0, {}, {}};
+        // Longer than one vector compare so both the SSE2 loop and the tail are used
+        for (int i = 0; i < 37; i++)
+        {
+            run.original.push_back((uint8_t) i);
+            run.patched.push_back((uint8_t) (i + 100));
+        }
+        std::vector<uint8_t> memory = run.original;
+        CHECK(PatchFile::Check(memory.data(), run) == PATCH_APPLICABLE);
+        memory = run.patched;
+        CHECK(PatchFile::Check(memory.data(), run) == PATCH_ALREADY_APPLIED);
+        for (size_t i : {0, 15, 16, 36})
+        {
+            memory = run.original;
+            memory[i] ^= 0xFF;
+            CHECK(PatchFile::Check(memory.data(), run) == PATCH_MISMATCH);
+        }
+    });
+}
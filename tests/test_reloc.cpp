@@ -0,0 +1,125 @@
+#include <cstring>
+#include <vector>
+#include "test.h"
+#include "reloc.h"
+
+namespace
+{
+    const uint64_t SRC = 0x140001000;
+    // In rel32 reach of SRC, like the executable memory pool
+    const uint64_t NEAR_DST = SRC + 0x100000;
+
+    std::vector<uint8_t> absJmp(uint64_t target)
+    {
+        std::vector<uint8_t> code = {0xFF, 0x25, 0x00, 0x00, 0x00, 0x00};
+        code.insert(code.end(), (const uint8_t*) &target, (const uint8_t*) &target + sizeof(target));
+        return code;
+    }
+
+    std::vector<uint8_t> concat(std::initializer_list<std::vector<uint8_t>> parts)
+    {
+        std::vector<uint8_t> res;
+        for (const auto& part : parts) res.insert(res.end(), part.begin(), part.end());
+        return res;
+    }
+
+    Test::Register plain("reloc/plain", [] {
+        // mov [rsp+8], rbx; push rdi; sub rsp, 32
+        const uint8_t code[] = {0x48, 0x89, 0x5C, 0x24, 0x08, 0x57, 0x48, 0x83, 0xEC, 0x20};
+        Relocation reloc;
+        REQUIRE(Reloc::Relocate(code, SRC, sizeof(code), 6, NEAR_DST, reloc));
+        CHECK(reloc.error == nullptr);
+        CHECK(reloc.sourceLen == 6);
+        CHECK(reloc.code == concat({{code, code + 6}, absJmp(SRC + 6)}));
+        CHECK(reloc.offsets == std::vector<std::pair<size_t, size_t>>{{0, 0}, {5, 5}});
+    });
+
+    Test::Register ripRelative("reloc/rip_relative", [] {
+        // mov rax, [rip+0x223344]; test rax, rax
+        const uint8_t code[] = {0x48, 0x8B, 0x05, 0x44, 0x33, 0x22, 0x00, 0x48, 0x85, 0xC0};
+        Relocation reloc;
+        REQUIRE(Reloc::Relocate(code, SRC, sizeof(code), 5, NEAR_DST, reloc));
+        REQUIRE(reloc.code.size() == 7 + 14);
+        int32_t disp;
+        memcpy(&disp, reloc.code.data() + 3, sizeof(disp));
+        // Still addresses SRC + 7 + 0x223344 from its new location
+        CHECK(NEAR_DST + 7 + disp == SRC + 7 + 0x223344);
+        CHECK(memcmp(reloc.code.data(), code, 3) == 0);
+
+        CHECK(!Reloc::Relocate(code, SRC, sizeof(code), 5, SRC + 0x100000000, reloc));
+        CHECK(reloc.error != nullptr);
+    });
+
+    Test::Register call("reloc/call", [] {
+        // call rel32; nop
+        const uint8_t code[] = {0xE8, 0x10, 0x20, 0x30, 0x00, 0x90};
+        Relocation reloc;
+        REQUIRE(Reloc::Relocate(code, SRC, sizeof(code), 5, NEAR_DST, reloc));
+        uint64_t target = SRC + 5 + 0x302010;
+        std::vector<uint8_t> absCall = {0xFF, 0x15, 0x02, 0x00, 0x00, 0x00, 0xEB, 0x08};
+        absCall.insert(absCall.end(), (const uint8_t*) &target, (const uint8_t*) &target + sizeof(target));
+        CHECK(reloc.code == concat({absCall, absJmp(SRC + 5)}));
+    });
+
+    Test::Register jmp("reloc/jmp", [] {
+        // jmp rel8 +0x10; nop
+        const uint8_t code[] = {0xEB, 0x10, 0x90};
+        Relocation reloc;
+        REQUIRE(Reloc::Relocate(code, SRC, sizeof(code), 2, NEAR_DST, reloc));
+        CHECK(reloc.code == concat({absJmp(SRC + 2 + 0x10), absJmp(SRC + 2)}));
+    });
+
+    Test::Register conditional("reloc/conditional", [] {
+        // je rel8 +5; nop; nop; nop
+        const uint8_t short8[] = {0x74, 0x05, 0x90, 0x90, 0x90};
+        Relocation reloc;
+        REQUIRE(Reloc::Relocate(short8, SRC, sizeof(short8), 5, NEAR_DST, reloc));
+        // jne over an absolute jmp to the original target
+        CHECK(reloc.code == concat({{0x75, 0x0E}, absJmp(SRC + 7), {0x90, 0x90, 0x90}, absJmp(SRC + 5)}));
+        CHECK(reloc.offsets == std::vector<std::pair<size_t, size_t>>{{0, 0}, {2, 16}, {3, 17}, {4, 18}});
+
+        // je rel32 +0x100
+        const uint8_t near32[] = {0x0F, 0x84, 0x00, 0x01, 0x00, 0x00};
+        REQUIRE(Reloc::Relocate(near32, SRC, sizeof(near32), 5, NEAR_DST, reloc));
+        CHECK(reloc.code == concat({{0x75, 0x0E}, absJmp(SRC + 6 + 0x100), absJmp(SRC + 6)}));
+    });
+
+    Test::Register rcxBranch("reloc/rcx_branch", [] {
+        // jrcxz +5; nop; nop; nop, only has a rel8 form
+        const uint8_t code[] = {0xE3, 0x05, 0x90, 0x90, 0x90};
+        Relocation reloc;
+        REQUIRE(Reloc::Relocate(code, SRC, sizeof(code), 2, NEAR_DST, reloc));
+        CHECK(reloc.code == concat({{0xE3, 0x02, 0xEB, 0x0E}, absJmp(SRC + 7), absJmp(SRC + 2)}));
+    });
+
+    Test::Register rejected("reloc/rejected", [] {
+        Relocation reloc;
+        // je +1 lands inside the bytes the hook overwrites
+        const uint8_t intoWindow[] = {0x74, 0x01, 0x90, 0x90, 0x90, 0x90};
+        CHECK(!Reloc::Relocate(intoWindow, SRC, sizeof(intoWindow), 5, NEAR_DST, reloc));
+        CHECK(reloc.error != nullptr && strcmp(reloc.error, "branch jumps into the relocated code") == 0);
+
+        // ret before the window is covered
+        const uint8_t tooShort[] = {0x90, 0xC3, 0xCC, 0xCC, 0xCC};
+        CHECK(!Reloc::Relocate(tooShort, SRC, sizeof(tooShort), 5, NEAR_DST, reloc));
+        CHECK(reloc.error != nullptr && strcmp(reloc.error, "function is too short to hook") == 0);
+
+        // jmp before the window is covered, the bytes after it may not be code
+        const uint8_t jmpThunk[] = {0xEB, 0x10, 0xCC, 0xCC, 0xCC};
+        CHECK(!Reloc::Relocate(jmpThunk, SRC, sizeof(jmpThunk), 5, NEAR_DST, reloc));
+        CHECK(reloc.error != nullptr && strcmp(reloc.error, "function is too short to hook") == 0);
+
+        // mov [rsp+8], rbx cut off by the end of the readable bytes
+        const uint8_t cut[] = {0x48, 0x89, 0x5C};
+        CHECK(!Reloc::Relocate(cut, SRC, sizeof(cut), 5, NEAR_DST, reloc));
+        CHECK(reloc.error != nullptr);
+    });
+
+    // A ret that is the last relocated instruction is fine, nothing falls through into the jump back
+    Test::Register endsInRet("reloc/ends_in_ret", [] {
+        const uint8_t code[] = {0x48, 0x83, 0xC4, 0x28, 0xC3, 0xCC};
+        Relocation reloc;
+        CHECK(Reloc::Relocate(code, SRC, sizeof(code), 5, NEAR_DST, reloc));
+        CHECK(reloc.sourceLen == 5);
+    });
+}
@@ -0,0 +1,94 @@
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+#include "test.h"
+#include "sigscan.h"
+
+namespace
+{
+    const uint8_t* naiveFind(const uint8_t* data, size_t len, const Pattern& pattern, size_t& count)
+    {
+        const uint8_t* first = nullptr;
+        count = 0;
+        for (size_t pos = 0; pattern.bytes.size() <= len && pos <= len - pattern.bytes.size(); pos++)
+        {
+            bool match = true;
+            for (size_t i = 0; i < pattern.bytes.size() && match; i++)
+            {
+                match = (data[pos + i] & pattern.mask[i]) == pattern.bytes[i];
+            }
+            if (!match) continue;
+            if (first == nullptr) first = data + pos;
+            count++;
+        }
+        return first;
+    }
+
+    Test::Register parse("sigscan/parse", [] {
+        Pattern pattern;
+        REQUIRE(SigScan::Parse("48 8B 05 ?? ? ?? c3", pattern));
+        CHECK(pattern.bytes == std::vector<uint8_t>{0x48, 0x8B, 0x05, 0, 0, 0, 0xC3});
+        CHECK(pattern.mask == std::vector<uint8_t>{0xFF, 0xFF, 0xFF, 0, 0, 0, 0xFF});
+        CHECK(SigScan::Format(pattern) == "48 8B 05 ?? ?? ?? C3");
+        // Without spaces
+        REQUIRE(SigScan::Parse("488B??C3", pattern));
+        CHECK(SigScan::Format(pattern) == "48 8B ?? C3");
+
+        CHECK(!SigScan::Parse("", pattern));
+        CHECK(!SigScan::Parse("?? ??", pattern));
+        CHECK(!SigScan::Parse("48 8G", pattern));
+        CHECK(!SigScan::Parse("48 8", pattern));
+    });
+
+    // Matches right at the end of the buffer, which is sized exactly so sanitizers catch reads past it
+    Test::Register edges("sigscan/edges", [] {
+        Pattern pattern;
+        REQUIRE(SigScan::Parse("?? E8 ?? ?? ?? ?? 90 ??", pattern));
+        for (size_t len = 0; len < 100; len++)
+        {
+            auto data = std::make_unique<uint8_t[]>(len);
+            memset(data.get(), 0xCC, len);
+            if (len >= pattern.bytes.size())
+            {
+                uint8_t* at = data.get() + len - pattern.bytes.size();
+                at[1] = 0xE8;
+                at[6] = 0x90;
+            }
+            const uint8_t* found = SigScan::Find(data.get(), len, pattern);
+            if (len < pattern.bytes.size()) CHECK(found == nullptr);
+            else CHECK(found == data.get() + len - pattern.bytes.size());
+            CHECK(SigScan::Count(data.get(), len, pattern, 10) == (len >= pattern.bytes.size() ? 1u : 0u));
+        }
+    });
+
+    // Random patterns against random code over a small alphabet so partial matches are common, compared with a
+    // byte by byte scan. The lengths cover the vector loops and the scalar tail
+    Test::Register randomized("sigscan/randomized", [] {
+        std::mt19937 random(42);
+        const uint8_t alphabet[] = {0x48, 0x8B, 0x89, 0xCC, 0xE8, 0x00};
+        for (int round = 0; round < 2000; round++)
+        {
+            size_t len = random() % 300;
+            auto data = std::make_unique<uint8_t[]>(len);
+            for (size_t i = 0; i < len; i++) data[i] = alphabet[random() % sizeof(alphabet)];
+
+            Pattern pattern;
+            size_t patternLen = 1 + random() % 12;
+            for (size_t i = 0; i < patternLen; i++)
+            {
+                bool wildcard = random() % 4 == 0;
+                pattern.bytes.push_back(wildcard ? 0 : alphabet[random() % 4]);
+                pattern.mask.push_back(wildcard ? 0x00 : 0xFF);
+            }
+            pattern.mask[random() % patternLen] = 0xFF;
+            for (size_t i = 0; i < patternLen; i++) pattern.bytes[i] &= pattern.mask[i];
+
+            size_t expectedCount;
+            const uint8_t* expected = naiveFind(data.get(), len, pattern, expectedCount);
+            CHECK(SigScan::Find(data.get(), len, pattern) == expected);
+            CHECK(SigScan::Count(data.get(), len, pattern, SIZE_MAX) == expectedCount);
+            CHECK(SigScan::Count(data.get(), len, pattern, 2) == (expectedCount < 2 ? expectedCount : 2));
+        }
+    });
+}
@@ -0,0 +1,95 @@
+// Runs stdlib.js's module system under node, the game's QuickJS isn't available on the host.
+// Usage: node test_stdlib.js path/to/stdlib.js
+
+const fs = require('fs');
+const vm = require('vm');
+
+let failures = 0;
+const cases = [];
+
+function test(name, fn) {
+	cases.push({ 'name': name, 'fn': fn });
+}
+
+function check(cond, expr) {
+	if (!cond) {
+		console.error('  CHECK(' + expr + ') failed');
+		failures++;
+	}
+}
+
+// Fresh stdlib for every case, rpc messages go through print and are collected
+function load() {
+	const sandbox = { 'printed': [], 'console': { 'log': () => {}, 'error': (ex) => console.error(ex) } };
+	sandbox.print = (msg) => sandbox.printed.push(msg);
+	vm.createContext(sandbox);
+	vm.runInContext(fs.readFileSync(process.argv[2], 'utf8'), sandbox, { 'filename': 'stdlib.js' });
+	return sandbox;
+}
+
+test('stdlib/require', () => {
+	const js = load();
+	let runs = 0;
+	js.mp_define('a/b', (module, exports, require) => { runs++; exports.value = 42; });
+	js.mp_resolved('a', './b', 'a/b');
+	const require = js.mp_makeRequire('a');
+	check(require('./b').value === 42, "require('./b').value === 42");
+	check(require('./b') === require('./b'), 'modules are shared');
+	check(runs === 1, 'runs === 1');
+});
+
+test('stdlib/require_circular', () => {
+	const js = load();
+	js.mp_define('x', (module, exports, require) => { exports.early = true; exports.y = require('./y').seen; });
+	js.mp_define('y', (module, exports, require) => { exports.seen = require('./x').early; });
+	js.mp_resolved('', './x', 'x');
+	js.mp_resolved('', './y', 'y');
+	check(js.mp_makeRequire('')('./x').y === true, 'partial exports are visible to a cycle');
+});
+
+test('stdlib/require_throws', () => {
+	const js = load();
+	let runs = 0;
+	js.mp_define('flaky', (module, exports) => {
+		runs++;
+		if (runs === 1) throw new Error('first load fails');
+		exports.ok = true;
+	});
+	js.mp_resolved('', 'flaky', 'flaky');
+	const require = js.mp_makeRequire('');
+
+	let thrown = null;
+	try {
+		require('flaky');
+	} catch (ex) {
+		thrown = ex;
+	}
+	check(thrown !== null && thrown.message === 'first load fails', 'the factory error reaches the caller');
+	// The failed load isn't cached, the next require runs the factory again
+	check(require('flaky').ok === true, "require('flaky').ok === true");
+	check(runs === 2, 'runs === 2');
+});
+
+test('stdlib/require_missing', () => {
+	const js = load();
+	let thrown = null;
+	try {
+		js.mp_makeRequire('mods/a')('./nope');
+	} catch (ex) {
+		thrown = ex;
+	}
+	check(thrown !== null && thrown.message.includes("Cannot find module './nope'"), 'missing modules throw');
+	check(js.printed.length === 1 && JSON.parse(js.printed[0].substring('<omori-patcher>: '.length)).func === 7,
+		'unresolved specs are sent to the patcher');
+});
+
+let failed = 0;
+for (const c of cases) {
+	const before = failures;
+	c.fn();
+	const ok = failures === before;
+	if (!ok) failed++;
+	console.log((ok ? 'ok' : 'FAIL').padEnd(4) + ' ' + c.name);
+}
+console.log((cases.length - failed) + ' of ' + cases.length + ' tests passed');
+process.exit(failed === 0 ? 0 : 1);
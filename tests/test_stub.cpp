@@ -0,0 +1,195 @@
+#include <cstring>
+#include <vector>
+#include "test.h"
+#include "stub.h"
+
+namespace
+{
+    // Registers a stub saves and restores, read back from its machine code
+    struct StubShape
+    {
+        bool ok = false;
+        bool pushesFlags = false;
+        bool popsFlags = false;
+        std::vector<int> pushed;
+        std::vector<int> popped;
+        int xmmStores = 0;
+        int xmmLoads = 0;
+    };
+
+    bool match(const Stub::StubTemplate& stub, size_t pos, std::initializer_list<uint8_t> bytes)
+    {
+        if (pos + bytes.size() > stub.size) return false;
+        return memcmp(stub.code + pos, bytes.begin(), bytes.size()) == 0;
+    }
+
+    /**
+     * Walks the prologue up to the stack alignment and the epilogue from the lea restoring rsp
+     */
+    StubShape shapeOf(const Stub::StubTemplate& stub)
+    {
+        StubShape shape;
+        size_t pos = 0;
+        if (match(stub, pos, {0x9C})) shape.pushesFlags = true, pos++;
+        if (!match(stub, pos, {0x53, 0x48, 0x89, 0xE3})) return shape;
+        pos += 4;
+        while (pos < stub.size && !match(stub, pos, {0x48, 0x83, 0xE4, 0xF0}))
+        {
+            int high = stub.code[pos] == 0x41 ? 8 : 0;
+            if (high) pos++;
+            if (pos >= stub.size || stub.code[pos] < 0x50 || stub.code[pos] > 0x57) return shape;
+            shape.pushed.push_back(high + stub.code[pos++] - 0x50);
+        }
+
+        for (size_t i = 0; i + 3 < stub.size; i++)
+        {
+            size_t op = stub.code[i + 1] == 0x44 ? i + 2 : i + 1;
+            if (stub.code[i] != 0xF3 || stub.code[op] != 0x0F) continue;
+            if (stub.code[op + 1] == 0x7F) shape.xmmStores++;
+            if (stub.code[op + 1] == 0x6F) shape.xmmLoads++;
+        }
+
+        size_t lea = 0;
+        for (size_t i = 0; i + 4 <= stub.size; i++)
+        {
+            if (match(stub, i, {0x48, 0x8D, 0x63})) lea = i;
+        }
+        if (lea == 0) return shape;
+        pos = lea + 4;
+        while (pos < stub.size && stub.code[pos] != 0x5B)
+        {
+            int high = stub.code[pos] == 0x41 ? 8 : 0;
+            if (high) pos++;
+            if (pos >= stub.size || stub.code[pos] < 0x58 || stub.code[pos] > 0x5F) return shape;
+            shape.popped.push_back(high + stub.code[pos++] - 0x58);
+        }
+        if (pos++ >= stub.size) return shape;
+        if (pos < stub.size && stub.code[pos] == 0x9D) shape.popsFlags = true, pos++;
+        shape.ok = pos == stub.size;
+        return shape;
+    }
+
+    bool isMovRaxSlot(const Stub::StubTemplate& stub, size_t slot)
+    {
+        return slot >= 2 && match(stub, slot - 2, {0x48, 0xB8}) && match(stub, slot + 8, {0xFF, 0xD0});
+    }
+
+    Test::Register volatileShape("stub/volatile_shape", [] {
+        const Stub::StubTemplate& stub = Stub::Precompiled<Stub::volatileSpec, false>;
+        REQUIRE(stub.error == nullptr);
+        StubShape shape = shapeOf(stub);
+        REQUIRE(shape.ok);
+        CHECK(shape.pushesFlags && shape.popsFlags);
+        CHECK(shape.pushed == std::vector<int>{GP_RAX, GP_RCX, GP_RDX, GP_R8, GP_R9, GP_R10, GP_R11});
+        CHECK(shape.popped == std::vector<int>{GP_R11, GP_R10, GP_R9, GP_R8, GP_RDX, GP_RCX, GP_RAX});
+        CHECK(shape.xmmStores == 6);
+        CHECK(shape.xmmLoads == 6);
+        CHECK(stub.callbackSlot == 0);
+        CHECK(isMovRaxSlot(stub, stub.hookSlot));
+    });
+
+    Test::Register callbackSlot("stub/callback_slot", [] {
+        Stub::StubTemplate stub = Stub::Build(Stub::volatileSpec, true);
+        REQUIRE(stub.error == nullptr);
+        CHECK(isMovRaxSlot(stub, stub.callbackSlot));
+        CHECK(isMovRaxSlot(stub, stub.hookSlot));
+        CHECK(stub.callbackSlot < stub.hookSlot);
+        CHECK(stub.size == Stub::Precompiled<Stub::volatileSpec, false>.size + 12);
+    });
+
+    Test::Register signatureSpec("stub/signature_spec", [] {
+        constexpr StubSpec spec = Stub::Signature<void (*)(int, double, void*, float, int, int)>::spec();
+        CHECK(spec.gpMask == ((1 << GP_RCX) | (1 << GP_R8)));
+        CHECK(spec.xmmMask == 0b1010);
+        CHECK(!spec.saveFlags);
+        CHECK(spec.stackArgs == 2);
+
+        constexpr StubSpec none = Stub::Signature<void (*)()>::spec();
+        CHECK(none.gpMask == 0 && none.xmmMask == 0 && none.stackArgs == 0);
+    });
+
+    Test::Register parameterPrefix("stub/parameter_prefix", [] {
+        using Target = int (*)(void*, char*, int, double, int);
+        CHECK(Stub::ParameterPrefix<void (*)(), Target>::value);
+        CHECK(Stub::ParameterPrefix<void (*)(void*, char*), Target>::value);
+        CHECK(Stub::ParameterPrefix<int (*)(void*, char*, int, double, int), Target>::value);
+        CHECK(!Stub::ParameterPrefix<void (*)(char*), Target>::value);
+        CHECK(!Stub::ParameterPrefix<void (*)(void*, char*, int, double, int, int), Target>::value);
+    });
+
+    // A hook taking fewer parameters than its target still keeps all of the target's argument registers alive
+    Test::Register entrySpec("stub/entry_spec", [] {
+        constexpr StubSpec spec = Stub::EntrySpec<void (*)(void*, char*, double, int, int, int), void (*)(void*)>();
+        CHECK(spec.gpMask == ((1 << GP_RCX) | (1 << GP_RDX) | (1 << GP_R9)));
+        CHECK(spec.xmmMask == 0b100);
+        CHECK(spec.stackArgs == 0);
+
+        constexpr StubSpec stack =
+                Stub::EntrySpec<void (*)(int, int, int, int, int, int), void (*)(int, int, int, int, int)>();
+        CHECK(stack.stackArgs == 1);
+    });
+
+    // An entry hook only keeps its arguments alive, so its stub is a fraction of the volatile one
+    Test::Register entryShape("stub/entry_shape", [] {
+        constexpr StubSpec spec = Stub::Signature<int (*)(void*, int)>::spec();
+        Stub::StubTemplate stub = Stub::Build(spec, false);
+        REQUIRE(stub.error == nullptr);
+        StubShape shape = shapeOf(stub);
+        REQUIRE(shape.ok);
+        CHECK(!shape.pushesFlags && !shape.popsFlags);
+        CHECK(shape.pushed == std::vector<int>{GP_RCX, GP_RDX});
+        CHECK(shape.popped == std::vector<int>{GP_RDX, GP_RCX});
+        CHECK(shape.xmmStores == 0);
+        CHECK(stub.size < Stub::Precompiled<Stub::volatileSpec, false>.size / 2);
+    });
+
+    Test::Register stackArgs("stub/stack_args", [] {
+        StubSpec spec = {1 << GP_RCX, 0, false, 3};
+        Stub::StubTemplate stub = Stub::Build(spec, false);
+        REQUIRE(stub.error == nullptr);
+        REQUIRE(shapeOf(stub).ok);
+        // Each argument is copied from above the hooked function's return address into the hook's own frame
+        for (uint8_t i = 0; i < 3; i++)
+        {
+            bool found = false;
+            for (size_t pos = 0; pos + 9 <= stub.size && !found; pos++)
+            {
+                found = match(stub, pos, {0x48, 0x8B, 0x43, (uint8_t) (48 + i * 8),
+                                          0x48, 0x89, 0x44, 0x24, (uint8_t) (32 + i * 8)});
+            }
+            CHECK(found);
+        }
+    });
+
+    Test::Register limits("stub/limits", [] {
+        StubSpec largest = {0xFFFF, 0xFFFF, true, Stub::MAX_STACK_ARGS};
+        Stub::StubTemplate stub = Stub::Build(largest, true);
+        CHECK(stub.error == nullptr);
+        CHECK(stub.size <= Stub::MAX_STUB_SIZE);
+        StubShape shape = shapeOf(stub);
+        CHECK(shape.ok);
+        CHECK(shape.pushed.size() == 14);
+        CHECK(shape.xmmStores == 16 && shape.xmmLoads == 16);
+
+        largest.stackArgs = Stub::MAX_STACK_ARGS + 1;
+        CHECK(Stub::Build(largest, false).error != nullptr);
+    });
+
+    Test::Register instantiate("stub/instantiate", [] {
+        const Stub::StubTemplate& stub = Stub::Precompiled<Stub::volatileSpec, true>;
+        std::vector<uint8_t> out;
+        Stub::Instantiate(stub, 0x1122334455667788, 0x99AABBCCDDEEFF00, 0x1234, out);
+        REQUIRE(out.size() == stub.size);
+        uint64_t hook, callback;
+        memcpy(&hook, out.data() + stub.hookSlot, sizeof(hook));
+        memcpy(&callback, out.data() + stub.callbackSlot, sizeof(callback));
+        CHECK(hook == 0x1122334455667788);
+        CHECK(callback == 0x99AABBCCDDEEFF00);
+        for (size_t i = 0; i < stub.size; i++)
+        {
+            bool inSlot = (i >= stub.hookSlot && i < stub.hookSlot + 8) ||
+                          (i >= stub.callbackSlot && i < stub.callbackSlot + 8);
+            if (!inSlot) CHECK(out[i] == stub.code[i]);
+        }
+    });
+}
@@ -0,0 +1,320 @@
+// Turns omori-patcher.binlog back into text
+// Usage: binlog-decode [--level info|success|warn|error|debug] [--thread <id>] <file.binlog>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include "binlog_format.h"
+
+#ifdef _WIN32
+#define strcasecmp _stricmp
+#endif
+
+using namespace BinLogFormat;
+
+struct Format
+{
+    uint8_t level;
+    std::string file;
+    uint32_t line;
+    std::string format;
+};
+
+struct Arg
+{
+    ArgType type;
+    uint64_t value;
+    std::string text;
+};
+
+const char* levelNames[] = {"", "INFO", "SUCCESS", "WARN", "ERROR", "DEBUG"};
+const int levelCount = sizeof(levelNames) / sizeof(levelNames[0]);
+
+class Reader
+{
+public:
+    const std::vector<char>& data;
+    size_t pos = 0;
+
+    explicit Reader(const std::vector<char>& data) : data(data) {}
+
+    bool read(void* out, size_t len)
+    {
+        if (pos + len > data.size()) return false;
+        memcpy(out, data.data() + pos, len);
+        pos += len;
+        return true;
+    }
+
+    template<typename T>
+    bool value(T& out)
+    {
+        return read(&out, sizeof(out));
+    }
+
+    bool string(std::string& out, size_t len)
+    {
+        if (pos + len > data.size()) return false;
+        out.assign(data.data() + pos, len);
+        pos += len;
+        return true;
+    }
+};
+
+std::string utf16ToUtf8(const std::string& bytes)
+{
+    std::string out;
+    for (size_t i = 0; i + 1 < bytes.size(); i += 2)
+    {
+        uint32_t c = (uint8_t) bytes[i] | (uint8_t) bytes[i + 1] << 8;
+        if (c >= 0xD800 && c < 0xDC00 && i + 3 < bytes.size())
+        {
+            uint32_t low = (uint8_t) bytes[i + 2] | (uint8_t) bytes[i + 3] << 8;
+            c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+            i += 2;
+        }
+        if (c < 0x80) out += (char) c;
+        else if (c < 0x800)
+        {
+            out += (char) (0xC0 | c >> 6);
+            out += (char) (0x80 | (c & 0x3F));
+        }
+        else if (c < 0x10000)
+        {
+            out += (char) (0xE0 | c >> 12);
+            out += (char) (0x80 | (c >> 6 & 0x3F));
+            out += (char) (0x80 | (c & 0x3F));
+        }
+        else
+        {
+            out += (char) (0xF0 | c >> 18);
+            out += (char) (0x80 | (c >> 12 & 0x3F));
+            out += (char) (0x80 | (c >> 6 & 0x3F));
+            out += (char) (0x80 | (c & 0x3F));
+        }
+    }
+    return out;
+}
+
+/**
+ * Formats printf style with recorded arguments, length modifiers are replaced with the ones matching the recorded
+ * 64 bit values
+ */
+std::string format(const std::string& fmt, const std::vector<Arg>& args)
+{
+    std::string out;
+    size_t next = 0;
+    char buf[512];
+    for (size_t i = 0; i < fmt.size(); i++)
+    {
+        if (fmt[i] != '%')
+        {
+            out += fmt[i];
+            continue;
+        }
+        if (i + 1 < fmt.size() && fmt[i + 1] == '%')
+        {
+            out += '%';
+            i++;
+            continue;
+        }
+
+        // Flags, width and precision are kept, length modifiers are dropped
+        std::string spec = "%";
+        size_t j = i + 1;
+        while (j < fmt.size() && strchr("-+ #0123456789.*", fmt[j]) != nullptr)
+        {
+            char c = fmt[j++];
+            if (c != '*')
+            {
+                spec += c;
+                continue;
+            }
+            // A * width or precision was recorded as an int argument ahead of the value
+            int value = next < args.size() ? (int) args[next++].value : 0;
+            // Negative precision means none, a negative width is a left justified one and works as is
+            if (value < 0 && spec.back() == '.') spec.pop_back();
+            else spec += std::to_string(value);
+        }
+        while (j < fmt.size() && strchr("hlLqjzztI64", fmt[j]) != nullptr) j++;
+        if (j >= fmt.size()) break;
+        char conversion = fmt[j];
+        i = j;
+
+        if (next >= args.size())
+        {
+            out += "<missing>";
+            continue;
+        }
+        const Arg& arg = args[next++];
+        if (arg.type == ARG_STRING || arg.type == ARG_WSTRING)
+        {
+            snprintf(buf, sizeof(buf), (spec + "s").c_str(), arg.text.c_str());
+        }
+        else if (arg.type == ARG_DOUBLE || strchr("fFeEgGaA", conversion) != nullptr)
+        {
+            double value;
+            memcpy(&value, &arg.value, sizeof(value));
+            if (arg.type != ARG_DOUBLE) value = (double) (int64_t) arg.value;
+            snprintf(buf, sizeof(buf), (spec + conversion).c_str(), value);
+        }
+        else if (conversion == 'p' || arg.type == ARG_POINTER)
+        {
+            // Matches MSVC's %p, which is what the patcher's own text log prints
+            if (spec == "%") spec = "%016";
+            snprintf(buf, sizeof(buf), (spec + "llX").c_str(), (unsigned long long) arg.value);
+        }
+        else if (conversion == 'c')
+        {
+            snprintf(buf, sizeof(buf), (spec + "c").c_str(), (int) arg.value);
+        }
+        else if (conversion == 'd' || conversion == 'i')
+        {
+            snprintf(buf, sizeof(buf), (spec + "lld").c_str(), (long long) arg.value);
+        }
+        else
+        {
+            snprintf(buf, sizeof(buf), (spec + "ll" + conversion).c_str(), (unsigned long long) arg.value);
+        }
+        out += buf;
+    }
+    return out;
+}
+
+int parseLevel(const char* name)
+{
+    for (int i = 1; i < levelCount; i++)
+    {
+        if (strcasecmp(name, levelNames[i]) == 0) return i;
+    }
+    return -1;
+}
+
+// Debug is the most verbose level even though it was added last
+int severity(int level)
+{
+    return level == 5 ? 0 : level;
+}
+
+int main(int argc, char** argv)
+{
+    int minLevel = -1;
+    long long thread = -1;
+    const char* path = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--level") == 0 && i + 1 < argc)
+        {
+            minLevel = parseLevel(argv[++i]);
+            if (minLevel < 0)
+            {
+                fprintf(stderr, "Unknown level %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--thread") == 0 && i + 1 < argc)
+        {
+            thread = strtoll(argv[++i], nullptr, 0);
+        }
+        else
+        {
+            path = argv[i];
+        }
+    }
+    if (path == nullptr)
+    {
+        fprintf(stderr, "Usage: %s [--level info|success|warn|error|debug] [--thread <id>] <file.binlog>\n", argv[0]);
+        return 1;
+    }
+
+    FILE* file = fopen(path, "rb");
+    if (file == nullptr)
+    {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return 1;
+    }
+    std::vector<char> data;
+    char chunk[65536];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) data.insert(data.end(), chunk, chunk + n);
+    fclose(file);
+
+    Reader reader(data);
+    char magic[4];
+    uint32_t version;
+    if (!reader.read(magic, sizeof(magic)) || memcmp(magic, MAGIC, sizeof(magic)) != 0 || !reader.value(version) ||
+        version != VERSION)
+    {
+        fprintf(stderr, "%s isn't a version %u binary log\n", path, VERSION);
+        return 1;
+    }
+
+    std::map<uint32_t, Format> formats;
+    uint64_t firstNs = 0;
+    while (reader.pos < data.size())
+    {
+        uint8_t type;
+        uint32_t id;
+        if (!reader.value(type) || !reader.value(id)) break;
+        if (type == RECORD_FORMAT)
+        {
+            Format fmt;
+            uint16_t fileLen, formatLen;
+            if (!reader.value(fmt.level) || !reader.value(fmt.line) || !reader.value(fileLen) ||
+                !reader.string(fmt.file, fileLen) || !reader.value(formatLen) || !reader.string(fmt.format, formatLen))
+            {
+                break;
+            }
+            formats[id] = fmt;
+            continue;
+        }
+        if (type != RECORD_EVENT)
+        {
+            fprintf(stderr, "Unknown record type %u at offset %zu\n", type, reader.pos - 5);
+            return 1;
+        }
+
+        uint32_t threadId;
+        uint64_t timeNs;
+        uint8_t argCount;
+        if (!reader.value(threadId) || !reader.value(timeNs) || !reader.value(argCount)) break;
+        bool truncated = (argCount & EVENT_TRUNCATED) != 0;
+        std::vector<Arg> args(argCount & ARG_COUNT_MASK);
+        bool ok = true;
+        for (Arg& arg : args)
+        {
+            ok = reader.value(arg.type);
+            if (!ok) break;
+            if (arg.type == ARG_STRING || arg.type == ARG_WSTRING)
+            {
+                uint32_t len;
+                ok = reader.value(len) && reader.string(arg.text, len);
+                if (arg.type == ARG_WSTRING) arg.text = utf16ToUtf8(arg.text);
+            }
+            else
+            {
+                ok = reader.value(arg.value);
+            }
+            if (!ok) break;
+        }
+        if (!ok) break;
+        if (firstNs == 0) firstNs = timeNs;
+
+        auto it = formats.find(id);
+        if (it == formats.end())
+        {
+            fprintf(stderr, "Event with unknown format %u\n", id);
+            continue;
+        }
+        const Format& fmt = it->second;
+        if (minLevel >= 0 && severity(fmt.level) < severity(minLevel)) continue;
+        if (thread >= 0 && threadId != (uint64_t) thread) continue;
+
+        const char* levelName = fmt.level < levelCount ? levelNames[fmt.level] : "?";
+        printf("%12.3f ms  %6u  %-7s  %s%s\n", (double) (timeNs - firstNs) / 1e6, threadId, levelName,
+               format(fmt.format, args).c_str(), truncated ? " [truncated]" : "");
+    }
+    if (reader.pos < data.size()) fprintf(stderr, "Truncated record at offset %zu\n", reader.pos);
+    return 0;
+}
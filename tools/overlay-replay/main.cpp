@@ -0,0 +1,289 @@
+// Replays a trace captured with overlay.capture against the overlay engine and reports how fast it handled the calls
+// Usage: overlay-replay [--root <dir>] [--iterations <n>] [--cache-bytes <n>] [--profile <file>] <trace>
+//
+// With --root files are opened for real through PosixFileApi, see fileapi_posix.h for how paths are mapped.
+// Without it a synthetic file api that never touches the disk is used, which times the overlay alone.
+// --cache-bytes serves replaced files from a content cache of that budget, like overlay.cacheBytes. --profile records
+// and prefetches from an access profile like overlay.profile, the first replay against a new one only records it
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <unordered_map>
+#include <vector>
+#include "fileapi_posix.h"
+#include "overlay.h"
+#include "overlaytrace.h"
+#include "prefetch.h"
+
+using namespace OverlayTrace;
+
+// Counts every operator new so allocations per call can be reported
+std::atomic<uint64_t> allocations = 0;
+
+void* operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = malloc(size != 0 ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
+
+/**
+ * Pretends every open succeeds and every read fills the whole buffer, without touching the buffer
+ */
+class SyntheticFileApi : public PosixFileApi
+{
+public:
+    FileHandle createFile(const wchar_t*, uint32_t, uint32_t, void*, uint32_t, uint32_t, FileHandle) override
+    {
+        return (FileHandle) (intptr_t) ++nextHandle;
+    }
+
+    bool readFile(FileHandle, void*, uint32_t size, uint32_t* read, void*) override
+    {
+        if (read != nullptr) *read = size;
+        return true;
+    }
+
+    bool setFilePointer(FileHandle, int64_t distance, int64_t* newPointer, uint32_t) override
+    {
+        if (newPointer != nullptr) *newPointer = distance;
+        return true;
+    }
+
+    bool closeFile(FileHandle) override
+    {
+        return true;
+    }
+
+private:
+    intptr_t nextHandle = 0;
+};
+
+struct OpStats
+{
+    const char* name = nullptr;
+    std::vector<uint64_t> ns{};
+    std::vector<uint64_t> recordedNs{};
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+};
+
+uint64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t percentile(std::vector<uint64_t>& values, double p)
+{
+    if (values.empty()) return 0;
+    auto index = (size_t) (p * (double) (values.size() - 1));
+    std::nth_element(values.begin(), values.begin() + (ptrdiff_t) index, values.end());
+    return values[index];
+}
+
+int main(int argc, char** argv)
+{
+    const char* root = nullptr;
+    const char* path = nullptr;
+    int iterations = 1;
+    size_t cacheBytes = 0;
+    const char* profile = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--root") == 0 && i + 1 < argc) root = argv[++i];
+        else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) iterations = std::max(atoi(argv[++i]), 1);
+        else if (strcmp(argv[i], "--cache-bytes") == 0 && i + 1 < argc) cacheBytes = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) profile = argv[++i];
+        else path = argv[i];
+    }
+    if (path == nullptr)
+    {
+        fprintf(stderr, "Usage: %s [--root <dir>] [--iterations <n>] [--cache-bytes <n>] [--profile <file>] <trace>\n", argv[0]);
+        return 1;
+    }
+
+    Trace trace;
+    std::string error;
+    if (!Load(path, trace, error))
+    {
+        fprintf(stderr, "%s: %s\n", path, error.c_str());
+        return 1;
+    }
+
+    SyntheticFileApi synthetic;
+    PosixFileApi posix(root != nullptr ? root : "");
+    FileApi& api = root != nullptr ? (FileApi&) posix : (FileApi&) synthetic;
+    OverlayEngine engine(api);
+    engine.contentCache().configure(cacheBytes, 0);
+    for (const auto& [from, to] : trace.overlay) engine.add(from, to);
+    engine.freeze();
+    std::unique_ptr<Prefetcher> prefetcher;
+    if (profile != nullptr)
+    {
+        prefetcher = std::make_unique<Prefetcher>(engine, true, 512);
+        if (!prefetcher->load(profile, error)) printf("%s, recording a new profile\n", error.c_str());
+        engine.setListener(prefetcher.get());
+        prefetcher->start();
+    }
+
+    OpStats stats[4] = {{"CreateFileW"}, {"ReadFile"}, {"SetFilePointerEx"}, {"CloseHandle"}};
+    auto statsFor = [&stats](Op op) -> OpStats& {
+        return stats[op == OP_CREATE ? 0 : op == OP_READ ? 1 : op == OP_SEEK ? 2 : 3];
+    };
+    uint32_t maxRead = 0;
+    for (const Event& event : trace.events)
+    {
+        if (event.op == OP_READ) maxRead = std::max(maxRead, event.size);
+        OpStats& op = statsFor(event.op);
+        op.recordedNs.push_back(event.ns);
+        op.ns.reserve(op.ns.size() + iterations);
+    }
+    std::vector<char> buffer(std::max<uint32_t>(maxRead, 1));
+    std::unordered_map<uint64_t, FileHandle> handles;
+    handles.reserve(trace.events.size());
+    uint64_t skipped = 0;
+    uint64_t failed = 0;
+    uint64_t redirects = 0;
+
+    uint64_t wallStart = nowNs();
+    for (int iteration = 0; iteration < iterations; iteration++)
+    {
+        for (const Event& event : trace.events)
+        {
+            FileHandle handle = nullptr;
+            if (event.op != OP_CREATE)
+            {
+                auto it = handles.find(event.handle);
+                // Handles the trace didn't see being opened, like the console
+                if (it == handles.end())
+                {
+                    skipped++;
+                    continue;
+                }
+                handle = it->second;
+            }
+
+            OpStats& op = statsFor(event.op);
+            bool ok = true;
+            uint32_t read = 0;
+            int64_t pointer = 0;
+            bool redirected = false;
+            uint64_t allocationsBefore = allocations.load(std::memory_order_relaxed);
+            uint64_t start = nowNs();
+            switch (event.op)
+            {
+                case OP_CREATE:
+                    handle = engine.createFile(event.path.c_str(), event.access, event.share, nullptr,
+                                               event.disposition, event.flags, nullptr, &redirected);
+                    ok = handle != INVALID_FILE_HANDLE;
+                    break;
+                case OP_READ:
+                    ok = engine.readFile(handle, buffer.data(), event.size, &read, nullptr);
+                    break;
+                case OP_SEEK:
+                    ok = engine.setFilePointer(handle, event.distance, &pointer, event.method);
+                    break;
+                case OP_CLOSE:
+                    ok = engine.closeFile(handle);
+                    break;
+            }
+            op.ns.push_back(nowNs() - start);
+            op.allocations += allocations.load(std::memory_order_relaxed) - allocationsBefore;
+            op.bytes += read;
+            if (!ok) failed++;
+            if (redirected) redirects++;
+
+            if (event.op == OP_CREATE && ok)
+            {
+                // The game got the same handle back after closing it
+                auto it = handles.find(event.handle);
+                if (it != handles.end()) engine.closeFile(it->second);
+                handles[event.handle] = handle;
+            }
+            else if (event.op == OP_CLOSE)
+            {
+                handles.erase(event.handle);
+            }
+        }
+        for (const auto& [recorded, handle] : handles) engine.closeFile(handle);
+        handles.clear();
+    }
+    uint64_t wallNs = nowNs() - wallStart;
+
+    uint64_t calls = 0;
+    uint64_t callNs = 0;
+    uint64_t bytes = 0;
+    printf("%zu overlay entries, %zu events x %d, %s file api\n", trace.overlay.size(), trace.events.size(),
+           iterations, root != nullptr ? "posix" : "synthetic");
+    printf("%-18s %10s %10s %10s %10s %12s %12s\n", "call", "count", "p50 ns", "p99 ns", "allocs", "game p50", "game p99");
+    for (OpStats& op : stats)
+    {
+        if (op.ns.empty()) continue;
+        for (uint64_t ns : op.ns) callNs += ns;
+        calls += op.ns.size();
+        bytes += op.bytes;
+        printf("%-18s %10zu %10llu %10llu %10.2f %12llu %12llu\n", op.name, op.ns.size(),
+               (unsigned long long) percentile(op.ns, 0.5), (unsigned long long) percentile(op.ns, 0.99),
+               (double) op.allocations / (double) op.ns.size(),
+               (unsigned long long) percentile(op.recordedNs, 0.5), (unsigned long long) percentile(op.recordedNs, 0.99));
+    }
+    printf("%llu calls in %.2f ms (%.2f ms wall): %.0f calls/s, %.1f MB/s read\n", (unsigned long long) calls,
+           (double) callNs / 1e6, (double) wallNs / 1e6, callNs != 0 ? (double) calls * 1e9 / (double) callNs : 0,
+           callNs != 0 ? (double) bytes * 1e3 / (double) callNs : 0);
+    printf("%llu redirected opens, %llu failed calls, %llu calls on handles opened before the trace\n",
+           (unsigned long long) redirects, (unsigned long long) failed, (unsigned long long) skipped);
+    if (prefetcher != nullptr)
+    {
+        Prefetcher::Stats prefetch = prefetcher->stats();
+        printf("prefetch: %llu scenes, %llu queued, %llu warmed (%llu KB), %llu used, %llu late, %llu dropped\n",
+               (unsigned long long) prefetch.scenes, (unsigned long long) prefetch.queued,
+               (unsigned long long) prefetch.warmed, (unsigned long long) prefetch.warmedBytes / 1024,
+               (unsigned long long) prefetch.used, (unsigned long long) prefetch.late,
+               (unsigned long long) prefetch.dropped);
+        if (!prefetcher->save(profile)) fprintf(stderr, "Failed to write %s\n", profile);
+    }
+    if (engine.contentCache().enabled())
+    {
+        ContentCache::Stats cache = engine.contentCache().stats();
+        printf("cache: %llu hits, %llu misses, %llu too large, %llu evictions, %zu files in %zu KB, peak %zu KB\n",
+               (unsigned long long) cache.hits, (unsigned long long) cache.misses, (unsigned long long) cache.skipped,
+               (unsigned long long) cache.evictions, cache.entries, cache.bytes / 1024, cache.peakBytes / 1024);
+        if (prefetcher != nullptr)
+        {
+            printf("cache: %llu opens served from prefetched files, %llu prefetched files evicted unused\n",
+                   (unsigned long long) cache.prefetchHits, (unsigned long long) cache.prefetchEvictions);
+        }
+    }
+    return 0;
+}